@@ -0,0 +1,1367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#ifndef STL_NO_ZLIB
+#include <zlib.h>
+#endif
+
+#include "stl3d_lib.h"
+
+/* Checks for the results that are meant to come out exactly the same
+ * whichever way they are worked out. Run by "make check" from the top of the
+ * tree, since the test part is loaded from test_data. Prints what failed
+ * and exits non-zero if anything did.
+ */
+
+#define CHECK_MESH   "test_data/stlrotate_test.stl"
+
+/* Copies of the test part put side by side, enough facets for several
+ * chunks of the *_ctx() functions
+ */
+#define CHECK_COPIES 100
+
+/* Run with no pool, a pool of one and a pool of several */
+#define CHECK_CTXS   3
+
+/* Scratch file for the checks that write, removed again after each */
+#define CHECK_OUT    "checktest_out.stl"
+#define CHECK_GZ     "checktest_out.stl.gz"
+#define CHECK_CACHE  "checktest_out.cache"
+
+static int check_failures = 0;
+
+static void check(int ok, const char *what, const char *detail)
+{
+	if(!ok)
+	{
+		printf("FAIL: %s (%s)\n", what, detail);
+		check_failures++;
+	}
+}
+
+/* Every float and the attribute count the same, bit for bit */
+static int check_same_facets(const stl_facet_t *a, const stl_facet_t *b, size_t count)
+{
+	size_t i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		if((0 != memcmp(&a[i], &b[i], offsetof(stl_facet_t, abc))) || (a[i].abc != b[i].abc))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* The normal and corners bit for bit, leaving out the attribute count */
+static int check_same_floats(const stl_facet_t *a, const stl_facet_t *b, size_t count)
+{
+	size_t i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		if(0 != memcmp(&a[i].normal.x, &b[i].normal.x, 12 * sizeof(float)))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Same as check_same_facets() but by value, so 0 and -0 match */
+static int check_equal_facets(const stl_facet_t *a, const stl_facet_t *b, size_t count)
+{
+	size_t       i = 0;
+	unsigned int k = 0;
+	const float  *fa = NULL;
+	const float  *fb = NULL;
+
+	for(i = 0; i < count; i++)
+	{
+		fa = &a[i].normal.x;
+		fb = &b[i].normal.x;
+
+		for(k = 0; k < 12; k++)
+		{
+			if(fa[k] != fb[k])
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+static stl_t *check_copy(const stl_t *stl)
+{
+	stl_t *copy = NULL;
+
+	if(STL_SUCCESS != stl_new(&copy, stl->facets_count))
+	{
+		printf("Could not copy the test part\n");
+		exit(1);
+	}
+
+	memcpy(copy->header, stl->header, STL_HEADER_SIZE);
+	memcpy(copy->facets, stl->facets, stl->facets_count * sizeof(stl_facet_t));
+
+	return copy;
+}
+
+/* The test part, tiled out with each copy turned and moved a bit
+ * differently so no two chunks hold the same numbers
+ */
+static stl_t *check_load_mesh(void)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      i = 0;
+	stl_t       *part = NULL;
+	stl_t       *stl = NULL;
+	stl_facet_t *copy = NULL;
+	double      m[16];
+
+	error = stl_read_file(CHECK_MESH, &part);
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_new(&stl, part->facets_count * CHECK_COPIES);
+	}
+
+	for(i = 0; (STL_SUCCESS == error) && (i < CHECK_COPIES); i++)
+	{
+		copy = &stl->facets[i * part->facets_count];
+		memcpy(copy, part->facets, part->facets_count * sizeof(stl_facet_t));
+
+		stl_matrix_identity(m);
+		error = stl_matrix_rotate(m, 1.0, 2.0 + i, 3.0, 37.0 * i);
+
+		if(STL_SUCCESS == error)
+		{
+			error = stl_matrix_translate(m, 10.0 * (i % 10), 10.0 * (i / 10), 0.5 * i);
+		}
+
+		if(STL_SUCCESS == error)
+		{
+			error = stl_transform_facets(m, copy, part->facets_count);
+		}
+	}
+
+	if(STL_SUCCESS != error)
+	{
+		printf("Could not load %s\n", CHECK_MESH);
+		exit(1);
+	}
+
+	stl_free(part);
+
+	return stl;
+}
+
+/* A bit of everything: turned, squashed unevenly, moved */
+static void check_matrix(double m[16], int mirror)
+{
+	stl_matrix_identity(m);
+	stl_matrix_rotate(m, 0.3, -1.0, 0.7, 33.0);
+	stl_matrix_scale(m, 120.0, 85.0, 101.0);
+	stl_matrix_translate(m, 1.25, -7.5, 3.0);
+
+	if(mirror)
+	{
+		stl_matrix_mirror(m, STL_AXIS_Y);
+	}
+}
+
+/* Runs the kernels at one SIMD level, leaving the results in out[] */
+static void check_simd_run(stl_simd_t level, const stl_t *stl, stl_t **out)
+{
+	double    m[16];
+	stl_soa_t *soa = NULL;
+
+	stl_set_simd(level);
+
+	check_matrix(m, 0);
+	out[0] = check_copy(stl);
+	stl_transform(m, out[0]);
+
+	check_matrix(m, 1);
+	out[1] = check_copy(stl);
+	stl_transform(m, out[1]);
+
+	out[2] = check_copy(stl);
+	stl_scale(130.0, 70.0, 99.0, out[2]);
+
+	out[3] = NULL;
+	if(STL_SUCCESS == stl_to_soa((stl_t *)stl, &soa))
+	{
+		check_matrix(m, 0);
+		stl_soa_transform(m, soa);
+		stl_from_soa(soa, &out[3]);
+		stl_soa_free(soa);
+	}
+
+	stl_set_simd(STL_SIMD_AUTO);
+}
+
+/* Every level the CPU can run against the plain C kernels, with
+ * STL_SIMD_TOLERANCE (none) allowed
+ */
+static void check_simd(const stl_t *stl)
+{
+	static const char *names[] = { "transform", "mirror", "scale", "soa transform" };
+	stl_simd_t        best = 0;
+	stl_simd_t        level = 0;
+	unsigned int      i = 0;
+	char              detail[64];
+	stl_t             *scalar[4];
+	stl_t             *simd[4];
+
+	stl_set_simd(STL_SIMD_AUTO);
+	best = stl_get_simd();
+
+	check_simd_run(STL_SIMD_SCALAR, stl, scalar);
+
+	for(level = STL_SIMD_SCALAR + 1; level <= best; level++)
+	{
+		check_simd_run(level, stl, simd);
+
+		for(i = 0; i < 4; i++)
+		{
+			sprintf(detail, "SIMD level %u", level);
+			check((NULL != simd[i]) && (NULL != scalar[i]) &&
+				check_same_facets(simd[i]->facets, scalar[i]->facets, stl->facets_count), names[i], detail);
+
+			stl_free(simd[i]);
+		}
+	}
+
+	for(i = 0; i < 4; i++)
+	{
+		stl_free(scalar[i]);
+	}
+
+	printf("SIMD levels 1 to %u checked\n", best);
+}
+
+static int check_same_vertex(const stl_vertex_t *a, const stl_vertex_t *b)
+{
+	return (a->x == b->x) && (a->y == b->y) && (a->z == b->z);
+}
+
+/* The box around the corners as stl_get_facets() hands them out */
+static void check_facets_bounds(const stl_t *stl, stl_vertex_t *min, stl_vertex_t *max)
+{
+	size_t       i = 0;
+	unsigned int j = 0;
+	stl_facet_t  facet;
+	stl_vertex_t *v = NULL;
+
+	stl_get_facets(stl, 0, 1, &facet);
+	*min = facet.verticies[0];
+	*max = facet.verticies[0];
+
+	for(i = 0; i < stl->facets_count; i++)
+	{
+		stl_get_facets(stl, i, 1, &facet);
+
+		for(j = 0; j < 3; j++)
+		{
+			v = &facet.verticies[j];
+
+			min->x = (v->x < min->x) ? v->x : min->x;
+			min->y = (v->y < min->y) ? v->y : min->y;
+			min->z = (v->z < min->z) ? v->z : min->z;
+
+			max->x = (v->x > max->x) ? v->x : max->x;
+			max->y = (v->y > max->y) ? v->y : max->y;
+			max->z = (v->z > max->z) ? v->z : max->z;
+		}
+	}
+}
+
+/* The box stl_get_bounds() keeps across deferred scales and moves has to
+ * be the one around the corners that come out, however many are stacked
+ */
+static void check_deferred_bounds(const stl_t *stl)
+{
+	static const double steps[][3] =
+	{
+		{ 37.0, 271.0, 100.0 },
+		{ 271.0, 37.0, 55.5 },
+		{ -80.0, 100.0, 3.0 },
+		{ 100.0, -133.3, 100.0 }
+	};
+	unsigned int k = 0;
+	char         detail[64];
+	double       m[16];
+	stl_vertex_t min;
+	stl_vertex_t max;
+	stl_vertex_t facets_min;
+	stl_vertex_t facets_max;
+	stl_t        *copy = check_copy(stl);
+
+	/* Start with the box known, so every step has one to keep */
+	stl_get_bounds(copy, &min, &max);
+
+	for(k = 0; k < sizeof(steps) / sizeof(steps[0]); k++)
+	{
+		stl_matrix_identity(m);
+		stl_matrix_scale(m, steps[k][0], steps[k][1], steps[k][2]);
+		stl_matrix_translate(m, 0.1 * k, -3.3, 7.77);
+		stl_transform_deferred(m, copy);
+
+		sprintf(detail, "after %u deferred steps", k + 1);
+		check(copy->has_bounds, "deferred bounds kept", detail);
+
+		stl_get_bounds(copy, &min, &max);
+		check_facets_bounds(copy, &facets_min, &facets_max);
+
+		check(check_same_vertex(&min, &facets_min) && check_same_vertex(&max, &facets_max),
+			"deferred bounds", detail);
+	}
+
+	stl_free(copy);
+
+	printf("Deferred bounds checked\n");
+}
+
+/* A negative scale is a mirror, and has to leave the facets exactly as a
+ * mirror through stl_transform() and fresh normals do: corners swapped to
+ * keep the winding, normals pointing out. Compared by value, as the scale
+ * turns a 0 into -0 where the matrix doesn't.
+ */
+static void check_negative_scale(const stl_t *stl)
+{
+	static const double pcts[][3] =
+	{
+		{ -100.0, 100.0, 100.0 },
+		{ -100.0, -100.0, 100.0 },
+		{ -100.0, -100.0, -100.0 }
+	};
+	static const stl_axis_t axes[] = { STL_AXIS_X, STL_AXIS_Y, STL_AXIS_Z };
+	unsigned int k = 0;
+	unsigned int j = 0;
+	size_t       i = 0;
+	int          zero = 1;
+	char         detail[64];
+	double       m[16];
+	stl_t        *scaled = NULL;
+	stl_t        *mirrored = NULL;
+
+	for(k = 0; k < sizeof(pcts) / sizeof(pcts[0]); k++)
+	{
+		scaled = check_copy(stl);
+		stl_scale(pcts[k][0], pcts[k][1], pcts[k][2], scaled);
+
+		stl_matrix_identity(m);
+		for(j = 0; j <= k; j++)
+		{
+			stl_matrix_mirror(m, axes[j]);
+		}
+
+		mirrored = check_copy(stl);
+		stl_transform(m, mirrored);
+		stl_gen_normals(mirrored);
+
+		sprintf(detail, "%u axes", k + 1);
+		check(check_equal_facets(scaled->facets, mirrored->facets, stl->facets_count), "negative scale", detail);
+
+		stl_free(scaled);
+		stl_free(mirrored);
+	}
+
+	/* Turned off for one object, the other still gets its normals */
+	scaled = check_copy(stl);
+	mirrored = check_copy(stl);
+	stl_set_auto_normals(scaled, 0);
+
+	stl_scale(150.0, 150.0, 150.0, scaled);
+	stl_scale(150.0, 150.0, 150.0, mirrored);
+
+	for(i = 0; i < stl->facets_count; i++)
+	{
+		zero &= (0.0f == scaled->facets[i].normal.x) && (0.0f == scaled->facets[i].normal.y) &&
+			(0.0f == scaled->facets[i].normal.z);
+	}
+
+	check(zero, "auto normals off", "normals left zero");
+	check(stl_get_auto_normals(mirrored) && (0.0f != mirrored->facets[0].normal.x + mirrored->facets[0].normal.y +
+		mirrored->facets[0].normal.z), "auto normals on", "normals worked out");
+
+	stl_free(scaled);
+	stl_free(mirrored);
+
+	printf("Negative scales checked\n");
+}
+
+static void check_ctx_new(stl_ctx_t **ctx)
+{
+	ctx[0] = NULL;
+
+	if((STL_SUCCESS != stl_ctx_new(&ctx[1], 1)) || (STL_SUCCESS != stl_ctx_new(&ctx[2], 4)))
+	{
+		printf("Could not start the thread pools\n");
+		exit(1);
+	}
+}
+
+static void check_set_vertex(stl_vertex_t *v, float x, float y, float z)
+{
+	v->x = x;
+	v->y = y;
+	v->z = z;
+}
+
+/* A closed box from (0, 0, 0) to (x, y, z), wound counter clockwise seen
+ * from outside, with room for extra facets after the 12 of the box
+ */
+static stl_t *check_box(float x, float y, float z, size_t extra)
+{
+	/* Each side as four corners, counter clockwise from outside. Corner i
+	 * is at x if bit 0 is set, y if bit 1, z if bit 2.
+	 */
+	static const int sides[6][4] =
+	{
+		{ 0, 2, 3, 1 },
+		{ 4, 5, 7, 6 },
+		{ 0, 1, 5, 4 },
+		{ 2, 6, 7, 3 },
+		{ 0, 4, 6, 2 },
+		{ 1, 3, 7, 5 }
+	};
+	static const int halves[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+	unsigned int k = 0;
+	unsigned int h = 0;
+	unsigned int j = 0;
+	int          c = 0;
+	stl_t        *box = NULL;
+
+	if(STL_SUCCESS != stl_new(&box, 12 + extra))
+	{
+		printf("Could not make a box\n");
+		exit(1);
+	}
+
+	for(k = 0; k < 6; k++)
+	{
+		for(h = 0; h < 2; h++)
+		{
+			for(j = 0; j < 3; j++)
+			{
+				c = sides[k][halves[h][j]];
+
+				check_set_vertex(&box->facets[2 * k + h].verticies[j], (c & 1) ? x : 0.0f, (c & 2) ? y : 0.0f,
+					(c & 4) ? z : 0.0f);
+			}
+		}
+	}
+
+	stl_gen_normals(box);
+
+	return box;
+}
+
+/* A unit cube has to come out exactly, and a facet with no area has to be
+ * counted and otherwise left out
+ */
+static void check_stats_cube(void)
+{
+	stl_stats_t stats;
+	stl_t       *cube = check_box(1.0f, 1.0f, 1.0f, 0);
+	stl_t       *flat = check_box(1.0f, 1.0f, 1.0f, 1);
+
+	check((STL_SUCCESS == stl_compute_stats(cube, &stats)) && (12 == stats.facets_count) &&
+		(6.0 == stats.surface_area) && (1.0 == stats.volume) && (0.5 == stats.centroid[0]) &&
+		(0.5 == stats.centroid[1]) && (0.5 == stats.centroid[2]) && (0 == stats.degenerate_facets),
+		"cube stats", "unit cube");
+
+	/* All three corners in one place */
+	check_set_vertex(&flat->facets[12].verticies[0], 0.5f, 0.5f, 0.5f);
+	check_set_vertex(&flat->facets[12].verticies[1], 0.5f, 0.5f, 0.5f);
+	check_set_vertex(&flat->facets[12].verticies[2], 0.5f, 0.5f, 0.5f);
+
+	check((STL_SUCCESS == stl_compute_stats(flat, &stats)) && (13 == stats.facets_count) &&
+		(6.0 == stats.surface_area) && (1.0 == stats.volume) && (0.5 == stats.centroid[0]) &&
+		(0.5 == stats.centroid[1]) && (0.5 == stats.centroid[2]) && (1 == stats.degenerate_facets),
+		"cube stats", "with a degenerate facet");
+
+	stl_free(cube);
+	stl_free(flat);
+
+	printf("Cube stats checked\n");
+}
+
+/* Whatever one of the *_ctx() functions fills in */
+typedef union
+{
+	stl_stats_t stats;
+	stl_obb_t   obb;
+	double      m[16];
+} check_result_t;
+
+typedef stl_error_t (*check_run_t)(stl_ctx_t *ctx, void *arg, check_result_t *result);
+
+/* Runs with no pool, a pool of one and a pool of several, at every SIMD
+ * level, and checks each result is bit for bit the first one. The work is
+ * shared out in chunks and put back together in chunk order, so none of
+ * that is allowed to change the answer.
+ */
+static void check_runs(stl_ctx_t **ctx, const char *what, check_run_t run, void *arg, size_t size)
+{
+	stl_simd_t     best = 0;
+	stl_simd_t     level = 0;
+	unsigned int   c = 0;
+	char           detail[64];
+	check_result_t first;
+	check_result_t result;
+
+	memset(&first, 0x00, sizeof(first));
+	memset(&result, 0x00, sizeof(result));
+
+	stl_set_simd(STL_SIMD_AUTO);
+	best = stl_get_simd();
+
+	stl_set_simd(STL_SIMD_SCALAR);
+	check(STL_SUCCESS == run(NULL, arg, &first), what, "first run");
+
+	for(level = STL_SIMD_SCALAR; level <= best; level++)
+	{
+		stl_set_simd(level);
+
+		for(c = 0; c < CHECK_CTXS; c++)
+		{
+			sprintf(detail, "SIMD level %u, pool %u", level, c);
+
+			check((STL_SUCCESS == run(ctx[c], arg, &result)) && (0 == memcmp(&result, &first, size)), what, detail);
+		}
+	}
+
+	stl_set_simd(STL_SIMD_AUTO);
+
+	printf("%s checked across pools and SIMD levels\n", what);
+}
+
+static stl_error_t check_run_stats(stl_ctx_t *ctx, void *arg, check_result_t *result)
+{
+	return stl_compute_stats_ctx(ctx, (stl_t *)arg, &result->stats);
+}
+
+static stl_error_t check_run_compact_stats(stl_ctx_t *ctx, void *arg, check_result_t *result)
+{
+	return stl_compact_compute_stats_ctx(ctx, (stl_compact_t *)arg, &result->stats);
+}
+
+static stl_error_t check_run_orient(stl_ctx_t *ctx, void *arg, check_result_t *result)
+{
+	return stl_auto_orient_ctx(ctx, (stl_t *)arg, 0, 1.0, 1.0, result->m);
+}
+
+static stl_error_t check_run_obb(stl_ctx_t *ctx, void *arg, check_result_t *result)
+{
+	return stl_compute_obb_ctx(ctx, (stl_t *)arg, &result->obb);
+}
+
+/* The compact corners are rounded, so those are held to the first compact
+ * run rather than to the unpacked stats
+ */
+static void check_stats(stl_ctx_t **ctx, stl_t *stl)
+{
+	stl_compact_t *compact = NULL;
+
+	if(STL_SUCCESS != stl_to_compact(stl, 0, &compact))
+	{
+		printf("Could not pack the test part\n");
+		exit(1);
+	}
+
+	check_runs(ctx, "Stats", check_run_stats, stl, sizeof(stl_stats_t));
+	check_runs(ctx, "Compact stats", check_run_compact_stats, compact, sizeof(stl_stats_t));
+
+	stl_compact_free(compact);
+}
+
+/* A thin slab stood on its edge has one obvious way up: flat. The matrix
+ * that gets it there has to be a plain rotation, no stretching or mirroring.
+ */
+static void check_orient_slab(void)
+{
+	unsigned int r = 0;
+	unsigned int c = 0;
+	double       dot = 0.0;
+	double       det = 0.0;
+	int          rotation = 1;
+	double       m[16];
+	stl_vertex_t min;
+	stl_vertex_t max;
+	stl_t        *slab = check_box(10.0f, 1.0f, 10.0f, 0);
+
+	check(STL_SUCCESS == stl_auto_orient(slab, 0, 1.0, 1.0, m), "orient slab", "worked out");
+
+	/* Rows of unit length and at right angles */
+	for(r = 0; r < 3; r++)
+	{
+		for(c = 0; c < 3; c++)
+		{
+			dot = m[4 * r + 0] * m[4 * c + 0] + m[4 * r + 1] * m[4 * c + 1] + m[4 * r + 2] * m[4 * c + 2];
+			rotation &= (fabs(dot - ((r == c) ? 1.0 : 0.0)) < 1e-9);
+		}
+	}
+
+	det = m[0] * (m[5] * m[10] - m[6] * m[9]) - m[1] * (m[4] * m[10] - m[6] * m[8]) + m[2] * (m[4] * m[9] - m[5] * m[8]);
+
+	check(rotation && (fabs(det - 1.0) < 1e-9) && (0.0 == m[12]) && (0.0 == m[13]) && (0.0 == m[14]) && (1.0 == m[15]),
+		"orient slab", "a rotation");
+
+	stl_transform(m, slab);
+	stl_get_bounds(slab, &min, &max);
+
+	check(fabs((max.z - min.z) - 1.0) < 1e-4, "orient slab", "laid flat");
+
+	stl_free(slab);
+
+	printf("Orient slab checked\n");
+}
+
+/* Every corner of a turned 4 by 2 by 1 box has to be inside the box that
+ * comes back, and that can't be bigger than the one lined up with x, y and
+ * z, nor much bigger than the box itself
+ */
+static void check_obb_box(void)
+{
+	size_t       i = 0;
+	unsigned int j = 0;
+	unsigned int k = 0;
+	int          inside = 1;
+	double       d = 0.0;
+	double       m[16];
+	stl_vertex_t *v = NULL;
+	stl_vertex_t min;
+	stl_vertex_t max;
+	stl_obb_t    obb;
+	stl_t        *box = check_box(4.0f, 2.0f, 1.0f, 0);
+
+	stl_matrix_identity(m);
+	stl_matrix_rotate(m, 1.0, 2.0, 3.0, 30.0);
+	stl_matrix_translate(m, 5.0, -2.0, 7.0);
+	stl_transform(m, box);
+
+	check(STL_SUCCESS == stl_compute_obb(box, &obb), "box bounding box", "worked out");
+
+	for(i = 0; i < box->facets_count; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			v = &box->facets[i].verticies[j];
+
+			for(k = 0; k < 3; k++)
+			{
+				d = (v->x - obb.centre[0]) * obb.axes[k][0] + (v->y - obb.centre[1]) * obb.axes[k][1] +
+					(v->z - obb.centre[2]) * obb.axes[k][2];
+
+				inside &= (fabs(d) <= obb.size[k] / 2.0 + 1e-5);
+			}
+		}
+	}
+
+	check(inside, "box bounding box", "every corner inside");
+
+	stl_get_bounds(box, &min, &max);
+
+	check(obb.volume <= ((double)max.x - min.x) * ((double)max.y - min.y) * ((double)max.z - min.z),
+		"box bounding box", "no bigger than the one lined up with x, y and z");
+	check(obb.volume < 8.0 * 1.001, "box bounding box", "close around the box");
+
+	stl_free(box);
+
+	printf("Box bounding box checked\n");
+}
+
+/* A flat 10 by 1 plate has no volume whichever way the box is turned, so
+ * the box has to be found by its surface instead. Turned about z, and about
+ * a slanted axis, it should still come back 10 by 1 by 0.
+ */
+static void check_obb_plate(void)
+{
+	static const double turns[][4] =
+	{
+		{ 0.0, 0.0, 1.0, 45.0 },
+		{ 1.0, 2.0, 3.0, 30.0 }
+	};
+	unsigned int k = 0;
+	char         detail[64];
+	double       m[16];
+	stl_obb_t    obb;
+	stl_t        *plate = NULL;
+
+	for(k = 0; k < sizeof(turns) / sizeof(turns[0]); k++)
+	{
+		if(STL_SUCCESS != stl_new(&plate, 2))
+		{
+			printf("Could not make the plate\n");
+			exit(1);
+		}
+
+		check_set_vertex(&plate->facets[0].verticies[0], 0.0f, 0.0f, 0.0f);
+		check_set_vertex(&plate->facets[0].verticies[1], 10.0f, 0.0f, 0.0f);
+		check_set_vertex(&plate->facets[0].verticies[2], 10.0f, 1.0f, 0.0f);
+		check_set_vertex(&plate->facets[1].verticies[0], 0.0f, 0.0f, 0.0f);
+		check_set_vertex(&plate->facets[1].verticies[1], 10.0f, 1.0f, 0.0f);
+		check_set_vertex(&plate->facets[1].verticies[2], 0.0f, 1.0f, 0.0f);
+
+		stl_matrix_identity(m);
+		stl_matrix_rotate(m, turns[k][0], turns[k][1], turns[k][2], turns[k][3]);
+		stl_transform(m, plate);
+
+		sprintf(detail, "plate turned %g degrees", turns[k][3]);
+		check((STL_SUCCESS == stl_compute_obb(plate, &obb)) &&
+			(fabs(obb.size[0] - 10.0) < 1e-3) && (fabs(obb.size[1] - 1.0) < 1e-3) && (fabs(obb.size[2]) < 1e-3),
+			"flat bounding box", detail);
+
+		stl_free(plate);
+	}
+
+	printf("Flat bounding box checked\n");
+}
+
+static int check_exists(const char *file)
+{
+	FILE *fp = fopen(file, "rb");
+
+	if(NULL != fp)
+	{
+		fclose(fp);
+	}
+
+	return NULL != fp;
+}
+
+/* A heightmap that can't be made mustn't leave a file behind to get in the
+ * way of the next try
+ */
+static void check_heightmap_file(void)
+{
+	double vals[6] = { 0.0, 1.0, 2.0, 3.0, 4.0, 5.0 };
+
+	remove(CHECK_OUT);
+
+	check(STL_ERROR_INVALID_ARG == stl_write_heightmap_double(CHECK_OUT, vals, STL_ORIGIN_TOP_LEFT, 1, 6, 100.0, 1.0, 1.0),
+		"heightmap file", "one column refused");
+	check(!check_exists(CHECK_OUT), "heightmap file", "nothing left after a failure");
+
+	check(STL_SUCCESS == stl_write_heightmap_double(CHECK_OUT, vals, STL_ORIGIN_TOP_LEFT, 2, 3, 100.0, 1.0, 1.0),
+		"heightmap file", "written after a failure");
+
+	remove(CHECK_OUT);
+
+	printf("Heightmap file checked\n");
+}
+
+/* A file that claims more facets than it holds has to be turned away
+ * before anything is allocated for them
+ */
+static void check_short_file(void)
+{
+	unsigned char bytes[STL_FACETS_OFFSET];
+	FILE          *fp = NULL;
+	stl_t         *stl = NULL;
+
+	memset(bytes, 0x00, sizeof(bytes));
+	memset(bytes + STL_HEADER_SIZE, 0xff, 4);
+
+	fp = fopen(CHECK_OUT, "wb");
+	if((NULL == fp) || (sizeof(bytes) != fwrite(bytes, 1, sizeof(bytes), fp)) || (0 != fclose(fp)))
+	{
+		printf("Could not write %s\n", CHECK_OUT);
+		exit(1);
+	}
+
+	check(STL_ERROR == stl_read_file(CHECK_OUT, &stl), "short file", "stl_read_file()");
+	check(STL_ERROR == stl_read_file_parallel(CHECK_OUT, 4, &stl), "short file", "stl_read_file_parallel()");
+	check(STL_ERROR == stl_map_file(CHECK_OUT, &stl), "short file", "stl_map_file()");
+
+	remove(CHECK_OUT);
+
+	printf("Short file checked\n");
+}
+
+/* The whole of a file, which the caller frees */
+static unsigned char *check_read_bytes(const char *file, size_t *len)
+{
+	long          size = 0;
+	FILE          *fp = fopen(file, "rb");
+	unsigned char *bytes = NULL;
+
+	if((NULL == fp) || (0 != fseek(fp, 0, SEEK_END)) || ((size = ftell(fp)) <= 0) || (0 != fseek(fp, 0, SEEK_SET)))
+	{
+		printf("Could not read %s\n", file);
+		exit(1);
+	}
+
+	bytes = (unsigned char *)malloc((size_t)size);
+	if((NULL == bytes) || ((size_t)size != fread(bytes, 1, (size_t)size, fp)))
+	{
+		printf("Could not read %s\n", file);
+		exit(1);
+	}
+
+	fclose(fp);
+	*len = (size_t)size;
+
+	return bytes;
+}
+
+/* Collects what the parser hands over, and fails once it has had limit
+ * facets
+ */
+typedef struct
+{
+	stl_facet_t *facets;
+	size_t      count;
+	size_t      limit;
+	size_t      calls;
+} check_parsed_t;
+
+static stl_error_t check_parsed_cb(const stl_facet_t *facets, size_t count, void *arg)
+{
+	check_parsed_t *parsed = (check_parsed_t *)arg;
+
+	parsed->calls++;
+
+	if(parsed->count + count > parsed->limit)
+	{
+		return STL_ERROR_IO_ERROR;
+	}
+
+	memcpy(&parsed->facets[parsed->count], facets, count * sizeof(facets[0]));
+	parsed->count += count;
+
+	return STL_SUCCESS;
+}
+
+/* Feeds bytes to a new parser step bytes at a time */
+static stl_error_t check_parse(const unsigned char *bytes, size_t len, size_t step, check_parsed_t *parsed)
+{
+	stl_error_t  error = STL_SUCCESS;
+	size_t       i = 0;
+	stl_parser_t *parser = NULL;
+
+	parsed->count = 0;
+	parsed->calls = 0;
+
+	error = stl_parser_new(check_parsed_cb, parsed, &parser);
+
+	for(i = 0; (STL_SUCCESS == error) && (i < len); i += step)
+	{
+		error = stl_parser_feed(parser, bytes + i, (len - i < step) ? (len - i) : step);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_parser_finish(parser);
+	}
+
+	stl_parser_free(parser);
+
+	return error;
+}
+
+/* The parser has to give the same facets however the file is cut up, and
+ * once stopped has to stay stopped
+ */
+static void check_parser(const stl_t *stl)
+{
+	static const size_t steps[] = { 1, 49, 50, 4096, 1 << 20 };
+	static const char   ascii[] = "solid x\n facet normal 0 0 1\n  outer loop\n   vertex 0 0 0\n   vertex 1 0 0\n"
+		"   vertex 0 1 0\n  endloop\n endfacet\nendsolid x\n";
+	unsigned int        k = 0;
+	size_t              len = 0;
+	char                detail[64];
+	unsigned char       *bytes = NULL;
+	stl_parser_t        *parser = NULL;
+	check_parsed_t      parsed;
+
+	remove(CHECK_OUT);
+	if(STL_SUCCESS != stl_write_file(CHECK_OUT, (stl_t *)stl))
+	{
+		printf("Could not write %s\n", CHECK_OUT);
+		exit(1);
+	}
+
+	bytes = check_read_bytes(CHECK_OUT, &len);
+	remove(CHECK_OUT);
+
+	memset(&parsed, 0x00, sizeof(parsed));
+	parsed.facets = (stl_facet_t *)malloc(stl->facets_count * sizeof(parsed.facets[0]));
+	parsed.limit = stl->facets_count;
+
+	for(k = 0; k < sizeof(steps) / sizeof(steps[0]); k++)
+	{
+		sprintf(detail, "%lu bytes at a time", (unsigned long)steps[k]);
+		check((STL_SUCCESS == check_parse(bytes, len, steps[k], &parsed)) && (stl->facets_count == parsed.count) &&
+			check_same_facets(parsed.facets, stl->facets, stl->facets_count), "parser", detail);
+	}
+
+	/* The callback turns down the first batch, nothing else gets through */
+	parsed.limit = 0;
+	check(STL_ERROR_IO_ERROR == check_parse(bytes, len, 1 << 20, &parsed), "parser", "callback error passed back");
+
+	stl_parser_new(check_parsed_cb, &parsed, &parser);
+	parsed.calls = 0;
+
+	check(STL_ERROR_IO_ERROR == stl_parser_feed(parser, bytes, len / 2), "parser", "callback error");
+	check(STL_ERROR_IO_ERROR == stl_parser_feed(parser, bytes + len / 2, len - len / 2), "parser", "stopped after callback error");
+	check(STL_ERROR_IO_ERROR == stl_parser_finish(parser), "parser", "finish after callback error");
+	check(1 == parsed.calls, "parser", "no more callbacks after an error");
+
+	stl_parser_free(parser);
+
+	/* Text is turned away, and stays turned away */
+	stl_parser_new(check_parsed_cb, &parsed, &parser);
+
+	check(STL_ERROR_UNSUPPORTED == stl_parser_feed(parser, (const unsigned char *)ascii, strlen(ascii)), "parser", "ASCII refused");
+	check(STL_ERROR_UNSUPPORTED == stl_parser_feed(parser, bytes + STL_FACETS_OFFSET, STL_FACET_SIZE), "parser", "stopped after ASCII");
+	check(STL_ERROR_UNSUPPORTED == stl_parser_finish(parser), "parser", "finish after ASCII");
+
+	stl_parser_free(parser);
+
+	free(parsed.facets);
+	free(bytes);
+
+	printf("Parser checked\n");
+}
+
+static unsigned int check_random(unsigned int *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+/* A float from anywhere in the range, or one that looks like a coordinate,
+ * or one exactly half way between two floats, written out in one of a few
+ * ways, into text. Gives back what strtof() makes of that text.
+ */
+static float check_random_number(unsigned int *state, char *text)
+{
+	static const char *formats[] = { "%.9g", "%.17g", "%e", "%.25e", "%+.6E", "%.3f", "%.0f" };
+	unsigned int bits = check_random(state);
+	unsigned int pick = check_random(state);
+	float        f = 0.0f;
+	float        next = 0.0f;
+	double       d = 0.0;
+
+	/* No infinities or NaNs */
+	if(0x7F800000 == (bits & 0x7F800000))
+	{
+		bits &= ~0x40000000U;
+	}
+
+	memcpy(&f, &bits, sizeof(f));
+	d = f;
+
+	if(1 == pick % 3)
+	{
+		d = ((double)(bits % 2000001) - 1000000.0) / 1000.0;
+	}
+	else if((2 == pick % 3) && (fabs(f) < 1e30f))
+	{
+		next = nextafterf(f, HUGE_VALF);
+		d = ((double)f + next) / 2.0;
+	}
+
+	/* Fixed point only for numbers that don't run to hundreds of digits */
+	pick = (pick / 3) % (sizeof(formats) / sizeof(formats[0]));
+	if((pick >= 5) && (fabs(d) > 1e15))
+	{
+		pick = 0;
+	}
+
+	sprintf(text, formats[pick], d);
+
+	return strtof(text, NULL);
+}
+
+/* An ASCII file with numbers written every which way has to read back as
+ * strtof() reads them, whichever way _stl_parse_float() gets there
+ */
+static void check_ascii_parse(void)
+{
+	size_t       count = 20000;
+	size_t       i = 0;
+	unsigned int j = 0;
+	unsigned int state = 12345;
+	int          same = 1;
+	char         text[12][64];
+	FILE         *fp = NULL;
+	float        *expected = NULL;
+	stl_t        *stl = NULL;
+
+	expected = (float *)malloc(count * 12 * sizeof(expected[0]));
+	fp = fopen(CHECK_OUT, "wb");
+	if((NULL == expected) || (NULL == fp))
+	{
+		printf("Could not write %s\n", CHECK_OUT);
+		exit(1);
+	}
+
+	fprintf(fp, "solid check\n");
+
+	for(i = 0; i < count; i++)
+	{
+		for(j = 0; j < 12; j++)
+		{
+			expected[12 * i + j] = check_random_number(&state, text[j]);
+		}
+
+		fprintf(fp, "facet normal %s %s %s\n outer loop\n  vertex %s %s %s\n  vertex %s %s %s\n  vertex %s %s %s\n"
+			" endloop\nendfacet\n", text[0], text[1], text[2], text[3], text[4], text[5], text[6], text[7], text[8],
+			text[9], text[10], text[11]);
+	}
+
+	fprintf(fp, "endsolid check\n");
+	fclose(fp);
+
+	check((STL_SUCCESS == stl_read_file(CHECK_OUT, &stl)) && (count == stl->facets_count), "ASCII parse", "read");
+
+	for(i = 0; (NULL != stl) && (i < count); i++)
+	{
+		same &= (0 == memcmp(&stl->facets[i].normal.x, &expected[12 * i], 12 * sizeof(float)));
+	}
+
+	check(same, "ASCII parse", "every number as strtof() reads it");
+
+	stl_free(stl);
+	free(expected);
+	remove(CHECK_OUT);
+
+	printf("ASCII parse checked\n");
+}
+
+/* Written as ASCII and read back by each reader, every float has to come
+ * back as it went out: the edges of the range, both zeros, both
+ * infinities, and a spread of everything in between
+ */
+static void check_ascii_round_trip(const stl_t *mesh)
+{
+	static const unsigned int edges[] =
+	{
+		0x00000000, 0x80000000, 0x00000001, 0x80000001, 0x007FFFFF, 0x00800000,
+		0x7F7FFFFF, 0xFF7FFFFF, 0x7F800000, 0xFF800000, 0x3F800000, 0x3DCCCCCD,
+		0x4B800000, 0x4B800001, 0x3EAAAAAB, 0x501502F9
+	};
+	static const char *names[] = { "stl_read_file()", "stl_read_file_parallel()", "stl_map_file()" };
+	size_t       count = 20000;
+	size_t       i = 0;
+	unsigned int j = 0;
+	unsigned int k = 0;
+	unsigned int bits = 0;
+	unsigned int state = 54321;
+	float        *f = NULL;
+	stl_t        *stl = NULL;
+	stl_t        *back[3];
+
+	if(STL_SUCCESS != stl_new(&stl, count + mesh->facets_count))
+	{
+		printf("Could not make the ASCII part\n");
+		exit(1);
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		f = &stl->facets[i].normal.x;
+
+		for(j = 0; j < 12; j++, k++)
+		{
+			bits = (k < sizeof(edges) / sizeof(edges[0])) ? edges[k] : check_random(&state);
+
+			/* No NaNs, they don't keep their bits */
+			if((0x7F800000 == (bits & 0x7F800000)) && (0 != (bits & 0x007FFFFF)))
+			{
+				bits &= ~0x40000000U;
+			}
+
+			memcpy(&f[j], &bits, sizeof(bits));
+		}
+	}
+
+	memcpy(&stl->facets[count], mesh->facets, mesh->facets_count * sizeof(stl_facet_t));
+
+	remove(CHECK_OUT);
+	check(STL_SUCCESS == stl_write_file_ascii(CHECK_OUT, stl), "ASCII round trip", "written");
+
+	memset(back, 0x00, sizeof(back));
+	stl_read_file(CHECK_OUT, &back[0]);
+	stl_read_file_parallel(CHECK_OUT, 4, &back[1]);
+	stl_map_file(CHECK_OUT, &back[2]);
+
+	for(j = 0; j < 3; j++)
+	{
+		check((NULL != back[j]) && (stl->facets_count == back[j]->facets_count) &&
+			check_same_floats(back[j]->facets, stl->facets, stl->facets_count), "ASCII round trip", names[j]);
+
+		stl_free(back[j]);
+	}
+
+	stl_free(stl);
+	remove(CHECK_OUT);
+
+	printf("ASCII round trip checked\n");
+}
+
+#ifndef STL_NO_ZLIB
+/* The bytes of file compressed into CHECK_GZ as two gzip members, the
+ * second starting cut bytes in
+ */
+static void check_gzip_members(const char *file, size_t cut)
+{
+	size_t        len = 0;
+	unsigned char *bytes = check_read_bytes(file, &len);
+	gzFile        gz = NULL;
+
+	remove(CHECK_GZ);
+
+	gz = gzopen(CHECK_GZ, "wb");
+	if((NULL == gz) || (cut != (size_t)gzwrite(gz, bytes, (unsigned int)cut)) || (Z_OK != gzclose(gz)))
+	{
+		printf("Could not write %s\n", CHECK_GZ);
+		exit(1);
+	}
+
+	gz = gzopen(CHECK_GZ, "ab");
+	if((NULL == gz) || (len - cut != (size_t)gzwrite(gz, bytes + cut, (unsigned int)(len - cut))) || (Z_OK != gzclose(gz)))
+	{
+		printf("Could not write %s\n", CHECK_GZ);
+		exit(1);
+	}
+
+	free(bytes);
+}
+
+/* Every reader has to give back what went into a compressed file, whether
+ * it was written as several members by stl_write_file(), or split between
+ * two members part way through a facet by someone else
+ */
+static void check_gzip(const stl_t *mesh)
+{
+	static const char *names[] = { "stl_read_file()", "stl_read_file_parallel()", "stl_map_file()" };
+	size_t       copies = 13;
+	size_t       i = 0;
+	unsigned int j = 0;
+	unsigned int k = 0;
+	char         detail[64];
+	stl_t        *stl = NULL;
+	stl_t        *back[3];
+
+	/* Enough facets for several members, and attribute counts to keep */
+	if(STL_SUCCESS != stl_new(&stl, copies * mesh->facets_count))
+	{
+		printf("Could not make the gzip part\n");
+		exit(1);
+	}
+
+	for(i = 0; i < copies; i++)
+	{
+		memcpy(&stl->facets[i * mesh->facets_count], mesh->facets, mesh->facets_count * sizeof(stl_facet_t));
+	}
+
+	for(i = 0; i < stl->facets_count; i += 7)
+	{
+		stl->facets[i].abc = (unsigned short)i;
+	}
+
+	for(k = 0; k < 3; k++)
+	{
+		remove(CHECK_GZ);
+
+		if(0 == k)
+		{
+			check(STL_SUCCESS == stl_write_file(CHECK_GZ, stl), "gzip", "written");
+		}
+		else
+		{
+			/* Binary cut part way into a facet, then ASCII */
+			remove(CHECK_OUT);
+			check(STL_SUCCESS == ((1 == k) ? stl_write_file(CHECK_OUT, stl) : stl_write_file_ascii(CHECK_OUT, stl)),
+				"gzip", "uncompressed written");
+
+			check_gzip_members(CHECK_OUT, STL_FACETS_OFFSET + 1000 * STL_FACET_SIZE + 17);
+			remove(CHECK_OUT);
+		}
+
+		memset(back, 0x00, sizeof(back));
+		stl_read_file(CHECK_GZ, &back[0]);
+		stl_read_file_parallel(CHECK_GZ, 4, &back[1]);
+		stl_map_file(CHECK_GZ, &back[2]);
+
+		for(j = 0; j < 3; j++)
+		{
+			sprintf(detail, "%s, %s", (0 == k) ? "members written" : (1 == k) ? "two members" : "two members of ASCII",
+				names[j]);
+
+			check((NULL != back[j]) && (stl->facets_count == back[j]->facets_count) &&
+				((2 == k) ? check_same_floats(back[j]->facets, stl->facets, stl->facets_count) :
+				check_same_facets(back[j]->facets, stl->facets, stl->facets_count)), "gzip", detail);
+
+			stl_free(back[j]);
+		}
+	}
+
+	stl_free(stl);
+	remove(CHECK_GZ);
+
+	printf("Gzip checked\n");
+}
+#endif
+
+#ifndef _WIN32
+/* Sets the modification time of file to seconds and nanoseconds */
+static void check_set_mtime(const char *file, long nsec)
+{
+	struct timespec times[2];
+
+	times[0].tv_sec = 1000000000;
+	times[0].tv_nsec = 0;
+	times[1].tv_sec = 1000000000;
+	times[1].tv_nsec = nsec;
+
+	if(0 != utimensat(AT_FDCWD, file, times, 0))
+	{
+		printf("Could not set the time on %s\n", file);
+		exit(1);
+	}
+}
+
+/* A cache maps back to the facets it was made from, and once the source
+ * has been touched, even by a nanosecond, or has grown, it has to be
+ * reported as stale
+ */
+static void check_cache(const stl_t *stl)
+{
+	FILE  *fp = NULL;
+	stl_t *mapped = NULL;
+
+	remove(CHECK_OUT);
+	remove(CHECK_CACHE);
+
+	if(STL_SUCCESS != stl_write_file(CHECK_OUT, (stl_t *)stl))
+	{
+		printf("Could not write %s\n", CHECK_OUT);
+		exit(1);
+	}
+
+	check_set_mtime(CHECK_OUT, 0);
+	check(STL_SUCCESS == stl_write_cache(CHECK_CACHE, CHECK_OUT, (stl_t *)stl), "cache", "written");
+
+	check((STL_SUCCESS == stl_map_cache(CHECK_CACHE, CHECK_OUT, STL_CACHE_VERIFY, &mapped)) &&
+		(stl->facets_count == mapped->facets_count) && check_same_facets(mapped->facets, stl->facets, stl->facets_count),
+		"cache", "mapped back");
+	stl_free(mapped);
+	mapped = NULL;
+
+	check_set_mtime(CHECK_OUT, 1);
+	check(STL_ERROR_STALE == stl_map_cache(CHECK_CACHE, CHECK_OUT, 0, &mapped), "cache", "stale a nanosecond later");
+
+	/* Same time as when it was cached, but longer */
+	fp = fopen(CHECK_OUT, "ab");
+	if((NULL == fp) || (1 != fwrite("x", 1, 1, fp)) || (0 != fclose(fp)))
+	{
+		printf("Could not write %s\n", CHECK_OUT);
+		exit(1);
+	}
+
+	check_set_mtime(CHECK_OUT, 0);
+	check(STL_ERROR_STALE == stl_map_cache(CHECK_CACHE, CHECK_OUT, 0, &mapped), "cache", "stale once grown");
+
+	remove(CHECK_OUT);
+	remove(CHECK_CACHE);
+
+	printf("Cache checked\n");
+}
+#endif
+
+/* stl_write_file_ex() never replaces an output, and turns down flags it
+ * doesn't know rather than quietly leave them out
+ */
+static void check_write_ex(const stl_t *stl)
+{
+	stl_t *back = NULL;
+
+	remove(CHECK_OUT);
+
+	check(STL_ERROR_INVALID_ARG == stl_write_file_ex(CHECK_OUT, (stl_t *)stl, 0x80), "write ex", "unknown flag refused");
+	check(!check_exists(CHECK_OUT), "write ex", "nothing written for an unknown flag");
+
+	check(STL_SUCCESS == stl_write_file_ex(CHECK_OUT, (stl_t *)stl, STL_WRITE_ATOMIC), "write ex", "atomic write");
+	check(STL_ERROR == stl_write_file_ex(CHECK_OUT, (stl_t *)stl, STL_WRITE_ATOMIC), "write ex", "atomic write over an output");
+	check(STL_ERROR == stl_write_file_ex(CHECK_OUT, (stl_t *)stl, 0), "write ex", "plain write over an output");
+
+	check((STL_SUCCESS == stl_read_file(CHECK_OUT, &back)) && (stl->facets_count == back->facets_count) &&
+		check_same_facets(back->facets, stl->facets, stl->facets_count), "write ex", "output read back");
+
+	stl_free(back);
+	remove(CHECK_OUT);
+
+	printf("Write ex checked\n");
+}
+
+int main(void)
+{
+	unsigned int c = 0;
+	stl_ctx_t    *ctx[CHECK_CTXS];
+	stl_t        *stl = check_load_mesh();
+
+	check_ctx_new(ctx);
+
+	check_simd(stl);
+	check_deferred_bounds(stl);
+	check_negative_scale(stl);
+	check_stats(ctx, stl);
+	check_stats_cube();
+	check_runs(ctx, "Auto orient", check_run_orient, stl, 16 * sizeof(double));
+	check_orient_slab();
+	check_runs(ctx, "Bounding box", check_run_obb, stl, sizeof(stl_obb_t));
+	check_obb_box();
+	check_obb_plate();
+	check_heightmap_file();
+	check_short_file();
+	check_parser(stl);
+	check_write_ex(stl);
+	check_ascii_parse();
+	check_ascii_round_trip(stl);
+#ifndef STL_NO_ZLIB
+	check_gzip(stl);
+#endif
+#ifndef _WIN32
+	check_cache(stl);
+#endif
+
+	for(c = 0; c < CHECK_CTXS; c++)
+	{
+		stl_ctx_free(ctx[c]);
+	}
+
+	stl_free(stl);
+
+	if(0 != check_failures)
+	{
+		printf("%d checks failed\n", check_failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+
+	return 0;
+}
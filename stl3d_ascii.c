@@ -0,0 +1,1187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* ASCII STL support. The whole file is mapped (or read) into memory and
+ * walked once with a hand written tokenizer, the numbers being converted
+ * by _stl_parse_float() rather than going through scanf().
+ *
+ *  solid name
+ *    facet normal ni nj nk
+ *      outer loop
+ *        vertex v1x v1y v1z
+ *        vertex v2x v2y v2z
+ *        vertex v3x v3y v3z
+ *      endloop
+ *    endfacet
+ *  endsolid name
+ */
+
+/* Rough size of one facet in an ASCII file, used to size the facet array
+ * before parsing so it rarely has to grow.
+ */
+#define STL_ASCII_FACET_BYTES 200
+
+/* Longest number handed to strtof() without allocating */
+#define STL_ASCII_NUMBER_MAX 64
+
+/* Powers of ten that are exact as floats and doubles */
+static const float stl_pow10_float[] =
+{
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+static const double stl_pow10_double[] =
+{
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+static int stl_is_space(char c)
+{
+	return ((' ' == c) || ('\t' == c) || ('\r' == c) || ('\n' == c) || ('\f' == c) || ('\v' == c));
+}
+
+static int stl_is_digit(char c)
+{
+	return ((c >= '0') && (c <= '9'));
+}
+
+static char stl_lower(char c)
+{
+	return ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+}
+
+static const char *stl_skip_space(const char *p, const char *end)
+{
+	while((p < end) && stl_is_space(*p))
+	{
+		p++;
+	}
+
+	return p;
+}
+
+static const char *stl_skip_line(const char *p, const char *end)
+{
+	while((p < end) && ('\n' != *p))
+	{
+		p++;
+	}
+
+	return p;
+}
+
+/* Skip whitespace and then the keyword word (any case), which has to be
+ * followed by whitespace or the end of the data. Returns non-zero and moves
+ * *pp past the keyword if it is there.
+ */
+static int stl_match_word(const char **pp, const char *end, const char *word)
+{
+	const char *p = stl_skip_space(*pp, end);
+
+	while('\0' != *word)
+	{
+		if((p >= end) || (stl_lower(*p) != *word))
+		{
+			return 0;
+		}
+
+		p++;
+		word++;
+	}
+
+	if((p < end) && !stl_is_space(*p))
+	{
+		return 0;
+	}
+
+	*pp = p;
+
+	return 1;
+}
+
+/* Convert the number in [start, stop) with strtof(). Used for anything the
+ * fast paths in _stl_parse_float() can't get exactly right.
+ */
+static int stl_parse_float_slow(const char *start, const char *stop, float *value)
+{
+	char   local[STL_ASCII_NUMBER_MAX];
+	char   *text = local;
+	char   *text_end = NULL;
+	size_t len = (size_t)(stop - start);
+
+	if(len >= sizeof(local))
+	{
+		text = (char *)malloc(len + 1);
+		if(NULL == text)
+		{
+			return 0;
+		}
+	}
+
+	memcpy(text, start, len);
+	text[len] = '\0';
+
+	*value = strtof(text, &text_end);
+
+	if(text != local)
+	{
+		free(text);
+	}
+
+	return (text_end == text + len);
+}
+
+/* Convert mantissa * 10^exp10 to the nearest float, when that can be done
+ * exactly with a single floating point operation. Returns 0 (and leaves
+ * value alone) when it can't.
+ */
+static int stl_decimal_to_float(unsigned long long mantissa, int exp10, float *value)
+{
+	unsigned long long bits = 0;
+	double             d = 0.0;
+	float              f = 0.0f;
+
+	/* Both operands are exact floats, so the one rounding done by the
+	 * multiply or divide gives the correctly rounded result.
+	 */
+	if((mantissa <= (1ULL << 24)) && (exp10 >= -10) && (exp10 <= 10))
+	{
+		f = (float)mantissa;
+		f = (exp10 < 0) ? (f / stl_pow10_float[-exp10]) : (f * stl_pow10_float[exp10]);
+
+		*value = f;
+		return 1;
+	}
+
+	/* Same again in double, then narrowed to float. That second rounding
+	 * can only go wrong if the double lands exactly half way between two
+	 * floats, so those (and anything outside the normal float range) are
+	 * left to the caller.
+	 */
+	if((mantissa <= (1ULL << 53)) && (exp10 >= -22) && (exp10 <= 22))
+	{
+		d = (double)mantissa;
+		d = (exp10 < 0) ? (d / stl_pow10_double[-exp10]) : (d * stl_pow10_double[exp10]);
+
+		memcpy(&bits, &d, sizeof(bits));
+
+		if((d >= FLT_MIN) && (d <= FLT_MAX) && (0x10000000ULL != (bits & 0x1FFFFFFFULL)))
+		{
+			*value = (float)d;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int _stl_parse_float(const char **pp, const char *end, float *value)
+{
+	const char         *p = *pp;
+	const char         *start = *pp;
+	int                negative = 0;
+	int                any_digits = 0;
+	int                digits = 0;
+	int                truncated = 0;
+	int                exp10 = 0;
+	int                exp_val = 0;
+	int                exp_negative = 0;
+	const char         *q = NULL;
+	unsigned long long mantissa = 0;
+	float              f = 0.0f;
+
+	if((p < end) && (('+' == *p) || ('-' == *p)))
+	{
+		negative = ('-' == *p);
+		p++;
+	}
+
+	/* Keep up to 19 significant digits, which always fit in 64 bits */
+	for(; (p < end) && stl_is_digit(*p); p++)
+	{
+		any_digits = 1;
+
+		if((0 == mantissa) && ('0' == *p))
+		{
+			continue;
+		}
+
+		if(digits < 19)
+		{
+			mantissa = (mantissa * 10) + (unsigned long long)(*p - '0');
+			digits++;
+		}
+		else
+		{
+			truncated |= ('0' != *p);
+			exp10++;
+		}
+	}
+
+	if((p < end) && ('.' == *p))
+	{
+		for(p++; (p < end) && stl_is_digit(*p); p++)
+		{
+			any_digits = 1;
+
+			if((0 == mantissa) && ('0' == *p))
+			{
+				exp10--;
+				continue;
+			}
+
+			if(digits < 19)
+			{
+				mantissa = (mantissa * 10) + (unsigned long long)(*p - '0');
+				digits++;
+				exp10--;
+			}
+			else
+			{
+				truncated |= ('0' != *p);
+			}
+		}
+	}
+
+	if(!any_digits)
+	{
+		/* Could still be inf or nan, let strtof() decide */
+		q = p;
+		while((q < end) && !stl_is_space(*q))
+		{
+			q++;
+		}
+
+		if((q == start) || !stl_parse_float_slow(start, q, value))
+		{
+			return 0;
+		}
+
+		*pp = q;
+
+		return 1;
+	}
+
+	if((p < end) && (('e' == *p) || ('E' == *p)))
+	{
+		q = p + 1;
+
+		if((q < end) && (('+' == *q) || ('-' == *q)))
+		{
+			exp_negative = ('-' == *q);
+			q++;
+		}
+
+		if((q < end) && stl_is_digit(*q))
+		{
+			for(; (q < end) && stl_is_digit(*q); q++)
+			{
+				if(exp_val < 100000)
+				{
+					exp_val = (exp_val * 10) + (*q - '0');
+				}
+			}
+
+			exp10 += exp_negative ? -exp_val : exp_val;
+			p = q;
+		}
+	}
+
+	*pp = p;
+
+	if(0 == mantissa)
+	{
+		*value = negative ? -0.0f : 0.0f;
+		return 1;
+	}
+
+	if(!truncated && stl_decimal_to_float(mantissa, exp10, &f))
+	{
+		*value = negative ? -f : f;
+		return 1;
+	}
+
+	return stl_parse_float_slow(start, p, value);
+}
+
+/* Parse three whitespace separated numbers into vertex
+ */
+static int stl_parse_vertex(const char **pp, const char *end, stl_vertex_t *vertex)
+{
+	float vals[3];
+	int   i = 0;
+
+	for(i = 0; i < 3; i++)
+	{
+		*pp = stl_skip_space(*pp, end);
+
+		if(!_stl_parse_float(pp, end, &vals[i]))
+		{
+			return 0;
+		}
+
+		/* Numbers have to be followed by whitespace */
+		if((*pp < end) && !stl_is_space(**pp))
+		{
+			return 0;
+		}
+	}
+
+	vertex->x = vals[0];
+	vertex->y = vals[1];
+	vertex->z = vals[2];
+
+	return 1;
+}
+
+/* Parse one "facet normal ... endfacet" block, the "facet" keyword having
+ * already been consumed.
+ */
+static int stl_parse_facet(const char **pp, const char *end, stl_facet_t *facet)
+{
+	int i = 0;
+
+	if(!stl_match_word(pp, end, "normal") ||
+		!stl_parse_vertex(pp, end, &facet->normal) ||
+		!stl_match_word(pp, end, "outer") ||
+		!stl_match_word(pp, end, "loop"))
+	{
+		return 0;
+	}
+
+	for(i = 0; i < 3; i++)
+	{
+		if(!stl_match_word(pp, end, "vertex") ||
+			!stl_parse_vertex(pp, end, &facet->verticies[i]))
+		{
+			return 0;
+		}
+	}
+
+	if(!stl_match_word(pp, end, "endloop") ||
+		!stl_match_word(pp, end, "endfacet"))
+	{
+		return 0;
+	}
+
+	facet->abc = 0;
+
+	return 1;
+}
+
+int _stl_looks_ascii(const unsigned char *start, size_t len, size_t file_size)
+{
+	size_t i = 0;
+	size_t check = len;
+
+	if((len < 5) || (memcmp(start, "solid", 5) != 0))
+	{
+		return 0;
+	}
+
+	/* Some binary files start their header with "solid" too. If the file is
+	 * exactly the size its facet count says a binary file would be, it's
+	 * binary.
+	 */
+	if((len >= STL_FACETS_OFFSET) && (file_size >= STL_FACETS_OFFSET))
+	{
+		if((file_size - STL_FACETS_OFFSET) == ((size_t)_stl_pack_le32(start + STL_HEADER_SIZE) * STL_FACET_SIZE))
+		{
+			return 0;
+		}
+	}
+
+	/* Otherwise it has to look like text, at least as far as where a binary
+	 * facet count would be.
+	 */
+	if(check > STL_FACETS_OFFSET)
+	{
+		check = STL_FACETS_OFFSET;
+	}
+
+	for(i = 0; i < check; i++)
+	{
+		if(((start[i] < 0x20) || (start[i] > 0x7E)) && !stl_is_space((char)start[i]))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+stl_error_t _stl_parse_ascii(const char *data, size_t size, stl_t **stl_new)
+{
+	stl_error_t error = STL_SUCCESS;
+	const char  *p = data;
+	const char  *end = data + size;
+	const char  *name = NULL;
+	const char  *name_end = NULL;
+	size_t      capacity = 0;
+	size_t      count = 0;
+	stl_facet_t *facets = NULL;
+	stl_t       *stl = NULL;
+
+	if((NULL == data) || (NULL == stl_new))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	stl = (stl_t *)malloc(sizeof(*stl));
+	if(NULL == stl)
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(stl, 0x00, sizeof(*stl));
+
+		capacity = (size / STL_ASCII_FACET_BYTES) + 16;
+
+		stl->facets = (stl_facet_t *)malloc(capacity * sizeof(stl->facets[0]));
+		if(NULL == stl->facets)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if(!stl_match_word(&p, end, "solid"))
+		{
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		/* The rest of the line is the name of the solid, which is kept in
+		 * the header.
+		 */
+		name_end = stl_skip_line(p, end);
+
+		for(name = p; (name < name_end) && stl_is_space(*name); name++)
+		{
+		}
+
+		while((name_end > name) && stl_is_space(*(name_end - 1)))
+		{
+			name_end--;
+		}
+
+		memcpy(stl->header, name, ((size_t)(name_end - name) < STL_HEADER_SIZE) ? (size_t)(name_end - name) : STL_HEADER_SIZE);
+
+		p = stl_skip_line(p, end);
+	}
+
+	while(STL_SUCCESS == error)
+	{
+		if(stl_match_word(&p, end, "facet"))
+		{
+			if(count == capacity)
+			{
+				capacity *= 2;
+
+				/* Don't let the size wrap around on huge inputs */
+				facets = NULL;
+				if(capacity <= ((size_t)-1) / sizeof(stl->facets[0]))
+				{
+					facets = (stl_facet_t *)realloc(stl->facets, capacity * sizeof(stl->facets[0]));
+				}
+
+				if(NULL == facets)
+				{
+					error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+					break;
+				}
+
+				stl->facets = facets;
+			}
+
+			memset(&stl->facets[count], 0x00, sizeof(stl->facets[0]));
+
+			if(!stl_parse_facet(&p, end, &stl->facets[count]))
+			{
+				error = STL_LOG_ERR(STL_ERROR);
+				break;
+			}
+
+			count++;
+		}
+		else if(stl_match_word(&p, end, "endsolid"))
+		{
+			p = stl_skip_line(p, end);
+
+			/* Some files hold several solids one after the other */
+			if(stl_match_word(&p, end, "solid"))
+			{
+				p = stl_skip_line(p, end);
+			}
+		}
+		else if(stl_skip_space(p, end) == end)
+		{
+			break;
+		}
+		else
+		{
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		stl->facets_count = count;
+
+		/* Give back what the estimate over allocated */
+		if((count > 0) && (count < capacity))
+		{
+			facets = (stl_facet_t *)realloc(stl->facets, count * sizeof(stl->facets[0]));
+			if(NULL != facets)
+			{
+				stl->facets = facets;
+			}
+		}
+
+		*stl_new = stl;
+		stl = NULL;
+	}
+
+	if(NULL != stl)
+	{
+		stl_free(stl);
+		stl = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t _stl_read_ascii_file(const char *input_file, stl_t **stl_new)
+{
+	stl_error_t error = STL_SUCCESS;
+	void        *base = NULL;
+	size_t      size = 0;
+	char        *data = NULL;
+	long        len = 0;
+	FILE        *fp = NULL;
+
+	if((NULL == input_file) || (NULL == stl_new))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	error = _stl_map_readonly(input_file, &base, &size);
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_parse_ascii((const char *)base, size, stl_new);
+		_stl_unmap(base, size);
+
+		return STL_LOG_ERR(error);
+	}
+
+	if(STL_ERROR_UNSUPPORTED != error)
+	{
+		return STL_LOG_ERR(error);
+	}
+
+	/* No mmap() on this platform, read the whole file in instead */
+	error = STL_SUCCESS;
+
+	fp = fopen(input_file, "rb");
+	if(NULL == fp)
+	{
+		error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if((fseek(fp, 0, SEEK_END) != 0) || ((len = ftell(fp)) <= 0) || (fseek(fp, 0, SEEK_SET) != 0))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		data = (char *)malloc((size_t)len);
+		if(NULL == data)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if(fread(data, 1, (size_t)len, fp) != (size_t)len)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_parse_ascii(data, (size_t)len, stl_new);
+	}
+
+	if(NULL != data)
+	{
+		free(data);
+		data = NULL;
+	}
+
+	if(NULL != fp)
+	{
+		fclose(fp);
+		fp = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Size of the blocks stl_write_file_ascii() builds up and writes */
+#define STL_ASCII_WRITE_BUFFER (1024 * 1024)
+
+/* Most text one facet can turn into */
+#define STL_ASCII_FACET_MAX 512
+
+static const unsigned long long stl_pow10_int[] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL
+};
+
+/* Shortest float to decimal below is Ryu (Ulf Adams, PLDI 2018) cut down to
+ * floats. The two tables hold the leading bits of 5^-q and 5^i, enough of
+ * them that one 32 x 64 bit multiply and shift gives the exact decimal digits
+ * of the bounds around a float.
+ */
+#define STL_FLOAT_POW5_INV_BITS 59
+#define STL_FLOAT_POW5_BITS     61
+
+/* floor(2^(ceil(log2(5^q)) - 1 + 59) / 5^q) + 1 */
+static const unsigned long long stl_float_pow5_inv[31] =
+{
+	576460752303423489ULL, 461168601842738791ULL, 368934881474191033ULL,
+	295147905179352826ULL, 472236648286964522ULL, 377789318629571618ULL,
+	302231454903657294ULL, 483570327845851670ULL, 386856262276681336ULL,
+	309485009821345069ULL, 495176015714152110ULL, 396140812571321688ULL,
+	316912650057057351ULL, 507060240091291761ULL, 405648192073033409ULL,
+	324518553658426727ULL, 519229685853482763ULL, 415383748682786211ULL,
+	332306998946228969ULL, 531691198313966350ULL, 425352958651173080ULL,
+	340282366920938464ULL, 544451787073501542ULL, 435561429658801234ULL,
+	348449143727040987ULL, 557518629963265579ULL, 446014903970612463ULL,
+	356811923176489971ULL, 570899077082383953ULL, 456719261665907162ULL,
+	365375409332725730ULL
+};
+
+/* The top 61 bits of 5^i */
+static const unsigned long long stl_float_pow5[48] =
+{
+	1152921504606846976ULL, 1441151880758558720ULL, 1801439850948198400ULL,
+	2251799813685248000ULL, 1407374883553280000ULL, 1759218604441600000ULL,
+	2199023255552000000ULL, 1374389534720000000ULL, 1717986918400000000ULL,
+	2147483648000000000ULL, 1342177280000000000ULL, 1677721600000000000ULL,
+	2097152000000000000ULL, 1310720000000000000ULL, 1638400000000000000ULL,
+	2048000000000000000ULL, 1280000000000000000ULL, 1600000000000000000ULL,
+	2000000000000000000ULL, 1250000000000000000ULL, 1562500000000000000ULL,
+	1953125000000000000ULL, 1220703125000000000ULL, 1525878906250000000ULL,
+	1907348632812500000ULL, 1192092895507812500ULL, 1490116119384765625ULL,
+	1862645149230957031ULL, 1164153218269348144ULL, 1455191522836685180ULL,
+	1818989403545856475ULL, 2273736754432320594ULL, 1421085471520200371ULL,
+	1776356839400250464ULL, 2220446049250313080ULL, 1387778780781445675ULL,
+	1734723475976807094ULL, 2168404344971008868ULL, 1355252715606880542ULL,
+	1694065894508600678ULL, 2117582368135750847ULL, 1323488980084844279ULL,
+	1654361225106055349ULL, 2067951531382569187ULL, 1292469707114105741ULL,
+	1615587133892632177ULL, 2019483917365790221ULL, 1262177448353618888ULL
+};
+
+/* ceil(log2(5^e)), or 1 for e == 0 */
+static int stl_pow5_bits(int e)
+{
+	return (int)(((unsigned int)e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) */
+static unsigned int stl_log10_pow2(int e)
+{
+	return ((unsigned int)e * 78913) >> 18;
+}
+
+/* floor(log10(5^e)) */
+static unsigned int stl_log10_pow5(int e)
+{
+	return ((unsigned int)e * 732923) >> 20;
+}
+
+/* Non-zero if 5^p divides value */
+static int stl_multiple_of_pow5(unsigned int value, unsigned int p)
+{
+	unsigned int count = 0;
+
+	while((0 != value) && (0 == (value % 5)))
+	{
+		value /= 5;
+		count++;
+	}
+
+	return (count >= p);
+}
+
+/* (m * factor) >> shift for a shift over 32, without a 128 bit product */
+static unsigned int stl_mul_shift(unsigned int m, unsigned long long factor, int shift)
+{
+	unsigned long long low = (unsigned long long)m * (unsigned int)factor;
+	unsigned long long high = (unsigned long long)m * (unsigned int)(factor >> 32);
+
+	return (unsigned int)(((low >> 32) + high) >> (shift - 32));
+}
+
+/* Turn the bits of a positive, finite, non-zero float into the decimal
+ * mantissa * 10^exp10 with the fewest digits that still reads back as the
+ * same float, the nearest such one if there's a choice.
+ */
+static void stl_shortest_decimal(unsigned int bits, unsigned int *mantissa, int *exp10)
+{
+	unsigned int  ieee_mantissa = bits & ((1u << 23) - 1);
+	unsigned int  ieee_exponent = (bits >> 23) & 0xFF;
+	unsigned int  m2 = 0;
+	unsigned int  mv = 0;
+	unsigned int  mp = 0;
+	unsigned int  mm = 0;
+	unsigned int  mm_shift = 0;
+	unsigned int  vr = 0;
+	unsigned int  vp = 0;
+	unsigned int  vm = 0;
+	unsigned int  q = 0;
+	unsigned int  last_digit = 0;
+	int           e2 = 0;
+	int           e10 = 0;
+	int           i = 0;
+	int           j = 0;
+	int           removed = 0;
+	int           accept_bounds = 0;
+	int           vm_zeros = 0;
+	int           vr_zeros = 0;
+
+	/* value = m2 * 2^e2, with two more bits to hold the half way points */
+	if(0 == ieee_exponent)
+	{
+		e2 = 1 - 127 - 23 - 2;
+		m2 = ieee_mantissa;
+	}
+	else
+	{
+		e2 = (int)ieee_exponent - 127 - 23 - 2;
+		m2 = (1u << 23) | ieee_mantissa;
+	}
+
+	/* Round half to even when reading, so an even float owns its bounds */
+	accept_bounds = (0 == (m2 & 1));
+
+	/* The value and the half way points to its neighbours, which are
+	 * closer below at a power of two
+	 */
+	mv = 4 * m2;
+	mp = 4 * m2 + 2;
+	mm_shift = (0 != ieee_mantissa) || (ieee_exponent <= 1);
+	mm = 4 * m2 - 1 - mm_shift;
+
+	if(e2 >= 0)
+	{
+		q = stl_log10_pow2(e2);
+		e10 = (int)q;
+		i = -e2 + (int)q + STL_FLOAT_POW5_INV_BITS + stl_pow5_bits((int)q) - 1;
+
+		vr = stl_mul_shift(mv, stl_float_pow5_inv[q], i);
+		vp = stl_mul_shift(mp, stl_float_pow5_inv[q], i);
+		vm = stl_mul_shift(mm, stl_float_pow5_inv[q], i);
+
+		/* One more digit of vr, for rounding if no loop below removes one */
+		if((0 != q) && ((vp - 1) / 10 <= vm / 10))
+		{
+			j = -e2 + (int)q - 1 + STL_FLOAT_POW5_INV_BITS + stl_pow5_bits((int)q - 1) - 1;
+			last_digit = stl_mul_shift(mv, stl_float_pow5_inv[q - 1], j) % 10;
+		}
+
+		/* Which of the divisions by 10^q were exact */
+		if(q <= 9)
+		{
+			if(0 == (mv % 5))
+			{
+				vr_zeros = stl_multiple_of_pow5(mv, q);
+			}
+			else if(accept_bounds)
+			{
+				vm_zeros = stl_multiple_of_pow5(mm, q);
+			}
+			else
+			{
+				vp -= stl_multiple_of_pow5(mp, q);
+			}
+		}
+	}
+	else
+	{
+		q = stl_log10_pow5(-e2);
+		e10 = (int)q + e2;
+		i = -e2 - (int)q;
+		j = (int)q - (stl_pow5_bits(i) - STL_FLOAT_POW5_BITS);
+
+		vr = stl_mul_shift(mv, stl_float_pow5[i], j);
+		vp = stl_mul_shift(mp, stl_float_pow5[i], j);
+		vm = stl_mul_shift(mm, stl_float_pow5[i], j);
+
+		if((0 != q) && ((vp - 1) / 10 <= vm / 10))
+		{
+			j = (int)q - 1 - (stl_pow5_bits(i + 1) - STL_FLOAT_POW5_BITS);
+			last_digit = stl_mul_shift(mv, stl_float_pow5[i + 1], j) % 10;
+		}
+
+		/* Exact if the q - 1 low bits are clear, mv always has two */
+		if(q <= 1)
+		{
+			vr_zeros = 1;
+			if(accept_bounds)
+			{
+				vm_zeros = (1 == mm_shift);
+			}
+			else
+			{
+				vp--;
+			}
+		}
+		else if(q < 31)
+		{
+			vr_zeros = (0 == (mv & ((1u << (q - 1)) - 1)));
+		}
+	}
+
+	/* Drop digits while the bounds still differ above them */
+	if(vm_zeros || vr_zeros)
+	{
+		while(vp / 10 > vm / 10)
+		{
+			vm_zeros &= (0 == (vm % 10));
+			vr_zeros &= (0 == last_digit);
+			last_digit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+
+		if(vm_zeros)
+		{
+			while(0 == (vm % 10))
+			{
+				vr_zeros &= (0 == last_digit);
+				last_digit = vr % 10;
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				removed++;
+			}
+		}
+
+		/* Exactly half way, round to even */
+		if(vr_zeros && (5 == last_digit) && (0 == (vr % 2)))
+		{
+			last_digit = 4;
+		}
+
+		*mantissa = vr + (((vr == vm) && (!accept_bounds || !vm_zeros)) || (last_digit >= 5));
+	}
+	else
+	{
+		while(vp / 10 > vm / 10)
+		{
+			last_digit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+
+		*mantissa = vr + ((vr == vm) || (last_digit >= 5));
+	}
+
+	*exp10 = e10 + removed;
+}
+
+/* Write value into out as the shortest decimal that reads back as the same
+ * float. Returns the number of characters written, which is at most 16. out
+ * is not NUL terminated.
+ */
+static int stl_format_float(float value, char *out)
+{
+	char          *p = out;
+	unsigned int  bits = 0;
+	unsigned int  mantissa = 0;
+	int           exp10 = 0;
+	int           precision = 0;
+	int           i = 0;
+	char          digits[10];
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	if(0 != (bits >> 31))
+	{
+		*p++ = '-';
+		bits &= 0x7FFFFFFF;
+	}
+
+	if(bits >= 0x7F800000)
+	{
+		/* No sign on a nan */
+		if(bits > 0x7F800000)
+		{
+			memcpy(out, "nan", 3);
+			return 3;
+		}
+
+		memcpy(p, "inf", 3);
+		return (int)(p - out) + 3;
+	}
+
+	if(0 == bits)
+	{
+		*p++ = '0';
+		return (int)(p - out);
+	}
+
+	stl_shortest_decimal(bits, &mantissa, &exp10);
+
+	while(0 == (mantissa % 10))
+	{
+		mantissa /= 10;
+		exp10++;
+	}
+
+	precision = 1;
+	while(mantissa >= stl_pow10_int[precision])
+	{
+		precision++;
+	}
+
+	/* From the last digit's power of ten to the first's */
+	exp10 += precision - 1;
+
+	for(i = precision - 1; i >= 0; i--)
+	{
+		digits[i] = (char)('0' + (mantissa % 10));
+		mantissa /= 10;
+	}
+
+	if((exp10 >= -5) && (exp10 < 9))
+	{
+		/* Plain notation, 0.000123 or 1234.5 */
+		if(exp10 < 0)
+		{
+			*p++ = '0';
+			*p++ = '.';
+			for(i = -1; i > exp10; i--)
+			{
+				*p++ = '0';
+			}
+			memcpy(p, digits, precision);
+			p += precision;
+		}
+		else
+		{
+			for(i = 0; i <= exp10; i++)
+			{
+				*p++ = (i < precision) ? digits[i] : '0';
+			}
+
+			if(precision > exp10 + 1)
+			{
+				*p++ = '.';
+				memcpy(p, digits + exp10 + 1, precision - exp10 - 1);
+				p += precision - exp10 - 1;
+			}
+		}
+	}
+	else
+	{
+		/* Exponent notation, 1.2345e+20 */
+		*p++ = digits[0];
+		if(precision > 1)
+		{
+			*p++ = '.';
+			memcpy(p, digits + 1, precision - 1);
+			p += precision - 1;
+		}
+
+		*p++ = 'e';
+		*p++ = (exp10 < 0) ? '-' : '+';
+		if(exp10 < 0)
+		{
+			exp10 = -exp10;
+		}
+
+		*p++ = (char)('0' + (exp10 / 10));
+		*p++ = (char)('0' + (exp10 % 10));
+	}
+
+	return (int)(p - out);
+}
+
+/* Append the text of a literal string to p */
+#define STL_PUT(p, text) \
+	do { memcpy((p), (text), sizeof(text) - 1); (p) += sizeof(text) - 1; } while(0)
+
+/* Append three numbers separated by spaces and end the line */
+static char *stl_put_vertex(char *p, const stl_vertex_t *vertex)
+{
+	p += stl_format_float(vertex->x, p);
+	*p++ = ' ';
+	p += stl_format_float(vertex->y, p);
+	*p++ = ' ';
+	p += stl_format_float(vertex->z, p);
+	*p++ = '\n';
+
+	return p;
+}
+
+/* Append the name of the solid, taken from the printable start of the header */
+static char *stl_put_name(char *p, const stl_t *stl)
+{
+	size_t len = 0;
+
+	while((len < STL_HEADER_SIZE) && (stl->header[len] >= 0x20) && (stl->header[len] <= 0x7E))
+	{
+		len++;
+	}
+
+	while((len > 0) && (' ' == stl->header[len - 1]))
+	{
+		len--;
+	}
+
+	if(len > 0)
+	{
+		*p++ = ' ';
+		memcpy(p, stl->header, len);
+		p += len;
+	}
+
+	*p++ = '\n';
+
+	return p;
+}
+
+stl_error_t stl_write_file_ascii(char *output_file, stl_t *stl)
+{
+	stl_error_t       error = STL_SUCCESS;
+	size_t            i = 0;
+	size_t            used = 0;
+	size_t            res = 0;
+	char              *buffer = NULL;
+	char              *p = NULL;
+	FILE              *fp = NULL;
+	const stl_facet_t *facet = NULL;
+	stl_facet_t       tmp;
+
+	if((NULL == output_file) || (NULL == stl))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	buffer = (char *)malloc(STL_ASCII_WRITE_BUFFER);
+	if(NULL == buffer)
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_create_file(output_file, &fp);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		p = buffer;
+
+		STL_PUT(p, "solid");
+		p = stl_put_name(p, stl);
+
+		for(i = 0; i <= stl->facets_count; i++)
+		{
+			/* Write the block out once there might not be room for another facet */
+			used = (size_t)(p - buffer);
+			if((used > STL_ASCII_WRITE_BUFFER - STL_ASCII_FACET_MAX) || (i == stl->facets_count))
+			{
+				res = fwrite(buffer, 1, used, fp);
+				if(used != res)
+				{
+					error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+					break;
+				}
+
+				p = buffer;
+			}
+
+			if(i == stl->facets_count)
+			{
+				break;
+			}
+
+			facet = _stl_get_facet(stl, i, &tmp);
+
+			STL_PUT(p, "  facet normal ");
+			p = stl_put_vertex(p, &facet->normal);
+			STL_PUT(p, "    outer loop\n");
+			STL_PUT(p, "      vertex ");
+			p = stl_put_vertex(p, &facet->verticies[0]);
+			STL_PUT(p, "      vertex ");
+			p = stl_put_vertex(p, &facet->verticies[1]);
+			STL_PUT(p, "      vertex ");
+			p = stl_put_vertex(p, &facet->verticies[2]);
+			STL_PUT(p, "    endloop\n");
+			STL_PUT(p, "  endfacet\n");
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		p = buffer;
+
+		STL_PUT(p, "endsolid");
+		p = stl_put_name(p, stl);
+
+		used = (size_t)(p - buffer);
+		res = fwrite(buffer, 1, used, fp);
+		if(used != res)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if(NULL != fp)
+	{
+		if((0 != fclose(fp)) && (STL_SUCCESS == error))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		fp = NULL;
+	}
+
+	if(NULL != buffer)
+	{
+		free(buffer);
+		buffer = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Cache files hold the facets exactly as stl_facet_t sits in memory, so
+ * loading one is a single mmap() with nothing to parse or convert. The
+ * layout is that of the machine that wrote it; a cache written by a machine
+ * with a different byte order or structure layout is rejected, and the
+ * caller falls back to the STL file.
+ *
+ *   stl_cache_header_t
+ *   zero padding up to facets_offset (a multiple of STL_CACHE_ALIGN)
+ *   facets_count x stl_facet_t
+ */
+
+#define STL_CACHE_MAGIC      "STL3DCAC"
+#define STL_CACHE_VERSION    2
+#define STL_CACHE_BYTE_ORDER 0x01020304
+
+/* Facets start on a cache line boundary */
+#define STL_CACHE_ALIGN      64
+
+/* Sub-second part of the modification time. Whole seconds alone miss a
+ * source rewritten within the same second as the cache was made.
+ */
+#if defined(_WIN32)
+#define STL_CACHE_MTIME_NSEC(st) 0
+#elif defined(__APPLE__)
+#define STL_CACHE_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define STL_CACHE_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+/* What the STL file looked like when the cache was made. A new inode
+ * catches a file replaced by one of the same size and time.
+ */
+typedef struct
+{
+	unsigned long long size;
+	unsigned long long inode;
+	long long          mtime;
+	long long          mtime_nsec;
+} stl_cache_source_t;
+
+typedef struct
+{
+	char               magic[8];
+	unsigned int       version;
+	unsigned int       byte_order;
+	unsigned int       header_size;
+	unsigned int       facet_size;
+
+	unsigned long long facets_count;
+	unsigned long long facets_offset;
+
+	stl_cache_source_t source;
+
+	/* Of the facet data, see stl_cache_checksum() */
+	unsigned long long checksum;
+
+	stl_vertex_t       bounds_min;
+	stl_vertex_t       bounds_max;
+
+	unsigned char      header[STL_HEADER_SIZE];
+} stl_cache_header_t;
+
+#define STL_CACHE_FACETS_OFFSET \
+	(((sizeof(stl_cache_header_t) + STL_CACHE_ALIGN - 1) / STL_CACHE_ALIGN) * STL_CACHE_ALIGN)
+
+/* FNV-1a style hash taken 8 bytes at a time, which is several times faster
+ * than going byte by byte. len must be a multiple of 8 on every call but
+ * the last.
+ */
+static unsigned long long stl_cache_checksum(unsigned long long hash, const unsigned char *data, size_t len)
+{
+	unsigned long long word = 0;
+
+	while(len >= sizeof(word))
+	{
+		memcpy(&word, data, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ULL;
+
+		data += sizeof(word);
+		len -= sizeof(word);
+	}
+
+	if(len > 0)
+	{
+		word = 0;
+		memcpy(&word, data, len);
+		hash = (hash ^ word) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+#define STL_CACHE_CHECKSUM_SEED 0xcbf29ce484222325ULL
+
+/* Size, inode and modification time of the source file
+ */
+static stl_error_t stl_cache_source_info(const char *source_file, stl_cache_source_t *source)
+{
+	stl_error_t error = STL_SUCCESS;
+	struct stat st;
+
+	memset(source, 0x00, sizeof(*source));
+
+	if(0 != stat(source_file, &st))
+	{
+		error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		source->size = (unsigned long long)st.st_size;
+		source->inode = (unsigned long long)st.st_ino;
+		source->mtime = (long long)st.st_mtime;
+		source->mtime_nsec = (long long)STL_CACHE_MTIME_NSEC(st);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Non-zero if the source file has changed since the cache was made */
+static int stl_cache_source_changed(const stl_cache_source_t *then, const stl_cache_source_t *now)
+{
+	return (then->size != now->size) ||
+		(then->inode != now->inode) ||
+		(then->mtime != now->mtime) ||
+		(then->mtime_nsec != now->mtime_nsec);
+}
+
+static void stl_cache_grow_bounds(stl_cache_header_t *hdr, const stl_vertex_t *v)
+{
+	hdr->bounds_min.x = (v->x < hdr->bounds_min.x) ? v->x : hdr->bounds_min.x;
+	hdr->bounds_min.y = (v->y < hdr->bounds_min.y) ? v->y : hdr->bounds_min.y;
+	hdr->bounds_min.z = (v->z < hdr->bounds_min.z) ? v->z : hdr->bounds_min.z;
+
+	hdr->bounds_max.x = (v->x > hdr->bounds_max.x) ? v->x : hdr->bounds_max.x;
+	hdr->bounds_max.y = (v->y > hdr->bounds_max.y) ? v->y : hdr->bounds_max.y;
+	hdr->bounds_max.z = (v->z > hdr->bounds_max.z) ? v->z : hdr->bounds_max.z;
+}
+
+stl_error_t stl_write_cache(char *cache_file, char *source_file, stl_t *stl)
+{
+	stl_error_t        error = STL_SUCCESS;
+	size_t             i = 0;
+	size_t             j = 0;
+	size_t             chunk = 0;
+	size_t             res = 0;
+	FILE               *fp = NULL;
+	stl_facet_t        *buffer = NULL;
+	const stl_facet_t  *facet = NULL;
+	stl_facet_t        tmp;
+	unsigned char      pad[STL_CACHE_ALIGN];
+	stl_cache_header_t hdr;
+
+	if((NULL == cache_file) || (NULL == stl))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	memset(&hdr, 0x00, sizeof(hdr));
+	memset(pad, 0x00, sizeof(pad));
+
+	memcpy(hdr.magic, STL_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = STL_CACHE_VERSION;
+	hdr.byte_order = STL_CACHE_BYTE_ORDER;
+	hdr.header_size = sizeof(hdr);
+	hdr.facet_size = sizeof(stl_facet_t);
+	hdr.facets_count = stl->facets_count;
+	hdr.facets_offset = STL_CACHE_FACETS_OFFSET;
+	hdr.checksum = STL_CACHE_CHECKSUM_SEED;
+	memcpy(hdr.header, stl->header, STL_HEADER_SIZE);
+
+	if(NULL != source_file)
+	{
+		error = stl_cache_source_info(source_file, &hdr.source);
+	}
+
+	/* Facets are copied through here a field at a time so the padding at
+	 * the end of stl_facet_t goes out as zeros rather than whatever was in
+	 * memory, and the checksum comes out the same for the same mesh.
+	 */
+	if(STL_SUCCESS == error)
+	{
+		buffer = (stl_facet_t *)calloc(STL_WRITE_CHUNK_FACETS, sizeof(buffer[0]));
+		if(NULL == buffer)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_create_file(cache_file, &fp);
+	}
+
+	/* The header goes out again at the end once the bounds and checksum
+	 * are known, this just makes room for it
+	 */
+	if(STL_SUCCESS == error)
+	{
+		if((1 != fwrite(&hdr, sizeof(hdr), 1, fp)) ||
+			(1 != fwrite(pad, STL_CACHE_FACETS_OFFSET - sizeof(hdr), 1, fp)))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (stl->facets_count > 0))
+	{
+		facet = _stl_get_facet(stl, 0, &tmp);
+		hdr.bounds_min = facet->verticies[0];
+		hdr.bounds_max = facet->verticies[0];
+	}
+
+	for(i = 0; (STL_SUCCESS == error) && (i < stl->facets_count); i += chunk)
+	{
+		chunk = stl->facets_count - i;
+		if(chunk > STL_WRITE_CHUNK_FACETS)
+		{
+			chunk = STL_WRITE_CHUNK_FACETS;
+		}
+
+		for(j = 0; j < chunk; j++)
+		{
+			facet = _stl_get_facet(stl, i + j, &tmp);
+
+			buffer[j].normal = facet->normal;
+			buffer[j].verticies[0] = facet->verticies[0];
+			buffer[j].verticies[1] = facet->verticies[1];
+			buffer[j].verticies[2] = facet->verticies[2];
+			buffer[j].abc = facet->abc;
+
+			stl_cache_grow_bounds(&hdr, &facet->verticies[0]);
+			stl_cache_grow_bounds(&hdr, &facet->verticies[1]);
+			stl_cache_grow_bounds(&hdr, &facet->verticies[2]);
+		}
+
+		hdr.checksum = stl_cache_checksum(hdr.checksum, (const unsigned char *)buffer, chunk * sizeof(buffer[0]));
+
+		res = fwrite(buffer, sizeof(buffer[0]), chunk, fp);
+		if(chunk != res)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if((0 != fseek(fp, 0, SEEK_SET)) || (1 != fwrite(&hdr, sizeof(hdr), 1, fp)))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if(NULL != fp)
+	{
+		if((0 != fclose(fp)) && (STL_SUCCESS == error))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		fp = NULL;
+
+		/* Half a cache is worse than none */
+		if(STL_SUCCESS != error)
+		{
+			remove(cache_file);
+		}
+	}
+
+	free(buffer);
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_map_cache(char *cache_file, char *source_file, unsigned int flags, stl_t **stl_new)
+{
+	stl_error_t              error = STL_SUCCESS;
+	void                     *base = NULL;
+	size_t                   size = 0;
+	const stl_cache_header_t *hdr = NULL;
+	stl_t                    *stl = NULL;
+	stl_cache_source_t       source;
+
+	if((NULL == cache_file) || (NULL == stl_new))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	memset(&source, 0x00, sizeof(source));
+
+	/* Private and writable, so the object can be modified in place like any
+	 * other without the changes reaching the cache file
+	 */
+	error = _stl_map_private(cache_file, &base, &size);
+
+	if(STL_SUCCESS == error)
+	{
+		hdr = (const stl_cache_header_t *)base;
+
+		if((size < sizeof(*hdr)) ||
+			(0 != memcmp(hdr->magic, STL_CACHE_MAGIC, sizeof(hdr->magic))) ||
+			(STL_CACHE_VERSION != hdr->version) ||
+			(STL_CACHE_BYTE_ORDER != hdr->byte_order) ||
+			(sizeof(*hdr) != hdr->header_size) ||
+			(sizeof(stl_facet_t) != hdr->facet_size))
+		{
+			fprintf(stderr, "Error: %s is not a cache file for this machine\n", cache_file);
+			error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+		}
+	}
+
+	/* The facets have to be all there */
+	if(STL_SUCCESS == error)
+	{
+		if((hdr->facets_offset > size) ||
+			(0 != (hdr->facets_offset % STL_CACHE_ALIGN)) ||
+			((size - hdr->facets_offset) / sizeof(stl_facet_t) < hdr->facets_count))
+		{
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (NULL != source_file))
+	{
+		error = stl_cache_source_info(source_file, &source);
+
+		if((STL_SUCCESS == error) && stl_cache_source_changed(&hdr->source, &source))
+		{
+			error = STL_LOG_ERR(STL_ERROR_STALE);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (flags & STL_CACHE_VERIFY))
+	{
+		if(hdr->checksum != stl_cache_checksum(STL_CACHE_CHECKSUM_SEED, (const unsigned char *)base + hdr->facets_offset,
+			(size_t)hdr->facets_count * sizeof(stl_facet_t)))
+		{
+			fprintf(stderr, "Error: %s is corrupt\n", cache_file);
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		stl = (stl_t *)malloc(sizeof(*stl));
+		if(NULL == stl)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(stl, 0x00, sizeof(*stl));
+
+		memcpy(stl->header, hdr->header, STL_HEADER_SIZE);
+		stl->facets_count = (size_t)hdr->facets_count;
+		stl->facets = (stl_facet_t *)((unsigned char *)base + hdr->facets_offset);
+		stl->facets_in_map = 1;
+		stl->map_base = base;
+		stl->map_size = size;
+
+		stl->has_bounds = (hdr->facets_count > 0);
+		stl->bounds_min = hdr->bounds_min;
+		stl->bounds_max = hdr->bounds_max;
+
+		*stl_new = stl;
+		base = NULL;
+	}
+
+	if(NULL != base)
+	{
+		_stl_unmap(base, size);
+		base = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Compact objects. Corners are 16 bit steps across the bounding box,
+ * 18 bytes a facet instead of 36, and normals are octahedral: the unit
+ * vector is pushed out onto the octahedron |x| + |y| + |z| = 1, the bottom
+ * half folded over the top, and the x and y left are kept as 16 bits each.
+ */
+
+/* Facets fetched at a time while packing */
+#define STL_COMPACT_BLOCK 256
+
+/* Largest packed value */
+#define STL_COMPACT_MAX 65535.0
+
+/* Packed normal that stands for a zero normal. (0, 0) is one of the four
+ * corners of the folded square that all mean straight down, so nothing is
+ * lost by keeping it back.
+ */
+#define STL_COMPACT_ZERO_NORMAL 0
+
+static unsigned short stl_compact_quantize(double v)
+{
+	v = floor(v + 0.5);
+
+	if(v < 0.0)
+	{
+		return 0;
+	}
+
+	if(v > STL_COMPACT_MAX)
+	{
+		return (unsigned short)STL_COMPACT_MAX;
+	}
+
+	return (unsigned short)v;
+}
+
+/* False for infinities and NaNs */
+static int stl_compact_finite(double v)
+{
+	return fabs(v) < HUGE_VAL;
+}
+
+static double stl_compact_sign(double v)
+{
+	return (v >= 0.0) ? 1.0 : -1.0;
+}
+
+static void stl_compact_encode_normal(const double n[3], unsigned short *packed)
+{
+	double sum = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+	double u = 0.0;
+	double v = 0.0;
+	double t = 0.0;
+
+	/* No direction, or not a number */
+	if(!(sum > 0.0))
+	{
+		packed[0] = STL_COMPACT_ZERO_NORMAL;
+		packed[1] = STL_COMPACT_ZERO_NORMAL;
+		return;
+	}
+
+	u = n[0] / sum;
+	v = n[1] / sum;
+
+	/* Fold the bottom half over */
+	if(n[2] < 0.0)
+	{
+		t = (1.0 - fabs(v)) * stl_compact_sign(u);
+		v = (1.0 - fabs(u)) * stl_compact_sign(v);
+		u = t;
+	}
+
+	packed[0] = stl_compact_quantize((u + 1.0) * (STL_COMPACT_MAX / 2.0));
+	packed[1] = stl_compact_quantize((v + 1.0) * (STL_COMPACT_MAX / 2.0));
+
+	/* Straight down from the other corner instead */
+	if((STL_COMPACT_ZERO_NORMAL == packed[0]) && (STL_COMPACT_ZERO_NORMAL == packed[1]))
+	{
+		packed[0] = (unsigned short)STL_COMPACT_MAX;
+		packed[1] = (unsigned short)STL_COMPACT_MAX;
+	}
+}
+
+static void stl_compact_decode_normal(const unsigned short *packed, double n[3])
+{
+	double length = 0.0;
+	double t = 0.0;
+
+	if((STL_COMPACT_ZERO_NORMAL == packed[0]) && (STL_COMPACT_ZERO_NORMAL == packed[1]))
+	{
+		n[0] = 0.0;
+		n[1] = 0.0;
+		n[2] = 0.0;
+		return;
+	}
+
+	n[0] = packed[0] / (STL_COMPACT_MAX / 2.0) - 1.0;
+	n[1] = packed[1] / (STL_COMPACT_MAX / 2.0) - 1.0;
+	n[2] = 1.0 - fabs(n[0]) - fabs(n[1]);
+
+	if(n[2] < 0.0)
+	{
+		t = (1.0 - fabs(n[1])) * stl_compact_sign(n[0]);
+		n[1] = (1.0 - fabs(n[0])) * stl_compact_sign(n[1]);
+		n[0] = t;
+	}
+
+	length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+	n[0] /= length;
+	n[1] /= length;
+	n[2] /= length;
+}
+
+void stl_compact_free(stl_compact_t *compact)
+{
+	if(NULL == compact)
+	{
+		return;
+	}
+
+	free(compact->corners);
+	free(compact->normals);
+	free(compact->abc);
+
+	free(compact);
+}
+
+size_t stl_compact_size(stl_compact_t *compact)
+{
+	size_t size = 0;
+
+	if(NULL == compact)
+	{
+		return 0;
+	}
+
+	size = sizeof(*compact) + compact->facets_count * 9 * sizeof(compact->corners[0]);
+
+	if(NULL != compact->normals)
+	{
+		size += compact->facets_count * 2 * sizeof(compact->normals[0]);
+	}
+
+	if(NULL != compact->abc)
+	{
+		size += compact->facets_count * sizeof(compact->abc[0]);
+	}
+
+	return size;
+}
+
+stl_error_t stl_to_compact(stl_t *stl, unsigned int flags, stl_compact_t **compact_new)
+{
+	stl_error_t       error = STL_SUCCESS;
+	size_t            i = 0;
+	size_t            j = 0;
+	size_t            block = 0;
+	unsigned int      k = 0;
+	int               has_abc = 0;
+	double            origin[3];
+	double            scale[3];
+	double            v[3];
+	stl_vertex_t      min;
+	stl_vertex_t      max;
+	const stl_facet_t *facets = NULL;
+	unsigned short    *corners = NULL;
+	stl_facet_t       tmp[STL_COMPACT_BLOCK];
+	stl_compact_t     *compact = NULL;
+
+	memset(&min, 0x00, sizeof(min));
+	memset(&max, 0x00, sizeof(max));
+
+	if((NULL == stl) || (NULL == compact_new))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if((STL_SUCCESS == error) && (0 != stl->facets_count))
+	{
+		error = stl_get_bounds(stl, &min, &max);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		compact = (stl_compact_t *)malloc(sizeof(*compact));
+		if(NULL == compact)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(compact, 0x00, sizeof(*compact));
+
+		memcpy(compact->header, stl->header, STL_HEADER_SIZE);
+		compact->facets_count = stl->facets_count;
+
+		compact->corners = (unsigned short *)_stl_alloc_array(stl->facets_count, 9 * sizeof(compact->corners[0]));
+		compact->abc = (unsigned short *)_stl_alloc_array(stl->facets_count, sizeof(compact->abc[0]));
+		if((NULL == compact->corners) || (NULL == compact->abc))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (0 != (flags & STL_COMPACT_NORMALS)))
+	{
+		compact->normals = (unsigned short *)_stl_alloc_array(stl->facets_count, 2 * sizeof(compact->normals[0]));
+		if(NULL == compact->normals)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		origin[0] = min.x;
+		origin[1] = min.y;
+		origin[2] = min.z;
+
+		v[0] = (double)max.x - min.x;
+		v[1] = (double)max.y - min.y;
+		v[2] = (double)max.z - min.z;
+
+		/* A flat box packs every corner to 0 on that axis */
+		for(k = 0; k < 3; k++)
+		{
+			scale[k] = (v[k] > 0.0) ? (STL_COMPACT_MAX / v[k]) : 0.0;
+
+			compact->matrix[4 * k + k] = v[k] / STL_COMPACT_MAX;
+			compact->matrix[4 * k + 3] = origin[k];
+		}
+	}
+
+	for(i = 0; (STL_SUCCESS == error) && (i < stl->facets_count); i += block)
+	{
+		block = stl->facets_count - i;
+		if(block > STL_COMPACT_BLOCK)
+		{
+			block = STL_COMPACT_BLOCK;
+		}
+
+		/* Decodes mapped facets and applies a pending transform on the way */
+		facets = _stl_get_facets(stl, i, block, tmp);
+
+		for(j = 0; (STL_SUCCESS == error) && (j < block); j++)
+		{
+			corners = &compact->corners[9 * (i + j)];
+
+			for(k = 0; k < 3; k++)
+			{
+				v[0] = facets[j].verticies[k].x;
+				v[1] = facets[j].verticies[k].y;
+				v[2] = facets[j].verticies[k].z;
+
+				/* Nowhere to put it in the box */
+				if(!stl_compact_finite(v[0]) || !stl_compact_finite(v[1]) || !stl_compact_finite(v[2]))
+				{
+					error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+					break;
+				}
+
+				corners[3 * k + 0] = stl_compact_quantize((v[0] - origin[0]) * scale[0]);
+				corners[3 * k + 1] = stl_compact_quantize((v[1] - origin[1]) * scale[1]);
+				corners[3 * k + 2] = stl_compact_quantize((v[2] - origin[2]) * scale[2]);
+			}
+
+			if(NULL != compact->normals)
+			{
+				v[0] = facets[j].normal.x;
+				v[1] = facets[j].normal.y;
+				v[2] = facets[j].normal.z;
+
+				stl_compact_encode_normal(v, &compact->normals[2 * (i + j)]);
+			}
+
+			compact->abc[i + j] = facets[j].abc;
+			has_abc |= (0 != facets[j].abc);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if(!has_abc)
+		{
+			free(compact->abc);
+			compact->abc = NULL;
+		}
+
+		*compact_new = compact;
+		compact = NULL;
+	}
+
+	stl_compact_free(compact);
+
+	return STL_LOG_ERR(error);
+}
+
+void _stl_compact_get_facets(const stl_compact_t *compact, size_t first, size_t count, int normals, stl_facet_t *facets)
+{
+	size_t               i = 0;
+	unsigned int         k = 0;
+	double               n[3];
+	const double         *m = compact->matrix;
+	const unsigned short *q = NULL;
+
+	for(i = 0; i < count; i++)
+	{
+		q = &compact->corners[9 * (first + i)];
+
+		for(k = 0; k < 3; k++, q += 3)
+		{
+			facets[i].verticies[k].x = (float)(m[0] * q[0] + m[1] * q[1] + m[2] * q[2] + m[3]);
+			facets[i].verticies[k].y = (float)(m[4] * q[0] + m[5] * q[1] + m[6] * q[2] + m[7]);
+			facets[i].verticies[k].z = (float)(m[8] * q[0] + m[9] * q[1] + m[10] * q[2] + m[11]);
+		}
+
+		if(NULL != compact->normals)
+		{
+			stl_compact_decode_normal(&compact->normals[2 * (first + i)], n);
+
+			facets[i].normal.x = (float)n[0];
+			facets[i].normal.y = (float)n[1];
+			facets[i].normal.z = (float)n[2];
+		}
+		else
+		{
+			memset(&facets[i].normal, 0x00, sizeof(facets[i].normal));
+		}
+
+		facets[i].abc = (NULL != compact->abc) ? compact->abc[first + i] : 0;
+	}
+
+	if((NULL == compact->normals) && normals)
+	{
+		_stl_normals_facets(facets, count);
+	}
+}
+
+stl_error_t stl_from_compact(stl_compact_t *compact, stl_t **stl_out)
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_t       *stl = NULL;
+
+	if((NULL == compact) || (NULL == stl_out))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_new(&stl, compact->facets_count);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memcpy(stl->header, compact->header, STL_HEADER_SIZE);
+		_stl_compact_get_facets(compact, 0, compact->facets_count, 1, stl->facets);
+
+		*stl_out = stl;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_compact_transform(const double m[16], stl_compact_t *compact)
+{
+	stl_error_t    error = STL_SUCCESS;
+	size_t         i = 0;
+	unsigned int   r = 0;
+	unsigned int   c = 0;
+	unsigned int   k = 0;
+	double         matrix[12];
+	double         n[3];
+	double         p[3];
+	unsigned short tmp[3];
+	unsigned short *corners = NULL;
+	_stl_xform_t   xform;
+
+	if((NULL == m) || (NULL == compact))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_xform_prepare(m, &xform);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		/* xform.m after the matrix already there */
+		for(r = 0; r < 3; r++)
+		{
+			for(c = 0; c < 4; c++)
+			{
+				matrix[4 * r + c] = (3 == c) ? xform.m[4 * r + 3] : 0.0;
+
+				for(k = 0; k < 3; k++)
+				{
+					matrix[4 * r + c] += xform.m[4 * r + k] * compact->matrix[4 * k + c];
+				}
+			}
+		}
+
+		memcpy(compact->matrix, matrix, sizeof(matrix));
+
+		/* Packing only keeps the direction, so there's no need to bring
+		 * them back to unit length first
+		 */
+		for(i = 0; (NULL != compact->normals) && (i < compact->facets_count); i++)
+		{
+			stl_compact_decode_normal(&compact->normals[2 * i], n);
+
+			p[0] = xform.n[0] * n[0] + xform.n[1] * n[1] + xform.n[2] * n[2];
+			p[1] = xform.n[3] * n[0] + xform.n[4] * n[1] + xform.n[5] * n[2];
+			p[2] = xform.n[6] * n[0] + xform.n[7] * n[1] + xform.n[8] * n[2];
+
+			stl_compact_encode_normal(p, &compact->normals[2 * i]);
+		}
+
+		/* Mirrored, swap the second and third corners to keep the winding */
+		for(i = 0; xform.flip && (i < compact->facets_count); i++)
+		{
+			corners = &compact->corners[9 * i];
+
+			memcpy(tmp, &corners[3], sizeof(tmp));
+			memcpy(&corners[3], &corners[6], sizeof(tmp));
+			memcpy(&corners[6], tmp, sizeof(tmp));
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
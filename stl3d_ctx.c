@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Contexts own a pool of worker threads that stay around between calls.
+ * A job is a range of items cut into chunks. Each thread starts with its
+ * own share of the chunks and works through them from the front; once it
+ * runs out it steals from the back of the others' shares, so a thread that
+ * gets held up doesn't hold up the whole job.
+ *
+ * Which thread does which chunk changes from run to run, so jobs must give
+ * the same result whatever order the chunks are done in (anything that
+ * combines results does it per chunk, in chunk order, afterwards).
+ */
+
+/* The chunks one thread has left, [next, end) */
+typedef struct
+{
+	size_t          next;
+	size_t          end;
+#ifndef _WIN32
+	pthread_mutex_t lock;
+#endif
+} stl_ctx_share_t;
+
+struct stl_ctx_s
+{
+	/* Including the calling thread */
+	unsigned int     threads;
+	stl_ctx_share_t  *shares;
+
+	/* The job being run */
+	_stl_chunk_fn_t  fn;
+	void             *arg;
+	size_t           count;
+	size_t           chunk;
+
+#ifndef _WIN32
+	pthread_t        *workers;
+
+	/* Only one job at a time */
+	pthread_mutex_t  run_lock;
+
+	/* Protects the fields below */
+	pthread_mutex_t  lock;
+	pthread_cond_t   start_cond;
+	pthread_cond_t   done_cond;
+	unsigned long    generation;
+	unsigned int     working;
+	int              shutdown;
+#endif
+};
+
+typedef struct
+{
+	stl_ctx_t    *ctx;
+	unsigned int index;
+} stl_ctx_worker_arg_t;
+
+
+/* Take the next chunk for thread self, from its own share if there's any
+ * left, otherwise from the end of someone else's. Returns 0 when every
+ * chunk has been taken.
+ */
+static int stl_ctx_take(stl_ctx_t *ctx, unsigned int self, size_t *chunk_index)
+{
+	unsigned int    i = 0;
+	int             found = 0;
+	stl_ctx_share_t *share = NULL;
+
+	for(i = 0; (i < ctx->threads) && !found; i++)
+	{
+		share = &ctx->shares[(self + i) % ctx->threads];
+
+#ifndef _WIN32
+		pthread_mutex_lock(&share->lock);
+#endif
+		if(share->next < share->end)
+		{
+			if(0 == i)
+			{
+				*chunk_index = share->next++;
+			}
+			else
+			{
+				*chunk_index = --share->end;
+			}
+
+			found = 1;
+		}
+#ifndef _WIN32
+		pthread_mutex_unlock(&share->lock);
+#endif
+	}
+
+	return found;
+}
+
+static void stl_ctx_work(stl_ctx_t *ctx, unsigned int self)
+{
+	size_t chunk_index = 0;
+	size_t first = 0;
+	size_t count = 0;
+
+	while(stl_ctx_take(ctx, self, &chunk_index))
+	{
+		first = chunk_index * ctx->chunk;
+		count = ctx->count - first;
+		if(count > ctx->chunk)
+		{
+			count = ctx->chunk;
+		}
+
+		ctx->fn(chunk_index, first, count, ctx->arg);
+	}
+}
+
+#ifndef _WIN32
+static void *stl_ctx_worker(void *arg)
+{
+	stl_ctx_worker_arg_t *warg = (stl_ctx_worker_arg_t *)arg;
+	stl_ctx_t            *ctx = warg->ctx;
+	unsigned int         index = warg->index;
+	unsigned long        seen = 0;
+
+	free(warg);
+
+	pthread_mutex_lock(&ctx->lock);
+
+	for(;;)
+	{
+		while(!ctx->shutdown && (ctx->generation == seen))
+		{
+			pthread_cond_wait(&ctx->start_cond, &ctx->lock);
+		}
+
+		if(ctx->shutdown)
+		{
+			break;
+		}
+
+		seen = ctx->generation;
+		pthread_mutex_unlock(&ctx->lock);
+
+		stl_ctx_work(ctx, index);
+
+		pthread_mutex_lock(&ctx->lock);
+
+		ctx->working--;
+		if(0 == ctx->working)
+		{
+			pthread_cond_signal(&ctx->done_cond);
+		}
+	}
+
+	pthread_mutex_unlock(&ctx->lock);
+
+	return NULL;
+}
+#endif
+
+stl_error_t stl_ctx_new(stl_ctx_t **ctx_new, unsigned int threads)
+{
+	stl_error_t          error = STL_SUCCESS;
+	unsigned int         i = 0;
+	stl_ctx_t            *ctx = NULL;
+#ifndef _WIN32
+	stl_ctx_worker_arg_t *warg = NULL;
+#endif
+
+	if(NULL == ctx_new)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(0 == threads)
+	{
+		threads = _stl_cpu_count();
+	}
+
+#ifdef _WIN32
+	/* No threads here, everything runs on the caller */
+	threads = 1;
+#endif
+
+	if(STL_SUCCESS == error)
+	{
+		ctx = (stl_ctx_t *)malloc(sizeof(*ctx));
+		if(NULL == ctx)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(ctx, 0x00, sizeof(*ctx));
+
+		ctx->shares = (stl_ctx_share_t *)_stl_alloc_array(threads, sizeof(ctx->shares[0]));
+		if(NULL == ctx->shares)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+#ifndef _WIN32
+	if(STL_SUCCESS == error)
+	{
+		ctx->workers = (pthread_t *)_stl_alloc_array(threads, sizeof(ctx->workers[0]));
+		if(NULL == ctx->workers)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+#endif
+
+	if(STL_SUCCESS == error)
+	{
+		memset(ctx->shares, 0x00, threads * sizeof(ctx->shares[0]));
+
+#ifndef _WIN32
+		for(i = 0; i < threads; i++)
+		{
+			pthread_mutex_init(&ctx->shares[i].lock, NULL);
+		}
+
+		pthread_mutex_init(&ctx->run_lock, NULL);
+		pthread_mutex_init(&ctx->lock, NULL);
+		pthread_cond_init(&ctx->start_cond, NULL);
+		pthread_cond_init(&ctx->done_cond, NULL);
+
+		/* Thread 0 is whoever calls in with a job. If the system won't give
+		 * us all the threads asked for, make do with the ones we got.
+		 */
+		ctx->threads = 1;
+
+		for(i = 1; i < threads; i++)
+		{
+			warg = (stl_ctx_worker_arg_t *)malloc(sizeof(*warg));
+			if(NULL == warg)
+			{
+				break;
+			}
+
+			warg->ctx = ctx;
+			warg->index = i;
+
+			if(0 != pthread_create(&ctx->workers[i], NULL, stl_ctx_worker, warg))
+			{
+				free(warg);
+				break;
+			}
+
+			ctx->threads++;
+		}
+#else
+		ctx->threads = threads;
+#endif
+
+		*ctx_new = ctx;
+		ctx = NULL;
+	}
+
+	/* Only still set if something failed before any threads were started */
+	if(NULL != ctx)
+	{
+#ifndef _WIN32
+		free(ctx->workers);
+#endif
+		free(ctx->shares);
+		free(ctx);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+void stl_ctx_free(stl_ctx_t *ctx)
+{
+	unsigned int i = 0;
+
+	if(NULL == ctx)
+	{
+		return;
+	}
+
+#ifndef _WIN32
+	pthread_mutex_lock(&ctx->lock);
+	ctx->shutdown = 1;
+	pthread_cond_broadcast(&ctx->start_cond);
+	pthread_mutex_unlock(&ctx->lock);
+
+	for(i = 1; i < ctx->threads; i++)
+	{
+		pthread_join(ctx->workers[i], NULL);
+	}
+
+	for(i = 0; i < ctx->threads; i++)
+	{
+		pthread_mutex_destroy(&ctx->shares[i].lock);
+	}
+
+	pthread_cond_destroy(&ctx->done_cond);
+	pthread_cond_destroy(&ctx->start_cond);
+	pthread_mutex_destroy(&ctx->lock);
+	pthread_mutex_destroy(&ctx->run_lock);
+
+	free(ctx->workers);
+#else
+	(void)i;
+#endif
+
+	free(ctx->shares);
+	free(ctx);
+}
+
+unsigned int stl_ctx_threads(stl_ctx_t *ctx)
+{
+	return (NULL == ctx) ? 1 : ctx->threads;
+}
+
+size_t _stl_chunk_count(size_t count, size_t chunk)
+{
+	return (count / chunk) + ((0 != (count % chunk)) ? 1 : 0);
+}
+
+stl_ctx_t *_stl_ctx_temp(size_t count)
+{
+	stl_ctx_t *ctx = NULL;
+
+	if((count > STL_CTX_CHUNK_FACETS) && (_stl_cpu_count() > 1))
+	{
+		if(STL_SUCCESS != stl_ctx_new(&ctx, 0))
+		{
+			ctx = NULL;
+		}
+	}
+
+	return ctx;
+}
+
+void _stl_ctx_run(stl_ctx_t *ctx, size_t count, size_t chunk, _stl_chunk_fn_t fn, void *arg)
+{
+	size_t       chunks = _stl_chunk_count(count, chunk);
+	size_t       i = 0;
+	size_t       first = 0;
+	unsigned int t = 0;
+
+	/* Nothing to share out, don't bother waking anyone */
+	if((NULL == ctx) || (ctx->threads < 2) || (chunks < 2))
+	{
+		for(i = 0; i < chunks; i++)
+		{
+			first = i * chunk;
+			fn(i, first, ((count - first) > chunk) ? chunk : (count - first), arg);
+		}
+
+		return;
+	}
+
+#ifndef _WIN32
+	pthread_mutex_lock(&ctx->run_lock);
+
+	ctx->fn = fn;
+	ctx->arg = arg;
+	ctx->count = count;
+	ctx->chunk = chunk;
+
+	/* Everyone starts with a run of neighbouring chunks */
+	for(t = 0; t < ctx->threads; t++)
+	{
+		pthread_mutex_lock(&ctx->shares[t].lock);
+		ctx->shares[t].next = (chunks * t) / ctx->threads;
+		ctx->shares[t].end = (chunks * (t + 1)) / ctx->threads;
+		pthread_mutex_unlock(&ctx->shares[t].lock);
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->working = ctx->threads - 1;
+	ctx->generation++;
+	pthread_cond_broadcast(&ctx->start_cond);
+	pthread_mutex_unlock(&ctx->lock);
+
+	stl_ctx_work(ctx, 0);
+
+	pthread_mutex_lock(&ctx->lock);
+	while(0 != ctx->working)
+	{
+		pthread_cond_wait(&ctx->done_cond, &ctx->lock);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	pthread_mutex_unlock(&ctx->run_lock);
+#else
+	(void)t;
+#endif
+}
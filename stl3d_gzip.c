@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifndef STL_NO_ZLIB
+#include <zlib.h>
+#endif
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Reading and writing gzip compressed STL files. Build with STL_NO_ZLIB
+ * defined where zlib isn't available, in which case compressed files are
+ * reported as unsupported.
+ */
+
+/* Number of facets compressed into each gzip member when writing. Every
+ * member is compressed on its own, so the blocks can be done in parallel
+ * and the members just concatenated; gzip readers treat the result as one
+ * stream.
+ */
+#define STL_GZIP_BLOCK_FACETS 65536
+
+/* Size of zlib's internal buffer when reading */
+#define STL_GZIP_READ_BUFFER  (256 * 1024)
+
+
+int _stl_is_gzip(const unsigned char *start, size_t len)
+{
+	return (len >= 2) && (0x1f == start[0]) && (0x8b == start[1]);
+}
+
+int _stl_has_gzip_suffix(const char *filename)
+{
+	size_t len = strlen(filename);
+
+	return (len >= 3) &&
+		('.' == filename[len - 3]) &&
+		('g' == tolower((unsigned char)filename[len - 2])) &&
+		('z' == tolower((unsigned char)filename[len - 1]));
+}
+
+#ifndef STL_NO_ZLIB
+/* Read exactly len bytes, gzread() can return short counts */
+static stl_error_t stl_gzread_all(gzFile gz, void *buffer, size_t len)
+{
+	int res = 0;
+
+	while(len > 0)
+	{
+		res = gzread(gz, buffer, (unsigned int)len);
+		if(res <= 0)
+		{
+			return STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		buffer = (unsigned char *)buffer + res;
+		len -= (size_t)res;
+	}
+
+	return STL_SUCCESS;
+}
+
+/* An ASCII file has to be parsed in one piece, so it is inflated into memory
+ * first. The bytes already read are passed in as start.
+ */
+static stl_error_t stl_gzread_ascii(gzFile gz, const unsigned char *start, size_t len, stl_t **stl_new)
+{
+	stl_error_t error = STL_SUCCESS;
+	int         res = 0;
+	size_t      size = len;
+	size_t      capacity = 1024 * 1024;
+	char        *data = NULL;
+	char        *tmp = NULL;
+
+	data = (char *)malloc(capacity);
+	if(NULL == data)
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memcpy(data, start, len);
+
+		do
+		{
+			if(capacity - size < STL_GZIP_READ_BUFFER)
+			{
+				capacity *= 2;
+				tmp = (char *)realloc(data, capacity);
+				if(NULL == tmp)
+				{
+					error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+					break;
+				}
+
+				data = tmp;
+			}
+
+			res = gzread(gz, data + size, STL_GZIP_READ_BUFFER);
+			if(res < 0)
+			{
+				error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+				break;
+			}
+
+			size += (size_t)res;
+		} while(res > 0);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_parse_ascii(data, size, stl_new);
+	}
+
+	free(data);
+
+	return STL_LOG_ERR(error);
+}
+#endif
+
+stl_error_t _stl_read_gzip_file(const char *input_file, stl_t **stl_new)
+{
+#ifndef STL_NO_ZLIB
+	stl_error_t   error = STL_SUCCESS;
+	gzFile        gz = NULL;
+	int           res = 0;
+	size_t        i = 0;
+	size_t        chunk = 0;
+	unsigned char bytes[STL_FACETS_OFFSET];
+	unsigned char *buffer = NULL;
+	stl_t         *stl = NULL;
+
+	if((NULL == input_file) || (NULL == stl_new))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	gz = gzopen(input_file, "rb");
+	if(NULL == gz)
+	{
+		error = STL_LOG_ERR(STL_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		gzbuffer(gz, STL_GZIP_READ_BUFFER);
+
+		res = gzread(gz, bytes, sizeof(bytes));
+		if(res < 0)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	/* The uncompressed size isn't known, so this goes on the header alone */
+	if((STL_SUCCESS == error) && _stl_looks_ascii(bytes, (size_t)res, 0))
+	{
+		error = stl_gzread_ascii(gz, bytes, (size_t)res, stl_new);
+		gzclose(gz);
+
+		return STL_LOG_ERR(error);
+	}
+
+	if((STL_SUCCESS == error) && ((int)sizeof(bytes) != res))
+	{
+		error = STL_LOG_ERR(STL_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		stl = (stl_t *)malloc(sizeof(*stl));
+		if(NULL == stl)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(stl, 0x00, sizeof(*stl));
+
+		memcpy(stl->header, bytes, STL_HEADER_SIZE);
+		stl->facets_count = _stl_pack_le32(bytes + STL_HEADER_SIZE);
+
+		stl->facets = (stl_facet_t *)_stl_alloc_array(stl->facets_count, sizeof(stl_facet_t));
+		buffer = (unsigned char *)malloc(STL_READ_CHUNK_FACETS * STL_FACET_SIZE);
+		if((NULL == stl->facets) || (NULL == buffer))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		for(i = 0; i < stl->facets_count; i += chunk)
+		{
+			chunk = stl->facets_count - i;
+			if(chunk > STL_READ_CHUNK_FACETS)
+			{
+				chunk = STL_READ_CHUNK_FACETS;
+			}
+
+			error = stl_gzread_all(gz, buffer, chunk * STL_FACET_SIZE);
+			if(STL_SUCCESS != error)
+			{
+				break;
+			}
+
+			_stl_decode_facets(buffer, &(stl->facets[i]), chunk);
+		}
+	}
+
+	if(NULL != gz)
+	{
+		gzclose(gz);
+		gz = NULL;
+	}
+
+	free(buffer);
+
+	if(STL_SUCCESS != error)
+	{
+		stl_free(stl);
+		stl = NULL;
+	}
+	else
+	{
+		*stl_new = stl;
+	}
+
+	return STL_LOG_ERR(error);
+#else
+	(void)input_file;
+	(void)stl_new;
+
+	fprintf(stderr, "Error: Built without zlib, can't read compressed STL files\n");
+
+	return STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+#endif
+}
+
+#ifndef STL_NO_ZLIB
+/* One block being compressed by a thread. The buffers are kept from one
+ * round to the next.
+ */
+typedef struct
+{
+	unsigned char *raw;
+	stl_facet_t   *scratch;
+	unsigned char *out;
+	size_t        out_size;
+	size_t        out_len;
+	stl_error_t   error;
+} stl_gzip_block_t;
+
+typedef struct
+{
+	const stl_t      *stl;
+	unsigned char    header[STL_FACETS_OFFSET];
+	size_t           first;
+	stl_gzip_block_t *blocks;
+} stl_gzip_job_t;
+
+/* Compress block index of the current round into its own gzip member
+ */
+static void stl_gzip_block(unsigned int index, void *arg)
+{
+	stl_gzip_job_t      *job = (stl_gzip_job_t *)arg;
+	stl_gzip_block_t    *block = &job->blocks[index];
+	const stl_t         *stl = job->stl;
+	size_t              start = job->first + ((size_t)index * STL_GZIP_BLOCK_FACETS);
+	size_t              count = 0;
+	size_t              len = 0;
+	size_t              bound = 0;
+	const unsigned char *data = NULL;
+	unsigned char       *tmp = NULL;
+	z_stream            zs;
+
+	block->out_len = 0;
+	block->error = STL_SUCCESS;
+
+	/* Past the end, unless it's the first block which always carries the
+	 * header
+	 */
+	if((start >= stl->facets_count) && (0 != start))
+	{
+		return;
+	}
+
+	count = stl->facets_count - start;
+	if(count > STL_GZIP_BLOCK_FACETS)
+	{
+		count = STL_GZIP_BLOCK_FACETS;
+	}
+
+	len = count * STL_FACET_SIZE;
+
+	/* Mapped facets are already in file format, unless there's a transform
+	 * still to apply
+	 */
+	if((NULL != stl->mapped_facets) && (NULL == stl->pending))
+	{
+		data = stl->mapped_facets + (start * STL_FACET_SIZE);
+	}
+	else
+	{
+		_stl_encode_facets(_stl_get_facets(stl, start, count, block->scratch), count, block->raw);
+		data = block->raw;
+	}
+
+	memset(&zs, 0x00, sizeof(zs));
+
+	/* 16 + MAX_WBITS asks for a gzip wrapper rather than a zlib one */
+	if(Z_OK != deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY))
+	{
+		block->error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		return;
+	}
+
+	bound = deflateBound(&zs, (uLong)(len + ((0 == start) ? STL_FACETS_OFFSET : 0)));
+	if(bound > block->out_size)
+	{
+		tmp = (unsigned char *)realloc(block->out, bound);
+		if(NULL == tmp)
+		{
+			deflateEnd(&zs);
+			block->error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+			return;
+		}
+
+		block->out = tmp;
+		block->out_size = bound;
+	}
+
+	zs.next_out = block->out;
+	zs.avail_out = (uInt)block->out_size;
+
+	if(0 == start)
+	{
+		zs.next_in = (Bytef *)job->header;
+		zs.avail_in = sizeof(job->header);
+		deflate(&zs, Z_NO_FLUSH);
+	}
+
+	zs.next_in = (Bytef *)data;
+	zs.avail_in = (uInt)len;
+
+	/* The output buffer is big enough for everything, so this finishes in
+	 * one call
+	 */
+	if(Z_STREAM_END != deflate(&zs, Z_FINISH))
+	{
+		block->error = STL_LOG_ERR(STL_ERROR);
+	}
+
+	block->out_len = block->out_size - zs.avail_out;
+
+	deflateEnd(&zs);
+}
+#endif
+
+stl_error_t _stl_write_gzip_file(const char *output_file, stl_t *stl)
+{
+#ifndef STL_NO_ZLIB
+	stl_error_t    error = STL_SUCCESS;
+	unsigned int   i = 0;
+	unsigned int   threads = 0;
+	size_t         blocks = 0;
+	size_t         res = 0;
+	FILE           *fp = NULL;
+	stl_gzip_job_t job;
+
+	if((NULL == output_file) || (NULL == stl))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	memset(&job, 0x00, sizeof(job));
+	job.stl = stl;
+
+	/* One thread per block, up to one per CPU */
+	blocks = (stl->facets_count + STL_GZIP_BLOCK_FACETS - 1) / STL_GZIP_BLOCK_FACETS;
+	threads = _stl_cpu_count();
+	if(threads > blocks)
+	{
+		threads = (0 == blocks) ? 1 : (unsigned int)blocks;
+	}
+
+	job.blocks = (stl_gzip_block_t *)calloc(threads, sizeof(job.blocks[0]));
+	if(NULL == job.blocks)
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+	for(i = 0; (STL_SUCCESS == error) && (i < threads) && ((NULL == stl->mapped_facets) || (NULL != stl->pending)); i++)
+	{
+		job.blocks[i].raw = (unsigned char *)malloc(STL_GZIP_BLOCK_FACETS * STL_FACET_SIZE);
+		if(NULL == job.blocks[i].raw)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	/* Somewhere to apply a pending transform */
+	for(i = 0; (STL_SUCCESS == error) && (i < threads) && (NULL != stl->pending); i++)
+	{
+		job.blocks[i].scratch = (stl_facet_t *)malloc(STL_GZIP_BLOCK_FACETS * sizeof(stl_facet_t));
+		if(NULL == job.blocks[i].scratch)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memcpy(job.header, stl->header, STL_HEADER_SIZE);
+		error = _stl_unpack_le32((unsigned int)stl->facets_count, job.header + STL_HEADER_SIZE);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_create_file(output_file, &fp);
+	}
+
+	/* Each round compresses one block per thread, then the members are
+	 * written out in order
+	 */
+	while(STL_SUCCESS == error)
+	{
+		error = _stl_run_threads(threads, stl_gzip_block, &job);
+
+		for(i = 0; (STL_SUCCESS == error) && (i < threads); i++)
+		{
+			error = job.blocks[i].error;
+
+			if((STL_SUCCESS == error) && (job.blocks[i].out_len > 0))
+			{
+				res = fwrite(job.blocks[i].out, 1, job.blocks[i].out_len, fp);
+				if(job.blocks[i].out_len != res)
+				{
+					error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+				}
+			}
+		}
+
+		job.first += (size_t)threads * STL_GZIP_BLOCK_FACETS;
+		if(job.first >= stl->facets_count)
+		{
+			break;
+		}
+	}
+
+	if(NULL != fp)
+	{
+		if((0 != fclose(fp)) && (STL_SUCCESS == error))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		fp = NULL;
+	}
+
+	for(i = 0; (NULL != job.blocks) && (i < threads); i++)
+	{
+		free(job.blocks[i].raw);
+		free(job.blocks[i].scratch);
+		free(job.blocks[i].out);
+	}
+
+	free(job.blocks);
+
+	return STL_LOG_ERR(error);
+#else
+	(void)output_file;
+	(void)stl;
+
+	fprintf(stderr, "Error: Built without zlib, can't write compressed STL files\n");
+
+	return STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+#endif
+}
@@ -4,6 +4,7 @@
 #include <math.h>
 
 #include "stl3d_lib.h"
+#include "stl3d_internal.h"
 
 #define _GEN_SMALLER_BOTTOM_MESH
 
@@ -11,8 +12,8 @@ stl_error_t
 stl_from_heightmap_uchar_file(
 	char *filename,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
@@ -20,11 +21,12 @@ stl_from_heightmap_uchar_file(
 	)
 {
 	stl_error_t   error = STL_SUCCESS;
-	int           res = 0;
+	size_t        res = 0;
+	size_t        cells = 0;
 	FILE          *fp = NULL;
 	unsigned char *vals = NULL;
 
-	if(NULL == filename)
+	if((NULL == filename) || !_stl_size_mul(cols, rows, &cells))
 	{
 		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
 	}
@@ -40,7 +42,7 @@ stl_from_heightmap_uchar_file(
 
 	if(STL_SUCCESS == error)
 	{
-		vals = (unsigned char *)malloc(cols * rows * sizeof(vals[0]));
+		vals = (unsigned char *)_stl_alloc_array(cells, sizeof(vals[0]));
 		if(NULL == vals)
 		{
 			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
@@ -49,9 +51,9 @@ stl_from_heightmap_uchar_file(
 
 	if(STL_SUCCESS == error)
 	{
-		res = fread(vals, 1, cols * rows * sizeof(vals[0]), fp);
+		res = fread(vals, sizeof(vals[0]), cells, fp);
 
-		if(res != cols * rows * sizeof(vals[0]))
+		if(res != cells)
 		{
 			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
 		}
@@ -81,8 +83,8 @@ stl_error_t
 stl_from_heightmap_uchar(
 	const unsigned char *vals,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
@@ -90,23 +92,27 @@ stl_from_heightmap_uchar(
 	)
 {
 	stl_error_t  error = STL_SUCCESS;
-	unsigned int i = 0;
+	size_t       i = 0;
+	size_t       cells = 0;
 	double       *vals_double = NULL;
 
-	if((NULL == vals) || (0 == cols) || (0 == rows))
+	if((NULL == vals) || (0 == cols) || (0 == rows) || !_stl_size_mul(cols, rows, &cells))
 	{
 		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
 	}
 
-	vals_double = (double *)malloc(cols * rows * sizeof(vals_double[0]));
-	if(NULL == vals_double)
+	if(STL_SUCCESS == error)
 	{
-		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		vals_double = (double *)_stl_alloc_array(cells, sizeof(vals_double[0]));
+		if(NULL == vals_double)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		for(i = 0; i < cols * rows; i++)
+		for(i = 0; i < cells; i++)
 		{
 			vals_double[i] = vals[i];
 		}
@@ -127,8 +133,8 @@ stl_error_t
 stl_from_heightmap_char(
 	const signed char *vals,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
@@ -136,23 +142,27 @@ stl_from_heightmap_char(
 	)
 {
 	stl_error_t  error = STL_SUCCESS;
-	unsigned int i = 0;
+	size_t       i = 0;
+	size_t       cells = 0;
 	double       *vals_double = NULL;
 
-	if((NULL == vals) || (0 == cols) || (0 == rows))
+	if((NULL == vals) || (0 == cols) || (0 == rows) || !_stl_size_mul(cols, rows, &cells))
 	{
 		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
 	}
 
-	vals_double = (double *)malloc(cols * rows * sizeof(vals_double[0]));
-	if(NULL == vals_double)
+	if(STL_SUCCESS == error)
 	{
-		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		vals_double = (double *)_stl_alloc_array(cells, sizeof(vals_double[0]));
+		if(NULL == vals_double)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		for(i = 0; i < cols * rows; i++)
+		for(i = 0; i < cells; i++)
 		{
 			vals_double[i] = vals[i];
 		}
@@ -169,45 +179,109 @@ stl_from_heightmap_char(
 	return STL_LOG_ERR(error);
 }
 
-/* Make an STL object from an array of double values
+/* Where stl_hmap_generate() puts the facets it makes. With a writer they are
+ * streamed straight to the file, otherwise a new STL object is created to
+ * hold them.
  */
-stl_error_t
-stl_from_heightmap_double(
+typedef struct
+{
+	stl_writer_t *writer;
+	stl_t        *stl;
+	size_t       next;
+	stl_error_t  error;
+} stl_hmap_out_t;
+
+/* Hand over the two triangles just generated
+ */
+static void stl_hmap_emit(stl_hmap_out_t *out, stl_facet_t *tri)
+{
+	if(STL_SUCCESS != out->error)
+	{
+		return;
+	}
+
+	if(NULL != out->writer)
+	{
+		/* These are gone once written, so they get their normals now */
+		_stl_normals_facets(tri, 2);
+
+		out->error = stl_writer_append(out->writer, tri, 2);
+	}
+	else
+	{
+		memcpy(&out->stl->facets[out->next], tri, 2 * sizeof(tri[0]));
+		out->next += 2;
+
+		/* Cheap while the corners are at hand, saves a scan later */
+		_stl_bounds_add(out->stl, tri, 2);
+	}
+}
+
+/* The checks stl_hmap_generate() makes before it starts, so that a file
+ * isn't created for a heightmap that can't be made
+ */
+static stl_error_t stl_hmap_check_args(const double *vals, size_t cols, size_t rows, double scale_pct, double units_per_pixel)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      cells = 0;
+
+	if((NULL == vals) || (cols < 2) || (rows < 2) || (scale_pct <= 0.0) || (units_per_pixel <= 0.0))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* There are fewer than 4 facets per cell, so checking this up front
+	 * keeps the facet count below from wrapping
+	 */
+	if((STL_SUCCESS == error) && (!_stl_size_mul(cols, rows, &cells) || (cells > ((size_t)-1) / 4)))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+static stl_error_t
+stl_hmap_generate(
 	const double *vals,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
-	stl_t **newstl
+	stl_hmap_out_t *out
 	)
 {
 	stl_error_t  error = STL_SUCCESS;
-	unsigned int fascet_count = 0;
-	unsigned int i = 0;
-	unsigned int c = 0;
-	unsigned int r = 0;
-	unsigned int f = 0;
+	size_t       fascet_count = 0;
+	size_t       i = 0;
+	size_t       c = 0;
+	size_t       r = 0;
 	double       min_z = 0.0;
 	double       min_z_scaled = 0.0;
 	double const **hmap = NULL;
 	const double *tmp = NULL;
-	stl_t        *stl = NULL;
+	stl_facet_t  tri[2];
 #ifdef _GEN_SMALLER_BOTTOM_MESH
 	double       center_x = 0.0;
 	double       center_y = 0.0;
 #endif
 
-	if((NULL == vals) || (cols < 2) || (rows < 2) || (scale_pct <= 0.0) || (units_per_pixel <= 0.0) || (NULL == newstl))
+	if(NULL == out)
 	{
 		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
 	}
 
+	if(STL_SUCCESS == error)
+	{
+		error = stl_hmap_check_args(vals, cols, rows, scale_pct, units_per_pixel);
+	}
+
 	/* Create the array used for the 2d array representation */
 	if(STL_SUCCESS == error)
 	{
-		hmap = (double const **)malloc(rows * sizeof(hmap[0]));
+		hmap = (double const **)_stl_alloc_array(rows, sizeof(hmap[0]));
 		if(NULL == hmap)
 		{
 			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
@@ -241,8 +315,8 @@ stl_from_heightmap_double(
 	if(STL_SUCCESS == error)
 	{
 #if 0
-		unsigned int count1 = 0;
-		unsigned int count2 = 0;
+		size_t       count1 = 0;
+		size_t       count2 = 0;
 #endif
 
 		/* Calculate how many fascents we will need for this STL file
@@ -283,7 +357,11 @@ stl_from_heightmap_double(
 		/* This many for the right side */
 		fascet_count += (rows - 1) * 2;
 
-		error = stl_new(&stl, fascet_count);
+		/* Streamed output doesn't need to know the count up front */
+		if(NULL == out->writer)
+		{
+			error = stl_new(&out->stl, fascet_count);
+		}
 	}
 
 	/*  1    2    3    4    5
@@ -310,7 +388,7 @@ stl_from_heightmap_double(
 
 		min_z_scaled = min_z * (scale_pct / 100.0);
 
-		f = 0;
+		memset(tri, 0x00, sizeof(tri));
 
 		/* Generate the top mesh */
 		for(r = 0; r < rows - 1; r++)
@@ -320,42 +398,38 @@ stl_from_heightmap_double(
 				/* Triangle 1
 				 */
 				/* point 1 */
-				stl->facets[f].verticies[0].x = (float)(c * units_per_pixel);
-				stl->facets[f].verticies[0].y = (float)(r * units_per_pixel);
-				stl->facets[f].verticies[0].z = (float)((hmap[r][c] * (scale_pct / 100.0)) + base_height);
+				tri[0].verticies[0].x = (float)(c * units_per_pixel);
+				tri[0].verticies[0].y = (float)(r * units_per_pixel);
+				tri[0].verticies[0].z = (float)((hmap[r][c] * (scale_pct / 100.0)) + base_height);
 
 				/* point 2 */
-				stl->facets[f].verticies[1].x = (float)((c + 1) * units_per_pixel);
-				stl->facets[f].verticies[1].y = (float)(r * units_per_pixel);
-				stl->facets[f].verticies[1].z = (float)((hmap[r][c + 1] * (scale_pct / 100.0)) + base_height);
+				tri[0].verticies[1].x = (float)((c + 1) * units_per_pixel);
+				tri[0].verticies[1].y = (float)(r * units_per_pixel);
+				tri[0].verticies[1].z = (float)((hmap[r][c + 1] * (scale_pct / 100.0)) + base_height);
 
 				/* point 6 */
-				stl->facets[f].verticies[2].x = (float)(c * units_per_pixel);
-				stl->facets[f].verticies[2].y = (float)((r + 1) * units_per_pixel);
-				stl->facets[f].verticies[2].z = (float)((hmap[r + 1][c] * (scale_pct / 100.0)) + base_height);
-
-				stl_gen_normal_vector(stl->facets[f].verticies, &stl->facets[f].normal);
+				tri[0].verticies[2].x = (float)(c * units_per_pixel);
+				tri[0].verticies[2].y = (float)((r + 1) * units_per_pixel);
+				tri[0].verticies[2].z = (float)((hmap[r + 1][c] * (scale_pct / 100.0)) + base_height);
 
 				/* Triangle 2
 				 */
 				/* point 2 */
-				stl->facets[f+1].verticies[0].x = (float)((c + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[0].y = (float)(r * units_per_pixel);
-				stl->facets[f+1].verticies[0].z = (float)((hmap[r][c + 1] * (scale_pct / 100.0)) + base_height);
+				tri[1].verticies[0].x = (float)((c + 1) * units_per_pixel);
+				tri[1].verticies[0].y = (float)(r * units_per_pixel);
+				tri[1].verticies[0].z = (float)((hmap[r][c + 1] * (scale_pct / 100.0)) + base_height);
 
 				/* point 7 */
-				stl->facets[f+1].verticies[1].x = (float)((c + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[1].y = (float)((r + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[1].z = (float)((hmap[r + 1][c + 1] * (scale_pct / 100.0)) + base_height);
+				tri[1].verticies[1].x = (float)((c + 1) * units_per_pixel);
+				tri[1].verticies[1].y = (float)((r + 1) * units_per_pixel);
+				tri[1].verticies[1].z = (float)((hmap[r + 1][c + 1] * (scale_pct / 100.0)) + base_height);
 
 				/* point 6 */
-				stl->facets[f+1].verticies[2].x = (float)(c * units_per_pixel);
-				stl->facets[f+1].verticies[2].y = (float)((r + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[2].z = (float)((hmap[r + 1][c] * (scale_pct / 100.0)) + base_height);
+				tri[1].verticies[2].x = (float)(c * units_per_pixel);
+				tri[1].verticies[2].y = (float)((r + 1) * units_per_pixel);
+				tri[1].verticies[2].z = (float)((hmap[r + 1][c] * (scale_pct / 100.0)) + base_height);
 
-				stl_gen_normal_vector(stl->facets[f+1].verticies, &stl->facets[f+1].normal);
-
-				f+=2;
+				stl_hmap_emit(out, tri);
 			}
 		}
 
@@ -372,43 +446,39 @@ stl_from_heightmap_double(
 			 */
 
 			/* point 1 */
-			stl->facets[f].verticies[0].x = (float)(0 * units_per_pixel);
-			stl->facets[f].verticies[0].y = (float)(r * units_per_pixel);
-			stl->facets[f].verticies[0].z = (float)(min_z_scaled - base_height);
+			tri[0].verticies[0].x = (float)(0 * units_per_pixel);
+			tri[0].verticies[0].y = (float)(r * units_per_pixel);
+			tri[0].verticies[0].z = (float)(min_z_scaled - base_height);
 
 			/* point 6 */
-			stl->facets[f].verticies[1].x = (float)(0 * units_per_pixel);
-			stl->facets[f].verticies[1].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[0].verticies[1].x = (float)(0 * units_per_pixel);
+			tri[0].verticies[1].y = (float)((r + 1) * units_per_pixel);
+			tri[0].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point center */
-			stl->facets[f].verticies[2].x = (float)center_x;
-			stl->facets[f].verticies[2].y = (float)center_y;
-			stl->facets[f].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f].verticies, &stl->facets[f].normal);
+			tri[0].verticies[2].x = (float)center_x;
+			tri[0].verticies[2].y = (float)center_y;
+			tri[0].verticies[2].z = (float)(min_z_scaled - base_height);
 
 			/* Right triangle
 			 */
 
 			/* point 10 */
-			stl->facets[f+1].verticies[0].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[0].x = (float)((cols - 1) * units_per_pixel);
+			tri[1].verticies[0].y = (float)((r + 1) * units_per_pixel);
+			tri[1].verticies[0].z = (float)(min_z_scaled - base_height);
 
 			/* point 5 */
-			stl->facets[f+1].verticies[1].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[1].y = (float)(r * units_per_pixel);
-			stl->facets[f+1].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[1].x = (float)((cols - 1) * units_per_pixel);
+			tri[1].verticies[1].y = (float)(r * units_per_pixel);
+			tri[1].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point center */
-			stl->facets[f+1].verticies[2].x = (float)center_x;
-			stl->facets[f+1].verticies[2].y = (float)center_y;
-			stl->facets[f+1].verticies[2].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[2].x = (float)center_x;
+			tri[1].verticies[2].y = (float)center_y;
+			tri[1].verticies[2].z = (float)(min_z_scaled - base_height);
 
-			stl_gen_normal_vector(stl->facets[f+1].verticies, &stl->facets[f+1].normal);
-
-			f += 2;
+			stl_hmap_emit(out, tri);
 		}
 
 		/* Generate top and bottom triangles */
@@ -417,43 +487,39 @@ stl_from_heightmap_double(
 			/* Top triangle
 			 */
 			/* point 2 */
-			stl->facets[f].verticies[0].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f].verticies[0].y = (float)(0 * units_per_pixel);
-			stl->facets[f].verticies[0].z = (float)(min_z_scaled - base_height);
+			tri[0].verticies[0].x = (float)((c + 1) * units_per_pixel);
+			tri[0].verticies[0].y = (float)(0 * units_per_pixel);
+			tri[0].verticies[0].z = (float)(min_z_scaled - base_height);
 
 			/* point 1 */
-			stl->facets[f].verticies[1].x = (float)(c * units_per_pixel);
-			stl->facets[f].verticies[1].y = (float)(0 * units_per_pixel);
-			stl->facets[f].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[0].verticies[1].x = (float)(c * units_per_pixel);
+			tri[0].verticies[1].y = (float)(0 * units_per_pixel);
+			tri[0].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point center */
-			stl->facets[f].verticies[2].x = (float)center_x;
-			stl->facets[f].verticies[2].y = (float)center_y;
-			stl->facets[f].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f].verticies, &stl->facets[f].normal);
+			tri[0].verticies[2].x = (float)center_x;
+			tri[0].verticies[2].y = (float)center_y;
+			tri[0].verticies[2].z = (float)(min_z_scaled - base_height);
 
 			/* Bottom triangle
 			 */
 
 			/* point 21 */
-			stl->facets[f+1].verticies[0].x = (float)(c * units_per_pixel);
-			stl->facets[f+1].verticies[0].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[0].x = (float)(c * units_per_pixel);
+			tri[1].verticies[0].y = (float)((rows - 1) * units_per_pixel);
+			tri[1].verticies[0].z = (float)(min_z_scaled - base_height);
 
 			/* point 22 */
-			stl->facets[f+1].verticies[1].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[1].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[1].x = (float)((c + 1) * units_per_pixel);
+			tri[1].verticies[1].y = (float)((rows - 1) * units_per_pixel);
+			tri[1].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point center */
-			stl->facets[f+1].verticies[2].x = (float)center_x;
-			stl->facets[f+1].verticies[2].y = (float)center_y;
-			stl->facets[f+1].verticies[2].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[2].x = (float)center_x;
+			tri[1].verticies[2].y = (float)center_y;
+			tri[1].verticies[2].z = (float)(min_z_scaled - base_height);
 
-			stl_gen_normal_vector(stl->facets[f+1].verticies, &stl->facets[f+1].normal);
-
-			f += 2;
+			stl_hmap_emit(out, tri);
 		}
 #else
 		for(c = 0; c < cols - 1; c++)
@@ -463,43 +529,38 @@ stl_from_heightmap_double(
 				/* Triangle 1
 				 */
 				/* point 1 */
-				stl->facets[f].verticies[0].x = (float)(c * units_per_pixel);
-				stl->facets[f].verticies[0].y = (float)(r * units_per_pixel);
-				stl->facets[f].verticies[0].z = (float)(min_z_scaled - base_height);
+				tri[0].verticies[0].x = (float)(c * units_per_pixel);
+				tri[0].verticies[0].y = (float)(r * units_per_pixel);
+				tri[0].verticies[0].z = (float)(min_z_scaled - base_height);
 
 				/* point 6 */
-				stl->facets[f].verticies[1].x = (float)(c * units_per_pixel);
-				stl->facets[f].verticies[1].y = (float)((r + 1) * units_per_pixel);
-				stl->facets[f].verticies[1].z = (float)(min_z_scaled - base_height);
+				tri[0].verticies[1].x = (float)(c * units_per_pixel);
+				tri[0].verticies[1].y = (float)((r + 1) * units_per_pixel);
+				tri[0].verticies[1].z = (float)(min_z_scaled - base_height);
 
 				/* point 2 */
-				stl->facets[f].verticies[2].x = (float)((c + 1) * units_per_pixel);
-				stl->facets[f].verticies[2].y = (float)(r * units_per_pixel);
-				stl->facets[f].verticies[2].z = (float)(min_z_scaled - base_height);
-
-
-				/* TODO - generate unit vector */
+				tri[0].verticies[2].x = (float)((c + 1) * units_per_pixel);
+				tri[0].verticies[2].y = (float)(r * units_per_pixel);
+				tri[0].verticies[2].z = (float)(min_z_scaled - base_height);
 
 				/* Triangle 2
 				 */
 				/* point 2 */
-				stl->facets[f+1].verticies[0].x = (float)((c + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[0].y = (float)(r * units_per_pixel);
-				stl->facets[f+1].verticies[0].z = (float)(min_z_scaled - base_height);
+				tri[1].verticies[0].x = (float)((c + 1) * units_per_pixel);
+				tri[1].verticies[0].y = (float)(r * units_per_pixel);
+				tri[1].verticies[0].z = (float)(min_z_scaled - base_height);
 
 				/* point 6 */
-				stl->facets[f+1].verticies[1].x = (float)(c * units_per_pixel);
-				stl->facets[f+1].verticies[1].y = (float)((r + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[1].z = (float)(min_z_scaled - base_height);
+				tri[1].verticies[1].x = (float)(c * units_per_pixel);
+				tri[1].verticies[1].y = (float)((r + 1) * units_per_pixel);
+				tri[1].verticies[1].z = (float)(min_z_scaled - base_height);
 
 				/* point 7 */
-				stl->facets[f+1].verticies[2].x = (float)((c + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[2].y = (float)((r + 1) * units_per_pixel);
-				stl->facets[f+1].verticies[2].z = (float)(min_z_scaled - base_height);
-
-				/* TODO - generate unit vector */
+				tri[1].verticies[2].x = (float)((c + 1) * units_per_pixel);
+				tri[1].verticies[2].y = (float)((r + 1) * units_per_pixel);
+				tri[1].verticies[2].z = (float)(min_z_scaled - base_height);
 
-				f+= 2;
+				stl_hmap_emit(out, tri);
 			}
 		}
 #endif
@@ -510,42 +571,38 @@ stl_from_heightmap_double(
 			/* Triangle 1
 			 */
 			/* point 1 top */
-			stl->facets[f].verticies[0].x = (float)(c * units_per_pixel);
-			stl->facets[f].verticies[0].y = (float)(0 * units_per_pixel);
-			stl->facets[f].verticies[0].z = (float)((hmap[0][c] * (scale_pct / 100.0)) + base_height);
+			tri[0].verticies[0].x = (float)(c * units_per_pixel);
+			tri[0].verticies[0].y = (float)(0 * units_per_pixel);
+			tri[0].verticies[0].z = (float)((hmap[0][c] * (scale_pct / 100.0)) + base_height);
 
 			/* point 1 bottom */
-			stl->facets[f].verticies[1].x = (float)(c * units_per_pixel);
-			stl->facets[f].verticies[1].y = (float)(0 * units_per_pixel);
-			stl->facets[f].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[0].verticies[1].x = (float)(c * units_per_pixel);
+			tri[0].verticies[1].y = (float)(0 * units_per_pixel);
+			tri[0].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point 2 top */
-			stl->facets[f].verticies[2].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f].verticies[2].y = (float)(0 * units_per_pixel);
-			stl->facets[f].verticies[2].z = (float)((hmap[0][c + 1] * (scale_pct / 100.0)) + base_height);
-
-			stl_gen_normal_vector(stl->facets[f].verticies, &stl->facets[f].normal);
+			tri[0].verticies[2].x = (float)((c + 1) * units_per_pixel);
+			tri[0].verticies[2].y = (float)(0 * units_per_pixel);
+			tri[0].verticies[2].z = (float)((hmap[0][c + 1] * (scale_pct / 100.0)) + base_height);
 
 			/* Triangle 2
 			 */
 			/* point 2 top */
-			stl->facets[f+1].verticies[0].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].y = (float)(0 * units_per_pixel);
-			stl->facets[f+1].verticies[0].z = (float)((hmap[0][c + 1] * (scale_pct / 100.0)) + base_height);
+			tri[1].verticies[0].x = (float)((c + 1) * units_per_pixel);
+			tri[1].verticies[0].y = (float)(0 * units_per_pixel);
+			tri[1].verticies[0].z = (float)((hmap[0][c + 1] * (scale_pct / 100.0)) + base_height);
 
 			/* point 1 bottom */
-			stl->facets[f+1].verticies[1].x = (float)(c * units_per_pixel);
-			stl->facets[f+1].verticies[1].y = (float)(0 * units_per_pixel);
-			stl->facets[f+1].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[1].x = (float)(c * units_per_pixel);
+			tri[1].verticies[1].y = (float)(0 * units_per_pixel);
+			tri[1].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point 2 bottom */
-			stl->facets[f+1].verticies[2].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[2].y = (float)(0 * units_per_pixel);
-			stl->facets[f+1].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f+1].verticies, &stl->facets[f+1].normal);
+			tri[1].verticies[2].x = (float)((c + 1) * units_per_pixel);
+			tri[1].verticies[2].y = (float)(0 * units_per_pixel);
+			tri[1].verticies[2].z = (float)(min_z_scaled - base_height);
 
-			f+= 2;
+			stl_hmap_emit(out, tri);
 		}
 
 		/* Generate the bottom side mesh */
@@ -554,42 +611,38 @@ stl_from_heightmap_double(
 			/* Triangle 1
 			 */
 			/* point 21 top */
-			stl->facets[f].verticies[0].x = (float)(c * units_per_pixel);
-			stl->facets[f].verticies[0].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f].verticies[0].z = (float)((hmap[rows - 1][c] * (scale_pct / 100.0)) + base_height);
+			tri[0].verticies[0].x = (float)(c * units_per_pixel);
+			tri[0].verticies[0].y = (float)((rows - 1) * units_per_pixel);
+			tri[0].verticies[0].z = (float)((hmap[rows - 1][c] * (scale_pct / 100.0)) + base_height);
 
 			/* point 22 top */
-			stl->facets[f].verticies[1].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f].verticies[1].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f].verticies[1].z = (float)((hmap[rows - 1][c + 1] * (scale_pct / 100.0)) + base_height);
+			tri[0].verticies[1].x = (float)((c + 1) * units_per_pixel);
+			tri[0].verticies[1].y = (float)((rows - 1) * units_per_pixel);
+			tri[0].verticies[1].z = (float)((hmap[rows - 1][c + 1] * (scale_pct / 100.0)) + base_height);
 
 			/* point 21 bottom */
-			stl->facets[f].verticies[2].x = (float)(c * units_per_pixel);
-			stl->facets[f].verticies[2].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f].verticies, &stl->facets[f].normal);
+			tri[0].verticies[2].x = (float)(c * units_per_pixel);
+			tri[0].verticies[2].y = (float)((rows - 1) * units_per_pixel);
+			tri[0].verticies[2].z = (float)(min_z_scaled - base_height);
 
 			/* Triangle 2
 			 */
 			/* point 22 top */
-			stl->facets[f+1].verticies[0].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].z = (float)((hmap[rows - 1][c + 1] * (scale_pct / 100.0)) + base_height);
+			tri[1].verticies[0].x = (float)((c + 1) * units_per_pixel);
+			tri[1].verticies[0].y = (float)((rows - 1) * units_per_pixel);
+			tri[1].verticies[0].z = (float)((hmap[rows - 1][c + 1] * (scale_pct / 100.0)) + base_height);
 
 			/* point 22 bottom */
-			stl->facets[f+1].verticies[1].x = (float)((c + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[1].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[1].x = (float)((c + 1) * units_per_pixel);
+			tri[1].verticies[1].y = (float)((rows - 1) * units_per_pixel);
+			tri[1].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point 21 bottom */
-			stl->facets[f+1].verticies[2].x = (float)(c * units_per_pixel);
-			stl->facets[f+1].verticies[2].y = (float)((rows - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f+1].verticies, &stl->facets[f+1].normal);
+			tri[1].verticies[2].x = (float)(c * units_per_pixel);
+			tri[1].verticies[2].y = (float)((rows - 1) * units_per_pixel);
+			tri[1].verticies[2].z = (float)(min_z_scaled - base_height);
 
-			f+= 2;
+			stl_hmap_emit(out, tri);
 		}
 
 		/* Generate the left side mesh */
@@ -598,42 +651,38 @@ stl_from_heightmap_double(
 			/* Triangle 1
 			 */
 			/* point 1 top */
-			stl->facets[f].verticies[0].x = (float)(0 * units_per_pixel);  /* 0 -> c */
-			stl->facets[f].verticies[0].y = (float)(r * units_per_pixel);
-			stl->facets[f].verticies[0].z = (float)((hmap[r][0] * (scale_pct / 100.0)) + base_height);  /* 0 -> c */
+			tri[0].verticies[0].x = (float)(0 * units_per_pixel);  /* 0 -> c */
+			tri[0].verticies[0].y = (float)(r * units_per_pixel);
+			tri[0].verticies[0].z = (float)((hmap[r][0] * (scale_pct / 100.0)) + base_height);  /* 0 -> c */
 
 			/* point 6 top */
-			stl->facets[f].verticies[1].x = (float)(0 * units_per_pixel);  /* 0 -> c */
-			stl->facets[f].verticies[1].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f].verticies[1].z = (float)((hmap[r + 1][0] * (scale_pct / 100.0)) + base_height);  /* 0 -> c */
+			tri[0].verticies[1].x = (float)(0 * units_per_pixel);  /* 0 -> c */
+			tri[0].verticies[1].y = (float)((r + 1) * units_per_pixel);
+			tri[0].verticies[1].z = (float)((hmap[r + 1][0] * (scale_pct / 100.0)) + base_height);  /* 0 -> c */
 
 			/* point 1 bottom */
-			stl->facets[f].verticies[2].x = (float)(0 * units_per_pixel);  /* 0 -> c */
-			stl->facets[f].verticies[2].y = (float)(r * units_per_pixel);
-			stl->facets[f].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f].verticies, &stl->facets[f].normal);
+			tri[0].verticies[2].x = (float)(0 * units_per_pixel);  /* 0 -> c */
+			tri[0].verticies[2].y = (float)(r * units_per_pixel);
+			tri[0].verticies[2].z = (float)(min_z_scaled - base_height);
 
 			/* Triangle 2
 			 */
 			/* point 6 top */
-			stl->facets[f+1].verticies[0].x = (float)(0 * units_per_pixel);  /* 0 -> c */
-			stl->facets[f+1].verticies[0].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].z = (float)((hmap[r + 1][0] * (scale_pct / 100.0)) + base_height);  /* 0 -> c */
+			tri[1].verticies[0].x = (float)(0 * units_per_pixel);  /* 0 -> c */
+			tri[1].verticies[0].y = (float)((r + 1) * units_per_pixel);
+			tri[1].verticies[0].z = (float)((hmap[r + 1][0] * (scale_pct / 100.0)) + base_height);  /* 0 -> c */
 
 			/* point 6 bottom */
-			stl->facets[f+1].verticies[1].x = (float)(0 * units_per_pixel);  /* 0 -> c */
-			stl->facets[f+1].verticies[1].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[1].x = (float)(0 * units_per_pixel);  /* 0 -> c */
+			tri[1].verticies[1].y = (float)((r + 1) * units_per_pixel);
+			tri[1].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point 1 bottom */
-			stl->facets[f+1].verticies[2].x = (float)(0 * units_per_pixel);  /* 0 -> c */
-			stl->facets[f+1].verticies[2].y = (float)(r * units_per_pixel);
-			stl->facets[f+1].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f+1].verticies, &stl->facets[f+1].normal);
+			tri[1].verticies[2].x = (float)(0 * units_per_pixel);  /* 0 -> c */
+			tri[1].verticies[2].y = (float)(r * units_per_pixel);
+			tri[1].verticies[2].z = (float)(min_z_scaled - base_height);
 
-			f+= 2;
+			stl_hmap_emit(out, tri);
 		}
 
 		/* Generate the right side mesh */
@@ -642,45 +691,47 @@ stl_from_heightmap_double(
 			/* Triangle 1
 			 */
 			/* point 5 top */
-			stl->facets[f].verticies[0].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f].verticies[0].y = (float)(r * units_per_pixel);
-			stl->facets[f].verticies[0].z = (float)((hmap[r][cols - 1] * (scale_pct / 100.0)) + base_height);
+			tri[0].verticies[0].x = (float)((cols - 1) * units_per_pixel);
+			tri[0].verticies[0].y = (float)(r * units_per_pixel);
+			tri[0].verticies[0].z = (float)((hmap[r][cols - 1] * (scale_pct / 100.0)) + base_height);
 
 			/* point 5 bottom */
-			stl->facets[f].verticies[1].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f].verticies[1].y = (float)(r * units_per_pixel);
-			stl->facets[f].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[0].verticies[1].x = (float)((cols - 1) * units_per_pixel);
+			tri[0].verticies[1].y = (float)(r * units_per_pixel);
+			tri[0].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point 10 top */
-			stl->facets[f].verticies[2].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f].verticies[2].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f].verticies[2].z = (float)((hmap[r + 1][cols - 1] * (scale_pct / 100.0)) + base_height);
-
-			stl_gen_normal_vector(stl->facets[f].verticies, &stl->facets[f].normal);
+			tri[0].verticies[2].x = (float)((cols - 1) * units_per_pixel);
+			tri[0].verticies[2].y = (float)((r + 1) * units_per_pixel);
+			tri[0].verticies[2].z = (float)((hmap[r + 1][cols - 1] * (scale_pct / 100.0)) + base_height);
 
 			/* Triangle 2
 			 */
 			/* point 10 top */
-			stl->facets[f+1].verticies[0].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[0].z = (float)((hmap[r + 1][cols - 1] * (scale_pct / 100.0)) + base_height);
+			tri[1].verticies[0].x = (float)((cols - 1) * units_per_pixel);
+			tri[1].verticies[0].y = (float)((r + 1) * units_per_pixel);
+			tri[1].verticies[0].z = (float)((hmap[r + 1][cols - 1] * (scale_pct / 100.0)) + base_height);
 
 			/* point 5 bottom */
-			stl->facets[f+1].verticies[1].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[1].y = (float)(r * units_per_pixel);
-			stl->facets[f+1].verticies[1].z = (float)(min_z_scaled - base_height);
+			tri[1].verticies[1].x = (float)((cols - 1) * units_per_pixel);
+			tri[1].verticies[1].y = (float)(r * units_per_pixel);
+			tri[1].verticies[1].z = (float)(min_z_scaled - base_height);
 
 			/* point 10 bottom */
-			stl->facets[f+1].verticies[2].x = (float)((cols - 1) * units_per_pixel);
-			stl->facets[f+1].verticies[2].y = (float)((r + 1) * units_per_pixel);
-			stl->facets[f+1].verticies[2].z = (float)(min_z_scaled - base_height);
-
-			stl_gen_normal_vector(stl->facets[f+1].verticies, &stl->facets[f+1].normal);
+			tri[1].verticies[2].x = (float)((cols - 1) * units_per_pixel);
+			tri[1].verticies[2].y = (float)((r + 1) * units_per_pixel);
+			tri[1].verticies[2].z = (float)(min_z_scaled - base_height);
 
-			f+= 2;
+			stl_hmap_emit(out, tri);
 		}
 	}
 
+	/* A whole object gets its normals in one pass at the end */
+	if((STL_SUCCESS == error) && (STL_SUCCESS == out->error) && (NULL == out->writer))
+	{
+		_stl_normals_facets(out->stl->facets, out->stl->facets_count);
+	}
+
 	/* Cleanup */
 	if(NULL != hmap)
 	{
@@ -688,14 +739,109 @@ stl_from_heightmap_double(
 		hmap = NULL;
 	}
 
+	if(STL_SUCCESS == error)
+	{
+		error = out->error;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Make an STL object from an array of double values
+ */
+stl_error_t
+stl_from_heightmap_double(
+	const double *vals,
+	stl_origin_t origin,
+	size_t cols,
+	size_t rows,
+	double scale_pct,
+	double base_height,
+	double units_per_pixel,
+	stl_t **newstl
+	)
+{
+	stl_error_t    error = STL_SUCCESS;
+	stl_hmap_out_t out;
+
+	memset(&out, 0x00, sizeof(out));
+
+	if(NULL == newstl)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_hmap_generate(vals, origin, cols, rows, scale_pct, base_height, units_per_pixel, &out);
+	}
+
 	if(STL_SUCCESS != error)
 	{
-		stl_free(stl);
-		stl = NULL;
+		stl_free(out.stl);
+		out.stl = NULL;
 	}
 	else
 	{
-		*newstl = stl;
+		*newstl = out.stl;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t
+stl_write_heightmap_double(
+	char *output_file,
+	const double *vals,
+	stl_origin_t origin,
+	size_t cols,
+	size_t rows,
+	double scale_pct,
+	double base_height,
+	double units_per_pixel
+	)
+{
+	stl_error_t    error = STL_SUCCESS;
+	stl_error_t    close_error = STL_SUCCESS;
+	unsigned char  header[STL_HEADER_SIZE];
+	stl_hmap_out_t out;
+
+	memset(&out, 0x00, sizeof(out));
+	memset(header, 0x00, sizeof(header));
+
+	if(NULL == output_file)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* Before the file is made, so bad arguments don't leave one behind */
+	if(STL_SUCCESS == error)
+	{
+		error = stl_hmap_check_args(vals, cols, rows, scale_pct, units_per_pixel);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_writer_open(output_file, header, STL_FACETS_COUNT_DEFERRED, &out.writer);
+	}
+
+	if(NULL != out.writer)
+	{
+		error = stl_hmap_generate(vals, origin, cols, rows, scale_pct, base_height, units_per_pixel, &out);
+
+		close_error = stl_writer_close(out.writer);
+		out.writer = NULL;
+
+		if(STL_SUCCESS == error)
+		{
+			error = close_error;
+		}
+
+		/* Half a heightmap is worse than none, and would stop a retry */
+		if(STL_SUCCESS != error)
+		{
+			remove(output_file);
+		}
 	}
 
 	return STL_LOG_ERR(error);
@@ -0,0 +1,261 @@
+#ifndef _STL3D_INTERNAL_H
+#define _STL3D_INTERNAL_H
+
+/* Helpers shared between the library source files. These are not part of
+ * the public API in stl3d_lib.h.
+ */
+
+#include <stdio.h>
+
+#include "stl3d_lib.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define STL_PI 3.14159265358979323846
+
+/* Number of facets read from a file with each fread() */
+#define STL_READ_CHUNK_FACETS 4096
+
+/* Number of facets packed into each block written to a file */
+#define STL_WRITE_CHUNK_FACETS 16384
+
+/* Convert between little endian file bytes and native 32 bit numbers
+ */
+unsigned int _stl_pack_le32(const unsigned char *buffer);
+stl_error_t _stl_unpack_le32(const unsigned int val, unsigned char *buffer);
+
+/* Convert one facet between the packed 50 byte file layout and stl_facet_t
+ */
+void _stl_decode_facet(const unsigned char *buffer, stl_facet_t *facet);
+void _stl_encode_facet(const stl_facet_t *facet, unsigned char *buffer);
+
+/* Unpack count consecutive facets from the file layout
+ */
+void _stl_decode_facets(const unsigned char *buffer, stl_facet_t *facets, size_t count);
+
+/* Pack count consecutive facets into the file layout
+ */
+void _stl_encode_facets(const stl_facet_t *facets, size_t count, unsigned char *buffer);
+
+/* Create a new, unbuffered output file. Fails if the file already exists.
+ */
+stl_error_t _stl_create_file(const char *output_file, FILE **fp_new);
+
+/* Map a whole file read-only. Returns STL_ERROR_UNSUPPORTED on platforms
+ * without mmap().
+ */
+stl_error_t _stl_map_readonly(const char *filename, void **base, size_t *size);
+void _stl_unmap(void *base, size_t size);
+
+/* Same as _stl_map_readonly() but the pages can be written to. Changes are
+ * private to the process (copy on write) and never reach the file.
+ */
+stl_error_t _stl_map_private(const char *filename, void **base, size_t *size);
+
+/* Set *result to a * b. Returns 0 (leaving *result alone) if that doesn't
+ * fit in a size_t.
+ */
+int _stl_size_mul(size_t a, size_t b, size_t *result);
+
+/* malloc() an array of count elements of size bytes each. Returns NULL if
+ * the total size overflows rather than allocating a wrapped-around size.
+ */
+void *_stl_alloc_array(size_t count, size_t size);
+
+/* Allocate bytes aligned to STL_ALIGN, free with _stl_free_aligned().
+ * Returns NULL on failure, never for 0 bytes.
+ */
+#define STL_ALIGN 64
+void *_stl_alloc_aligned(size_t bytes);
+void _stl_free_aligned(void *ptr);
+
+/* Return facet i of the object. For mapped objects, or when a transform is
+ * pending, the facet is put together in tmp and tmp is returned, otherwise
+ * a pointer into stl->facets is returned.
+ */
+const stl_facet_t *_stl_get_facet(const stl_t *stl, size_t i, stl_facet_t *tmp);
+
+/* Same for count facets from first on, tmp must have room for count
+ */
+const stl_facet_t *_stl_get_facets(const stl_t *stl, size_t first, size_t count, stl_facet_t *tmp);
+
+/* Make sure stl->facets holds the facets so they can be modified in place.
+ * For mapped objects this copies the facets to the heap and unmaps the file,
+ * and any pending transform is applied. Anything cached about the facets
+ * (bounds) is dropped.
+ */
+stl_error_t _stl_make_writable(stl_t *stl);
+
+/* Returns non-zero if a file starting with the len bytes in start is an
+ * ASCII STL file rather than a binary one. file_size is the size of the whole
+ * file, or 0 if it isn't known (when streaming).
+ */
+int _stl_looks_ascii(const unsigned char *start, size_t len, size_t file_size);
+
+/* Parse an ASCII STL file held in memory
+ */
+stl_error_t _stl_parse_ascii(const char *data, size_t size, stl_t **stl_new);
+
+/* Read and parse an ASCII STL file
+ */
+stl_error_t _stl_read_ascii_file(const char *input_file, stl_t **stl_new);
+
+/* Parse a number from the text in [*p, end) with the same result as
+ * strtof(), moving *p past it. Returns 0 if there is no number there.
+ */
+int _stl_parse_float(const char **p, const char *end, float *value);
+
+/* Returns non-zero if a file starting with the len bytes in start is gzip
+ * compressed
+ */
+int _stl_is_gzip(const unsigned char *start, size_t len);
+
+/* Returns non-zero if filename ends in ".gz", meaning it should be written
+ * compressed
+ */
+int _stl_has_gzip_suffix(const char *filename);
+
+/* Read a gzip compressed binary or ASCII STL file
+ */
+stl_error_t _stl_read_gzip_file(const char *input_file, stl_t **stl_new);
+
+/* Write a gzip compressed binary STL file, compressing blocks in parallel
+ */
+stl_error_t _stl_write_gzip_file(const char *output_file, stl_t *stl);
+
+/* An affine transform ready to apply to facets: m is the top three rows of
+ * the 4x4 matrix, n the 3x3 matrix for the normals. normalize rescales the
+ * normals to unit length afterwards, flip swaps the second and third
+ * corners.
+ */
+typedef struct _stl_xform_s
+{
+	double       m[12];
+	double       n[9];
+	int          normalize;
+	int          flip;
+
+	/* Only used while deferred (stl_t.pending): the bounds of the facets
+	 * before any of it, if they were known. Each step deferred on top
+	 * works the box out again from these through the whole transform.
+	 */
+	int          has_bounds;
+	stl_vertex_t bounds_min;
+	stl_vertex_t bounds_max;
+} _stl_xform_t;
+
+/* Check m is affine and work out the rest of xform from it
+ */
+stl_error_t _stl_xform_prepare(const double m[16], _stl_xform_t *xform);
+
+/* Move the cached bounds of stl through the top three rows m of a
+ * transform just applied to its facets. Transforms that keep the box lined
+ * up with the axes (scales, mirrors, moves) keep it exact, anything else
+ * drops it.
+ */
+void _stl_xform_bounds(const double m[12], stl_t *stl);
+
+/* Widen the cached bounds of stl to take in count facets, starting them off
+ * if there aren't any yet. For code that builds an object a few facets at a
+ * time.
+ */
+void _stl_bounds_add(stl_t *stl, const stl_facet_t *facets, size_t count);
+
+/* Apply xform to each facet, with the best kernel for the CPU
+ */
+void _stl_xform_facets(const _stl_xform_t *xform, stl_facet_t *facets, size_t facets_count);
+
+/* Apply the top three rows m of a transform to count corners held in
+ * separate x, y and z arrays, with the best kernel for the CPU
+ */
+void _stl_xform_points(const double m[12], float *x, float *y, float *z, size_t count);
+
+/* Multiply each corner by scale and zero the normals, with the best kernel
+ * for the CPU
+ */
+void _stl_scale_facets(const float scale[3], stl_facet_t *facets, size_t facets_count);
+
+/* Work out each facet's normal from its corners, with the best kernel for
+ * the CPU
+ */
+void _stl_normals_facets(stl_facet_t *facets, size_t facets_count);
+
+/* Unpack count facets of a compact object from first on into facets.
+ * Normals that weren't kept are worked out from the corners if normals is
+ * set, and left zero otherwise (for callers that only want the corners).
+ */
+void _stl_compact_get_facets(const stl_compact_t *compact, size_t first, size_t count, int normals, stl_facet_t *facets);
+
+/* What the orientation search knows about each facet, one array of each
+ * (see stl3d_orient.c). Corner j of facet i is at x[j][i], y[j][i] and
+ * z[j][i]. (ax, ay, az) is the facet's area vector, half the cross product
+ * of its edges, and the facet needs support when that vector dotted with
+ * the up direction is below threshold.
+ */
+typedef struct
+{
+	float *x[3];
+	float *y[3];
+	float *z[3];
+	float *ax;
+	float *ay;
+	float *az;
+	float *threshold;
+} _stl_orient_facets_t;
+
+/* Widen *min and *max to take in the height along up of every corner of
+ * facets [first, first + count)
+ */
+void _stl_orient_range(const _stl_orient_facets_t *facets, size_t first, size_t count, const float up[3], float *min, float *max);
+
+/* Area facing down steeply enough to need support, projected onto the bed,
+ * over facets [first, first + count) with up pointing up. Facets with no
+ * corner above bed are sitting on the bed and don't count.
+ */
+double _stl_orient_overhang(const _stl_orient_facets_t *facets, size_t first, size_t count, const float up[3], float bed);
+
+/* Facets in each piece of work handed to a context's threads, sized so a
+ * piece sits comfortably in a core's L2 cache
+ */
+#define STL_CTX_CHUNK_FACETS 4096
+
+/* Does one chunk of a context job: items [first, first + count), which is
+ * chunk number chunk_index
+ */
+typedef void (*_stl_chunk_fn_t)(size_t chunk_index, size_t first, size_t count, void *arg);
+
+/* Number of chunks count items make, the last one may be short
+ */
+size_t _stl_chunk_count(size_t count, size_t chunk);
+
+/* Cut count items into chunks and run fn on each across the context's
+ * threads, returning once all are done. The order the chunks run in isn't
+ * fixed. A NULL ctx runs them all on the calling thread.
+ */
+void _stl_ctx_run(stl_ctx_t *ctx, size_t count, size_t chunk, _stl_chunk_fn_t fn, void *arg);
+
+/* A context for one call over count facets, for the plain versions of
+ * functions that are worth spreading across the CPUs. Returns NULL (run on
+ * the calling thread) when there's too little work or only one CPU.
+ */
+stl_ctx_t *_stl_ctx_temp(size_t count);
+
+/* Function run on each thread by _stl_run_threads()
+ */
+typedef void (*_stl_task_fn_t)(unsigned int index, void *arg);
+
+/* Number of CPUs available to run threads on (at least 1)
+ */
+unsigned int _stl_cpu_count(void);
+
+/* Run fn(0, arg) .. fn(count - 1, arg) on count threads and wait for them
+ */
+stl_error_t _stl_run_threads(unsigned int count, _stl_task_fn_t fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* _STL3D_INTERNAL_H */
@@ -3,9 +3,12 @@
 #include <string.h>
 #include <math.h>
 
-#include "stl3d_lib.h"
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
-#define STL_PI 3.14159265358979323846
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
 
 int _log_err(int error, char *file, int line)
 {
@@ -18,15 +21,12 @@ int _log_err(int error, char *file, int line)
 }
 
 
-static double deg2rad(double deg)
-{
-	return (deg * STL_PI / 180);
-}
-
 
 void stl_print(stl_t *stl)
 {
-	unsigned int i = 0;
+	size_t            i = 0;
+	const stl_facet_t *facet = NULL;
+	stl_facet_t       tmp;
 
 	if(NULL == stl)
 	{
@@ -35,109 +35,286 @@ void stl_print(stl_t *stl)
 	}
 
 	printf("Skipping Header\n");
-	printf("stl->facets_count: %d\n", stl->facets_count);
+	printf("stl->facets_count: %llu\n", (unsigned long long)stl->facets_count);
 
 	for(i = 0; i < stl->facets_count; i++)
 	{
-		printf("Facet %d:\n", i+1);
+		facet = _stl_get_facet(stl, i, &tmp);
+
+		printf("Facet %llu:\n", (unsigned long long)(i+1));
 
-		printf("   Norm: %f %f %f\n", stl->facets[i].normal.x, stl->facets[i].normal.y, stl->facets[i].normal.z);
-		printf("      V1  : %f %f %f\n", stl->facets[i].verticies[0].x, stl->facets[i].verticies[0].y, stl->facets[i].verticies[0].z);
-		printf("      V2  : %f %f %f\n", stl->facets[i].verticies[1].x, stl->facets[i].verticies[1].y, stl->facets[i].verticies[1].z);
-		printf("      V3  : %f %f %f\n", stl->facets[i].verticies[2].x, stl->facets[i].verticies[2].y, stl->facets[i].verticies[2].z);
+		printf("   Norm: %f %f %f\n", facet->normal.x, facet->normal.y, facet->normal.z);
+		printf("      V1  : %f %f %f\n", facet->verticies[0].x, facet->verticies[0].y, facet->verticies[0].z);
+		printf("      V2  : %f %f %f\n", facet->verticies[1].x, facet->verticies[1].y, facet->verticies[1].z);
+		printf("      V3  : %f %f %f\n", facet->verticies[2].x, facet->verticies[2].y, facet->verticies[2].z);
 	}
 }
 
-/* This function is incomplete
+/* Facets fetched at a time by stl_scan_bounds() */
+#define STL_SCAN_FACETS 256
+
+/* Widen min/max to take in the corners of count facets from first on
  */
-void stl_print_stats(stl_t *stl)
+static void stl_scan_bounds(const stl_t *stl, size_t first, size_t count, double *min, double *max)
 {
-	unsigned int i = 0;
-	unsigned int j = 0;
-	double length_x = 0.0;
-	double length_y = 0.0;
-	double length_z = 0.0;
-
-	double min_x = 0.0;
-	double min_y = 0.0;
-	double min_z = 0.0;
-
-	double max_x = 0.0;
-	double max_y = 0.0;
-	double max_z = 0.0;
-
-	double surface_area = 0.0;
-
-	if(NULL == stl)
+	size_t            i = 0;
+	unsigned int      j = 0;
+	size_t            block = 0;
+	const stl_facet_t *facets = NULL;
+	const stl_facet_t *facet = NULL;
+	stl_facet_t       tmp[STL_SCAN_FACETS];
+
+	for(i = first; i < first + count; i++)
 	{
-		printf("NULL stl\n");
-		return;
-	}
-
-	printf("stl->facets_count: %d\n", stl->facets_count);
-
-	if(stl->facets_count == 0)
-	{
-		return;
-	}
+		/* A block at a time, so a pending transform is applied a block at
+		 * a time too
+		 */
+		if(0 == ((i - first) % STL_SCAN_FACETS))
+		{
+			block = first + count - i;
+			if(block > STL_SCAN_FACETS)
+			{
+				block = STL_SCAN_FACETS;
+			}
 
-	/* Prime the pump - set a min and max using the first point */
-	min_x = stl->facets[0].verticies[0].x;
-	min_y = stl->facets[0].verticies[0].y;
-	min_z = stl->facets[0].verticies[0].z;
+			facets = _stl_get_facets(stl, i, block, tmp);
+		}
 
-	max_x = stl->facets[0].verticies[0].x;
-	max_y = stl->facets[0].verticies[0].y;
-	max_z = stl->facets[0].verticies[0].z;
+		facet = &facets[(i - first) % STL_SCAN_FACETS];
 
-	for(i = 0; i < stl->facets_count; i++)
-	{
 		for(j = 0; j < 3; j++)
 		{
 			/* Find min x */
-			if(stl->facets[i].verticies[j].x < min_x)
+			if(facet->verticies[j].x < min[0])
 			{
-				min_x = stl->facets[i].verticies[j].x;
+				min[0] = facet->verticies[j].x;
 			}
 
 			/* Find max x */
-			if(stl->facets[i].verticies[j].x > max_x)
+			if(facet->verticies[j].x > max[0])
 			{
-				max_x = stl->facets[i].verticies[j].x;
+				max[0] = facet->verticies[j].x;
 			}
 
 			/* Find min y */
-			if(stl->facets[i].verticies[j].y < min_y)
+			if(facet->verticies[j].y < min[1])
 			{
-				min_y = stl->facets[i].verticies[j].y;
+				min[1] = facet->verticies[j].y;
 			}
 
 			/* Find max y */
-			if(stl->facets[i].verticies[j].y > max_y)
+			if(facet->verticies[j].y > max[1])
 			{
-				max_y = stl->facets[i].verticies[j].y;
+				max[1] = facet->verticies[j].y;
 			}
 
 			/* Find min z */
-			if(stl->facets[i].verticies[j].z < min_z)
+			if(facet->verticies[j].z < min[2])
 			{
-				min_z = stl->facets[i].verticies[j].z;
+				min[2] = facet->verticies[j].z;
 			}
 
 			/* Find max z */
-			if(stl->facets[i].verticies[j].z > max_z)
+			if(facet->verticies[j].z > max[2])
 			{
-				max_z = stl->facets[i].verticies[j].z;
+				max[2] = facet->verticies[j].z;
 			}
 		}
 	}
+}
+
+typedef struct
+{
+	const stl_t *stl;
+
+	/* Every chunk starts from the same first point the whole scan would,
+	 * so the result is the same however the facets are split up
+	 */
+	double      seed[3];
+
+	/* min x, y, z then max x, y, z for each chunk */
+	double      *results;
+} stl_stats_job_t;
+
+static void stl_stats_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_stats_job_t *job = (stl_stats_job_t *)arg;
+	double          *min = &job->results[6 * chunk_index];
+	double          *max = min + 3;
+
+	memcpy(min, job->seed, sizeof(job->seed));
+	memcpy(max, job->seed, sizeof(job->seed));
+
+	stl_scan_bounds(job->stl, first, count, min, max);
+}
+
+/* Fill in the cached bounds if they aren't there already. Objects with no
+ * facets have no bounds.
+ */
+static void stl_find_bounds(stl_ctx_t *ctx, stl_t *stl)
+{
+	size_t            i = 0;
+	unsigned int      j = 0;
+	size_t            chunk = 0;
+	size_t            chunks = 0;
+	double            min[3];
+	double            max[3];
+	double            one[6];
+	const stl_facet_t *facet = NULL;
+	stl_facet_t       tmp;
+	stl_stats_job_t   job;
+
+	if(stl->has_bounds || (0 == stl->facets_count))
+	{
+		return;
+	}
+
+	/* Prime the pump - set a min and max using the first point */
+	facet = _stl_get_facet(stl, 0, &tmp);
+
+	job.stl = stl;
+	job.seed[0] = facet->verticies[0].x;
+	job.seed[1] = facet->verticies[0].y;
+	job.seed[2] = facet->verticies[0].z;
+	job.results = one;
+
+	/* Split up only when there are threads to share it with, and fall back
+	 * to one piece if there's no memory for the per chunk results
+	 */
+	chunk = stl->facets_count;
+
+	if(stl_ctx_threads(ctx) > 1)
+	{
+		chunks = _stl_chunk_count(stl->facets_count, STL_CTX_CHUNK_FACETS);
+
+		job.results = (double *)_stl_alloc_array(chunks, sizeof(one));
+		if(NULL != job.results)
+		{
+			chunk = STL_CTX_CHUNK_FACETS;
+		}
+		else
+		{
+			job.results = one;
+		}
+	}
+
+	memcpy(min, job.seed, sizeof(min));
+	memcpy(max, job.seed, sizeof(max));
+
+	_stl_ctx_run(ctx, stl->facets_count, chunk, stl_stats_chunk, &job);
+
+	chunks = _stl_chunk_count(stl->facets_count, chunk);
+
+	for(i = 0; i < chunks; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			min[j] = (job.results[6 * i + j] < min[j]) ? job.results[6 * i + j] : min[j];
+			max[j] = (job.results[6 * i + 3 + j] > max[j]) ? job.results[6 * i + 3 + j] : max[j];
+		}
+	}
+
+	if(job.results != one)
+	{
+		free(job.results);
+	}
+
+	/* Every value came from a float, so nothing is lost keeping them */
+	stl->bounds_min.x = (float)min[0];
+	stl->bounds_min.y = (float)min[1];
+	stl->bounds_min.z = (float)min[2];
+
+	stl->bounds_max.x = (float)max[0];
+	stl->bounds_max.y = (float)max[1];
+	stl->bounds_max.z = (float)max[2];
+
+	stl->has_bounds = 1;
+}
+
+void stl_print_stats_ctx(stl_ctx_t *ctx, stl_t *stl)
+{
+	if(NULL == stl)
+	{
+		printf("NULL stl\n");
+		return;
+	}
+
+	printf("stl->facets_count: %llu\n", (unsigned long long)stl->facets_count);
+
+	if(stl->facets_count == 0)
+	{
+		return;
+	}
+
+	/* Only scans the facets the first time round */
+	stl_find_bounds(ctx, stl);
 
-	printf("min_x: %f   max_x: %f   width: %f\n", min_x, max_x, max_x - min_x);
-	printf("min_y: %f   max_y: %f   width: %f\n", min_y, max_y, max_y - min_y);
-	printf("min_z: %f   max_z: %f   width: %f\n", min_z, max_z, max_z - min_z);
+	printf("min_x: %f   max_x: %f   width: %f\n", stl->bounds_min.x, stl->bounds_max.x, (double)stl->bounds_max.x - stl->bounds_min.x);
+	printf("min_y: %f   max_y: %f   width: %f\n", stl->bounds_min.y, stl->bounds_max.y, (double)stl->bounds_max.y - stl->bounds_min.y);
+	printf("min_z: %f   max_z: %f   width: %f\n", stl->bounds_min.z, stl->bounds_max.z, (double)stl->bounds_max.z - stl->bounds_min.z);
 }
 
-stl_error_t stl_new(stl_t **stl_new, unsigned int fascets_count)
+void stl_print_stats(stl_t *stl)
+{
+	stl_print_stats_ctx(NULL, stl);
+}
+
+stl_error_t stl_get_bounds_ctx(stl_ctx_t *ctx, stl_t *stl, stl_vertex_t *min, stl_vertex_t *max)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if((NULL == stl) || (NULL == min) || (NULL == max) || (0 == stl->facets_count))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		stl_find_bounds(ctx, stl);
+
+		*min = stl->bounds_min;
+		*max = stl->bounds_max;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_get_bounds(stl_t *stl, stl_vertex_t *min, stl_vertex_t *max)
+{
+	return stl_get_bounds_ctx(NULL, stl, min, max);
+}
+
+void _stl_bounds_add(stl_t *stl, const stl_facet_t *facets, size_t count)
+{
+	size_t             i = 0;
+	unsigned int       j = 0;
+	const stl_vertex_t *v = NULL;
+
+	if((0 != count) && !stl->has_bounds)
+	{
+		stl->bounds_min = facets[0].verticies[0];
+		stl->bounds_max = facets[0].verticies[0];
+		stl->has_bounds = 1;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			v = &facets[i].verticies[j];
+
+			stl->bounds_min.x = (v->x < stl->bounds_min.x) ? v->x : stl->bounds_min.x;
+			stl->bounds_min.y = (v->y < stl->bounds_min.y) ? v->y : stl->bounds_min.y;
+			stl->bounds_min.z = (v->z < stl->bounds_min.z) ? v->z : stl->bounds_min.z;
+
+			stl->bounds_max.x = (v->x > stl->bounds_max.x) ? v->x : stl->bounds_max.x;
+			stl->bounds_max.y = (v->y > stl->bounds_max.y) ? v->y : stl->bounds_max.y;
+			stl->bounds_max.z = (v->z > stl->bounds_max.z) ? v->z : stl->bounds_max.z;
+		}
+	}
+}
+
+stl_error_t stl_new(stl_t **stl_new, size_t fascets_count)
 {
 	stl_error_t error = STL_SUCCESS;
 	stl_t       *stl = NULL;
@@ -162,7 +339,7 @@ stl_error_t stl_new(stl_t **stl_new, unsigned int fascets_count)
 
 		stl->facets_count = fascets_count;
 
-		stl->facets = (stl_facet_t *)malloc(stl->facets_count * sizeof(stl_facet_t));
+		stl->facets = (stl_facet_t *)_stl_alloc_array(stl->facets_count, sizeof(stl_facet_t));
 		if(NULL == stl->facets)
 		{
 			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
@@ -171,7 +348,10 @@ stl_error_t stl_new(stl_t **stl_new, unsigned int fascets_count)
 		{
 			memset(stl->facets, 0x00, sizeof(stl->facets[0]) * fascets_count);
 		}
+	}
 
+	if(STL_SUCCESS == error)
+	{
 		*stl_new = stl;
 		stl = NULL;
 	}
@@ -192,112 +372,350 @@ void stl_free(stl_t *stl)
 		return;
 	}
 
-	if(NULL != stl->facets)
+	if((NULL != stl->facets) && !stl->facets_in_map)
 	{
 		free(stl->facets);
-		stl->facets = NULL;
+	}
+
+	stl->facets = NULL;
+
+	free(stl->pending);
+	stl->pending = NULL;
+
+	if(NULL != stl->map_base)
+	{
+		_stl_unmap(stl->map_base, stl->map_size);
+		stl->map_base = NULL;
+		stl->mapped_facets = NULL;
 	}
 
 	free(stl);
 }
 
+int _stl_size_mul(size_t a, size_t b, size_t *result)
+{
+	if((0 != a) && (b > ((size_t)-1) / a))
+	{
+		return 0;
+	}
+
+	*result = a * b;
+
+	return 1;
+}
+
+void *_stl_alloc_array(size_t count, size_t size)
+{
+	size_t bytes = 0;
+
+	if(!_stl_size_mul(count, size, &bytes))
+	{
+		return NULL;
+	}
+
+	/* malloc(0) may return NULL, which would look like a failure */
+	return malloc((0 == bytes) ? 1 : bytes);
+}
+
+void *_stl_alloc_aligned(size_t bytes)
+{
+	void *ptr = NULL;
+
+	bytes = (0 == bytes) ? 1 : bytes;
+
+#ifdef _WIN32
+	ptr = _aligned_malloc(bytes, STL_ALIGN);
+#else
+	if(0 != posix_memalign(&ptr, STL_ALIGN, bytes))
+	{
+		ptr = NULL;
+	}
+#endif
+
+	return ptr;
+}
+
+void _stl_free_aligned(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+const stl_facet_t *_stl_get_facets(const stl_t *stl, size_t first, size_t count, stl_facet_t *tmp)
+{
+	if(NULL == stl->facets)
+	{
+		_stl_decode_facets(stl->mapped_facets + first * STL_FACET_SIZE, tmp, count);
+	}
+	else if(NULL == stl->pending)
+	{
+		return &stl->facets[first];
+	}
+	else
+	{
+		memcpy(tmp, &stl->facets[first], count * sizeof(tmp[0]));
+	}
+
+	if(NULL != stl->pending)
+	{
+		_stl_xform_facets(stl->pending, tmp, count);
+	}
+
+	return tmp;
+}
+
+const stl_facet_t *_stl_get_facet(const stl_t *stl, size_t i, stl_facet_t *tmp)
+{
+	return _stl_get_facets(stl, i, 1, tmp);
+}
+
+stl_error_t stl_get_facets(const stl_t *stl, size_t first, size_t count, stl_facet_t *facets)
+{
+	stl_error_t       error = STL_SUCCESS;
+	const stl_facet_t *src = NULL;
+
+	if((NULL == stl) || ((NULL == facets) && (0 != count)) ||
+		(first > stl->facets_count) || (count > stl->facets_count - first))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if((STL_SUCCESS == error) && (0 != count))
+	{
+		src = _stl_get_facets(stl, first, count, facets);
+		if(src != facets)
+		{
+			memcpy(facets, src, count * sizeof(facets[0]));
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
 
-static void _rot_vec_x(double cs, double sn, stl_vertex_t *vertex)
+stl_error_t _stl_make_writable(stl_t *stl)
 {
-	double py = 0.0;
-	double pz = 0.0;
+	stl_error_t  error = STL_SUCCESS;
+	stl_facet_t  *facets = NULL;
 
-	py = (double)vertex->y * cs - vertex->z * sn;
-	pz = (double)vertex->y * sn + vertex->z * cs;
+	if(NULL == stl)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
 
-	vertex->y = (float)py;
-	vertex->z = (float)pz;
+	/* The caller is about to change the facets */
+	if(STL_SUCCESS == error)
+	{
+		stl->has_bounds = 0;
+	}
+
+	/* Nothing to do unless this is a view of a mapped file */
+	if((STL_SUCCESS == error) && (NULL != stl->mapped_facets))
+	{
+		facets = (stl_facet_t *)_stl_alloc_array(stl->facets_count, sizeof(stl_facet_t));
+		if(NULL == facets)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+		else
+		{
+			_stl_decode_facets(stl->mapped_facets, facets, stl->facets_count);
+
+			_stl_unmap(stl->map_base, stl->map_size);
+
+			stl->facets = facets;
+			stl->mapped_facets = NULL;
+			stl->map_base = NULL;
+			stl->map_size = 0;
+		}
+	}
+
+	/* Catch up on a deferred transform before anything else moves them */
+	if((STL_SUCCESS == error) && (NULL != stl->pending))
+	{
+		_stl_xform_facets(stl->pending, stl->facets, stl->facets_count);
+
+		free(stl->pending);
+		stl->pending = NULL;
+	}
+
+	return STL_LOG_ERR(error);
 }
 
 
-static void _rot_vec_y(double cs, double sn, stl_vertex_t *vertex)
+/* The matrix for stl_rotate(). Anything that isn't x or y has always
+ * meant z.
+ */
+static stl_error_t stl_axis_matrix(stl_axis_t axis, float degrees, double m[16])
 {
-	double px = 0.0;
-	double pz = 0.0;
+	stl_error_t  error = STL_SUCCESS;
+
+	error = stl_matrix_identity(m);
 
-	px = (double)vertex->x * cs + vertex->z * sn;
-	pz = -(double)vertex->x * sn + vertex->z * cs;
+	if(STL_SUCCESS == error)
+	{
+		error = stl_matrix_rotate(m,
+			(STL_AXIS_X == axis) ? 1.0 : 0.0,
+			(STL_AXIS_Y == axis) ? 1.0 : 0.0,
+			((STL_AXIS_X != axis) && (STL_AXIS_Y != axis)) ? 1.0 : 0.0,
+			degrees);
+	}
 
-	vertex->x = (float)px;
-	vertex->z = (float)pz;
+	return STL_LOG_ERR(error);
 }
 
-static void _rot_vec_z(double cs, double sn, stl_vertex_t *vertex)
+stl_error_t stl_rotate_facets(stl_axis_t axis, float degrees, stl_facet_t *facets, size_t facets_count)
 {
-	double px = 0.0;
-	double py = 0.0;
-	
-	px = (double)vertex->x * cs - vertex->y * sn;
-	py = (double)vertex->x * sn + vertex->y * cs;
+	stl_error_t  error = STL_SUCCESS;
+	double       m[16];
+
+	error = stl_axis_matrix(axis, degrees, m);
 
-	vertex->x = (float)px;
-	vertex->y = (float)py;
+	if(STL_SUCCESS == error)
+	{
+		error = stl_transform_facets(m, facets, facets_count);
+	}
+
+	return STL_LOG_ERR(error);
 }
 
 stl_error_t stl_rotate(stl_axis_t axis, float degrees, stl_t *stl)
+{
+	return stl_rotate_ctx(NULL, axis, degrees, stl);
+}
+
+/* An odd number of negative scales mirrors the facets and turns them inside
+ * out, swap two corners so the winding still agrees with the normal
+ */
+static int stl_scale_flips(const float scale[3])
+{
+	return (scale[0] < 0.0f) ^ (scale[1] < 0.0f) ^ (scale[2] < 0.0f);
+}
+
+static void stl_flip_facets(stl_facet_t *facets, size_t facets_count)
+{
+	size_t       i = 0;
+	stl_vertex_t tmp;
+
+	for(i = 0; i < facets_count; i++)
+	{
+		tmp = facets[i].verticies[1];
+		facets[i].verticies[1] = facets[i].verticies[2];
+		facets[i].verticies[2] = tmp;
+	}
+}
+
+stl_error_t stl_scale_facets(double pct_x, double pct_y, double pct_z, stl_facet_t *facets, size_t facets_count)
 {
 	stl_error_t  error = STL_SUCCESS;
-	unsigned int i = 0;
-	double       radians = 0.0;
-	double       cs = 0.0;
-	double       sn = 0.0;
+	float        scale[3];
 
-	if(NULL == stl)
+	if((NULL == facets) && (0 != facets_count))
 	{
 		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		radians = deg2rad(degrees);
-		cs = cos(radians);
-		sn = sin(radians);
+		scale[0] = (float)(pct_x / 100.0);
+		scale[1] = (float)(pct_y / 100.0);
+		scale[2] = (float)(pct_z / 100.0);
 
-		/* TODO - The elegant way to do this is to set up a rotation matrix,
-		 * which will also let us rotate around any vector. Do this.
-		 */
-		for(i = 0; i < stl->facets_count; i++)
+		/* The scale zeroes the normals, then they're worked out again */
+		_stl_scale_facets(scale, facets, facets_count);
+
+		if(stl_scale_flips(scale))
 		{
-			if(STL_AXIS_X == axis)
-			{
-				_rot_vec_x(cs, sn, &stl->facets[i].normal);
-				_rot_vec_x(cs, sn, &stl->facets[i].verticies[0]);
-				_rot_vec_x(cs, sn, &stl->facets[i].verticies[1]);
-				_rot_vec_x(cs, sn, &stl->facets[i].verticies[2]);
-			}
-			else if(STL_AXIS_Y == axis)
-			{
-				_rot_vec_y(cs, sn, &stl->facets[i].normal);
-				_rot_vec_y(cs, sn, &stl->facets[i].verticies[0]);
-				_rot_vec_y(cs, sn, &stl->facets[i].verticies[1]);
-				_rot_vec_y(cs, sn, &stl->facets[i].verticies[2]);
-			}
-			else
-			{
-				/* axis == z */
-				_rot_vec_z(cs, sn, &stl->facets[i].normal);
-				_rot_vec_z(cs, sn, &stl->facets[i].verticies[0]);
-				_rot_vec_z(cs, sn, &stl->facets[i].verticies[1]);
-				_rot_vec_z(cs, sn, &stl->facets[i].verticies[2]);
-			}
+			stl_flip_facets(facets, facets_count);
 		}
+
+		_stl_normals_facets(facets, facets_count);
 	}
 
 	return STL_LOG_ERR(error);
 }
 
 stl_error_t stl_scale(double pct_x, double pct_y, double pct_z, stl_t *stl)
+{
+	return stl_scale_ctx(NULL, pct_x, pct_y, pct_z, stl);
+}
+
+stl_error_t stl_rotate_ctx(stl_ctx_t *ctx, stl_axis_t axis, float degrees, stl_t *stl)
 {
 	stl_error_t  error = STL_SUCCESS;
-	unsigned int i = 0;
-	double       scale_x = pct_x / 100.0;
-	double       scale_y = pct_y / 100.0;
-	double       scale_z = pct_z / 100.0;
+	double       m[16];
+
+	error = stl_axis_matrix(axis, degrees, m);
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_transform_ctx(ctx, m, stl);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+typedef struct
+{
+	stl_facet_t *facets;
+	float       scale[3];
+	int         flip;
+	int         normals;
+} stl_scale_job_t;
+
+/* The normals are done chunk by chunk right after the scale, while the
+ * chunk is still in cache
+ */
+static void stl_scale_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_scale_job_t *job = (stl_scale_job_t *)arg;
+
+	_stl_scale_facets(job->scale, job->facets + first, count);
+
+	if(job->flip)
+	{
+		stl_flip_facets(job->facets + first, count);
+	}
+
+	if(job->normals)
+	{
+		_stl_normals_facets(job->facets + first, count);
+	}
+}
+
+/* The corners get the same float multiply as every vertex did, so the
+ * scaled box is exactly the box of the scaled vertices
+ */
+static void stl_scale_bounds(const float scale[3], stl_t *stl)
+{
+	stl_vertex_t lo = stl->bounds_min;
+	stl_vertex_t hi = stl->bounds_max;
+
+	lo.x *= scale[0];
+	lo.y *= scale[1];
+	lo.z *= scale[2];
+
+	hi.x *= scale[0];
+	hi.y *= scale[1];
+	hi.z *= scale[2];
+
+	/* A negative scale turns the box round */
+	stl->bounds_min.x = (scale[0] < 0.0f) ? hi.x : lo.x;
+	stl->bounds_min.y = (scale[1] < 0.0f) ? hi.y : lo.y;
+	stl->bounds_min.z = (scale[2] < 0.0f) ? hi.z : lo.z;
+
+	stl->bounds_max.x = (scale[0] < 0.0f) ? lo.x : hi.x;
+	stl->bounds_max.y = (scale[1] < 0.0f) ? lo.y : hi.y;
+	stl->bounds_max.z = (scale[2] < 0.0f) ? lo.z : hi.z;
+}
+
+stl_error_t stl_scale_ctx(stl_ctx_t *ctx, double pct_x, double pct_y, double pct_z, stl_t *stl)
+{
+	stl_error_t     error = STL_SUCCESS;
+	int             had_bounds = 0;
+	stl_scale_job_t job;
 
 	if(NULL == stl)
 	{
@@ -306,44 +724,117 @@ stl_error_t stl_scale(double pct_x, double pct_y, double pct_z, stl_t *stl)
 
 	if(STL_SUCCESS == error)
 	{
-		for(i = 0; i < stl->facets_count; i++)
+		had_bounds = stl->has_bounds;
+		error = _stl_make_writable(stl);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		job.facets = stl->facets;
+		job.scale[0] = (float)(pct_x / 100.0);
+		job.scale[1] = (float)(pct_y / 100.0);
+		job.scale[2] = (float)(pct_z / 100.0);
+		job.flip = stl_scale_flips(job.scale);
+		job.normals = !stl->no_auto_normals;
+
+		_stl_ctx_run(ctx, stl->facets_count, STL_CTX_CHUNK_FACETS, stl_scale_chunk, &job);
+
+		if(had_bounds)
 		{
-			stl->facets[i].verticies[0].x *= (float)scale_x;
-			stl->facets[i].verticies[0].y *= (float)scale_y;
-			stl->facets[i].verticies[0].z *= (float)scale_z;
-
-			stl->facets[i].verticies[1].x *= (float)scale_x;
-			stl->facets[i].verticies[1].y *= (float)scale_y;
-			stl->facets[i].verticies[1].z *= (float)scale_z;
-
-			stl->facets[i].verticies[2].x *= (float)scale_x;
-			stl->facets[i].verticies[2].y *= (float)scale_y;
-			stl->facets[i].verticies[2].z *= (float)scale_z;
-
-			/* TODO - recalc the normal vector when scaling */
-			stl->facets[i].normal.x = 0.0;
-			stl->facets[i].normal.y = 0.0;
-			stl->facets[i].normal.z = 0.0;
+			stl_scale_bounds(job.scale, stl);
+			stl->has_bounds = 1;
 		}
 	}
 
 	return STL_LOG_ERR(error);
 }
 
-/* TODO - generate unit vector, you know using math and stuff
- */
-stl_error_t stl_gen_normal_vector(stl_vertex_t *verticies, stl_vertex_t *normal)
+static void stl_normals_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_facet_t *facets = (stl_facet_t *)arg;
+
+	_stl_normals_facets(facets + first, count);
+}
+
+stl_error_t stl_gen_normals_ctx(stl_ctx_t *ctx, stl_t *stl)
 {
 	stl_error_t  error = STL_SUCCESS;
+	int          had_bounds = 0;
+
+	if(NULL == stl)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		had_bounds = stl->has_bounds;
+		error = _stl_make_writable(stl);
+	}
+
+	/* Only the normals change, the corners and so the bounds stay put */
+	if(STL_SUCCESS == error)
+	{
+		_stl_ctx_run(ctx, stl->facets_count, STL_CTX_CHUNK_FACETS, stl_normals_chunk, stl->facets);
+		stl->has_bounds = had_bounds;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_gen_normals(stl_t *stl)
+{
+	return stl_gen_normals_ctx(NULL, stl);
+}
+
+stl_error_t stl_gen_normals_facets(stl_facet_t *facets, size_t facets_count)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if((NULL == facets) && (0 != facets_count))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		_stl_normals_facets(facets, facets_count);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_gen_normal_vector(stl_vertex_t *verticies, stl_vertex_t *normal)
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_facet_t facet;
 
 	if((NULL == verticies) || (NULL == normal))
 	{
 		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
 	}
 
-	normal->x = 0.0;
-	normal->y = 0.0;
-	normal->z = 0.0;
+	if(STL_SUCCESS == error)
+	{
+		/* Through the same kernel as whole arrays so the answer is the same */
+		memcpy(facet.verticies, verticies, sizeof(facet.verticies));
+		_stl_normals_facets(&facet, 1);
+
+		*normal = facet.normal;
+	}
 
 	return STL_LOG_ERR(error);
 }
+
+void stl_set_auto_normals(stl_t *stl, int enabled)
+{
+	if(NULL != stl)
+	{
+		stl->no_auto_normals = (0 == enabled);
+	}
+}
+
+int stl_get_auto_normals(const stl_t *stl)
+{
+	return (NULL != stl) && !stl->no_auto_normals;
+}
@@ -1,6 +1,8 @@
 #ifndef _STL3D_LIB_H
 #define _STL3D_LIB_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -16,6 +18,7 @@ extern "C"{
 #define STL_ERROR_IO_ERROR     2
 #define STL_ERROR_MEMORY_ERROR 3
 #define STL_ERROR_UNSUPPORTED  4
+#define STL_ERROR_STALE        5
 
 typedef unsigned int stl_error_t;
 
@@ -39,9 +42,21 @@ typedef unsigned int stl_axis_t;
 
 #define STL_HEADER_SIZE 80
 
+/* Size of one facet as stored in a binary STL file (12 floats plus the
+ * 2 byte attribute count), and the offset of the first facet in the file.
+ */
+#define STL_FACET_SIZE    50
+#define STL_FACETS_OFFSET (STL_HEADER_SIZE + 4)
+
+/* The count in a binary file is 32 bits, so this is the most facets one can
+ * hold. Objects in memory can be bigger, but fail to save as binary.
+ */
+#define STL_MAX_FILE_FACETS 0xFFFFFFFFu
+
 /* STL file format taken from https://en.wikipedia.org/wiki/STL_(file_format)
  *
- * At the moment this only handles binary STL files, not ASCII.
+ * Both binary and ASCII STL files can be read. Objects are always held (and
+ * written) in the binary layout below.
  */
 
 typedef struct
@@ -63,10 +78,165 @@ typedef struct
 typedef struct
 {
 	unsigned char header[STL_HEADER_SIZE];
-	unsigned int facets_count;
-	stl_facet_t  *facets;
+	size_t        facets_count;
+	stl_facet_t   *facets;
+
+	/* Only used by objects created with stl_map_file(). While the object is
+	 * a read-only view of the file, facets is NULL and mapped_facets points
+	 * at the packed on-disk facets. The first call that modifies the object
+	 * copies the facets to the heap and drops the mapping.
+	 */
+	const unsigned char *mapped_facets;
+	void                *map_base;
+	size_t              map_size;
+
+	/* Set by stl_map_cache(), where facets points into the (copy on write)
+	 * mapping rather than at its own allocation.
+	 */
+	int                 facets_in_map;
+
+	/* Bounding box of all the vertices, only valid while has_bounds is set.
+	 * See stl_get_bounds(). Anything that changes stl->facets directly must
+	 * clear has_bounds.
+	 */
+	int                 has_bounds;
+	stl_vertex_t        bounds_min;
+	stl_vertex_t        bounds_max;
+
+	/* Set by stl_transform_deferred(), a transform the facets haven't had
+	 * applied yet. Anything that reads the facets through the library sees
+	 * them with it applied; call stl_flush_transform() before reading
+	 * stl->facets directly.
+	 */
+	struct _stl_xform_s *pending;
+
+	/* Set by stl_set_auto_normals(stl, 0) */
+	int                 no_auto_normals;
 } stl_t;
 
+/* The same mesh held as a structure of arrays, so passes over one
+ * coordinate at a time read contiguous floats. Corner j of facet i is at
+ * index 3 * i + j of x, y and z, its normal and attribute count at index
+ * i of the others. Every array starts on a 64 byte boundary.
+ *
+ * Create with stl_soa_new() or stl_to_soa(), free with stl_soa_free().
+ */
+typedef struct
+{
+	unsigned char  header[STL_HEADER_SIZE];
+	size_t         facets_count;
+
+	float          *x;
+	float          *y;
+	float          *z;
+
+	float          *normal_x;
+	float          *normal_y;
+	float          *normal_z;
+
+	unsigned short *abc;
+
+	/* The one allocation all the arrays are carved from */
+	void           *block;
+} stl_soa_t;
+
+/* Filled in by stl_compute_stats() */
+typedef struct
+{
+	size_t       facets_count;
+	stl_vertex_t bounds_min;
+	stl_vertex_t bounds_max;
+
+	double       surface_area;
+
+	/* Positive when the facets wind counter clockwise seen from outside,
+	 * as they should. Only means anything for a closed mesh.
+	 */
+	double       volume;
+
+	/* Centre of the solid, or of the surface if the volume comes out as
+	 * zero
+	 */
+	double       centroid[3];
+
+	/* Facets with no area, or with corners that aren't numbers. They're
+	 * left out of everything above except the bounds.
+	 */
+	size_t       degenerate_facets;
+} stl_stats_t;
+
+/* Filled in by stl_compute_obb(), a box turned to fit the mesh */
+typedef struct
+{
+	double centre[3];
+
+	/* Unit length, at right angles and right handed, along the longest
+	 * side first
+	 */
+	double axes[3][3];
+
+	/* Length of the box along each of the axes */
+	double size[3];
+
+	double volume;
+} stl_obb_t;
+
+/* The same mesh packed small, for holding lots of them at once when exact
+ * floats aren't needed. Each corner coordinate is kept as a 16 bit step
+ * across the bounding box the mesh had when it was packed, so unpacked
+ * corners are within half a step (1/131070 of the box) of the originals.
+ * Normals are kept as two 16 bit numbers (octahedral encoding) if asked
+ * for, otherwise they're worked out from the corners when unpacked.
+ * Attribute counts are only kept if some facet has one.
+ *
+ * Transforms don't touch the packed corners, they're folded into matrix,
+ * so they're cheap and don't lose anything however many are applied.
+ *
+ * Create with stl_to_compact(), free with stl_compact_free().
+ */
+typedef struct
+{
+	unsigned char  header[STL_HEADER_SIZE];
+	size_t         facets_count;
+
+	/* Top three rows of the 4x4 matrix that takes a packed corner
+	 * (qx, qy, qz, 1) to the real one
+	 */
+	double         matrix[12];
+
+	/* Nine per facet, x, y and z of each corner in turn */
+	unsigned short *corners;
+
+	/* Two per facet, or NULL if the normals weren't kept */
+	unsigned short *normals;
+
+	/* One per facet, or NULL if they were all 0 */
+	unsigned short *abc;
+} stl_compact_t;
+
+
+/* Handles used to stream facets through a file without holding the whole
+ * STL object in memory. See stl_reader_open() and stl_writer_open().
+ */
+typedef struct stl_reader_s stl_reader_t;
+typedef struct stl_writer_s stl_writer_t;
+
+/* Push parser for binary STL data that arrives in pieces (sockets, pipes).
+ * See stl_parser_new().
+ */
+typedef struct stl_parser_s stl_parser_t;
+
+/* A pool of worker threads kept around for the *_ctx() functions, see
+ * stl_ctx_new()
+ */
+typedef struct stl_ctx_s stl_ctx_t;
+
+/* Called by the push parser with each batch of complete facets. Returning
+ * anything other than STL_SUCCESS stops the parser and is passed back to
+ * the caller of stl_parser_feed().
+ */
+typedef stl_error_t (*stl_facets_cb_t)(const stl_facet_t *facets, size_t count, void *arg);
+
 
 #if 1
 
@@ -81,41 +251,302 @@ int _log_err(int error, char *file, int line);
 
 /* Create a new empty STL object with the specified number of fascents allocated
  */
-stl_error_t stl_new(stl_t **stl, unsigned int fascets_count);
+stl_error_t stl_new(stl_t **stl, size_t fascets_count);
 
 /* Free the STL object that was created by stl_read_file()
  */
 void stl_free(stl_t *stl);
 
-/* Open and read an STL file into an STL object
+/* Open and read an STL file into an STL object. ASCII files are detected
+ * and parsed automatically, as are gzip compressed files.
  */
 stl_error_t stl_read_file(char *input_file, stl_t **stl_new);
 
+/* Same as stl_read_file(), but the facets are read and unpacked by several
+ * threads at once, each handling its own range of the file. Passing 0 for
+ * threads uses one thread per CPU.
+ */
+stl_error_t stl_read_file_parallel(char *input_file, unsigned int threads, stl_t **stl_new);
+
+/* Map a binary STL file into memory and return an STL object that is a
+ * read-only view of it. Nothing is copied until the object is modified
+ * (stl_rotate(), stl_scale(), ...). Free the object with stl_free().
+ */
+stl_error_t stl_map_file(char *input_file, stl_t **stl_new);
+
 /* Create and write a new STL file using the supplied
  * STL object. This function will fail if the output
- * file already exists.
+ * file already exists. If the name ends in ".gz" the
+ * file is gzip compressed.
  */
 stl_error_t stl_write_file(char *output_file, stl_t *stl);
 
+/* Flags for stl_write_file_ex()
+ *
+ * STL_WRITE_ATOMIC: Write to a temp file next to the output and only move it
+ *                   into place once it is complete and synced to disk. Other
+ *                   jobs never see a partial file.
+ * STL_WRITE_DIRECT: Bypass the page cache (O_DIRECT) where the filesystem
+ *                   allows it. Worth it for multi-GB outputs.
+ */
+#define STL_WRITE_ATOMIC 0x01
+#define STL_WRITE_DIRECT 0x02
+
+/* Same as stl_write_file(), but the full size of the file is preallocated
+ * up front, and flags (STL_WRITE_*) pick how it is written. Fails if the
+ * output file already exists. Compressed (".gz") outputs can't be
+ * preallocated and are written as by stl_write_file() when flags is 0;
+ * any flags on a ".gz" name give STL_ERROR_UNSUPPORTED, as do any flags on
+ * Windows. Bits that aren't an STL_WRITE_* flag give STL_ERROR_INVALID_ARG.
+ */
+stl_error_t stl_write_file_ex(char *output_file, stl_t *stl, unsigned int flags);
+
+/* Same as stl_write_file() but writes an ASCII STL file. Every number is
+ * written with the fewest digits that read back as exactly the same float.
+ */
+stl_error_t stl_write_file_ascii(char *output_file, stl_t *stl);
+
+/* Write a cache file for the STL object. The facets are stored as they are
+ * in memory, along with their bounding box and a checksum, so that
+ * stl_map_cache() can load them with a single mmap() and no parsing. If
+ * source_file is given, its size, inode and modification time (to the
+ * nanosecond where the platform has it) are recorded so a stale cache can be
+ * detected. Fails if the cache file already exists.
+ */
+stl_error_t stl_write_cache(char *cache_file, char *source_file, stl_t *stl);
+
+/* Flags for stl_map_cache()
+ *
+ * STL_CACHE_VERIFY: Check the facets against the checksum (reads the whole
+ *                   file rather than just the pages that get used)
+ */
+#define STL_CACHE_VERIFY 0x01
+
+/* Map a cache file written by stl_write_cache(). If source_file is given
+ * and its size, inode or modification time no longer match the ones recorded,
+ * STL_ERROR_STALE is returned and the cache should be rebuilt. Cache files
+ * from a machine with a different layout give STL_ERROR_UNSUPPORTED, as does
+ * a platform without mmap(). The object can be modified like any other, the
+ * changes never reach the cache file.
+ */
+stl_error_t stl_map_cache(char *cache_file, char *source_file, unsigned int flags, stl_t **stl);
+
+/* Open a binary STL file for reading a batch of facets at a time. The
+ * header and the number of facets in the file are returned through header
+ * (STL_HEADER_SIZE bytes) and facets_count, either of which may be NULL.
+ */
+stl_error_t stl_reader_open(char *input_file, unsigned char *header, size_t *facets_count, stl_reader_t **reader);
+
+/* Read up to max_facets facets into facets. facets_read is set to the number
+ * read, which is 0 once every facet in the file has been returned.
+ */
+stl_error_t stl_reader_next_batch(stl_reader_t *reader, stl_facet_t *facets, size_t max_facets, size_t *facets_read);
+
+/* Close a reader opened with stl_reader_open()
+ */
+void stl_reader_close(stl_reader_t *reader);
+
+/* Pass as facets_count to stl_writer_open() when the number of facets isn't
+ * known up front. Up to STL_MAX_FILE_FACETS facets may then be appended and
+ * the count in the file is filled in by stl_writer_close().
+ */
+#define STL_FACETS_COUNT_DEFERRED ((size_t)-1)
+
+/* Create a new binary STL file that will hold facets_count facets, which are
+ * then added with stl_writer_append(). Like stl_write_file() this fails if
+ * the output file already exists.
+ */
+stl_error_t stl_writer_open(char *output_file, const unsigned char *header, size_t facets_count, stl_writer_t **writer);
+
+/* Append facets to the output file
+ */
+stl_error_t stl_writer_append(stl_writer_t *writer, const stl_facet_t *facets, size_t count);
+
+/* Flush and close the output file. Fails if the number of facets appended
+ * does not match the count given to stl_writer_open(), unless that was
+ * STL_FACETS_COUNT_DEFERRED.
+ */
+stl_error_t stl_writer_close(stl_writer_t *writer);
+
+/* Create a push parser. Data is handed to it with stl_parser_feed() in chunks
+ * of any size, split anywhere (even in the middle of a facet), and callback
+ * is called with facets as soon as they are complete.
+ */
+stl_error_t stl_parser_new(stl_facets_cb_t callback, void *arg, stl_parser_t **parser);
+
+/* Feed the next len bytes of the file to the parser. Once an error comes
+ * back from the callback, or the data turns out to be ASCII, the parser is
+ * stopped and this and the calls below give back that error.
+ */
+stl_error_t stl_parser_feed(stl_parser_t *parser, const unsigned char *data, size_t len);
+
+/* Get the header (STL_HEADER_SIZE bytes) and facet count. Fails until the
+ * first STL_FACETS_OFFSET bytes have been fed. Either output may be NULL.
+ */
+stl_error_t stl_parser_header(stl_parser_t *parser, unsigned char *header, size_t *facets_count);
+
+/* Call once the input has ended. Fails if the data stopped short of the
+ * number of facets given in the file.
+ */
+stl_error_t stl_parser_finish(stl_parser_t *parser);
+
+/* Free a parser created with stl_parser_new()
+ */
+void stl_parser_free(stl_parser_t *parser);
+
+/* Called by stl_pipeline_run() with each batch of facets. The facets can be
+ * changed in place before they are written out.
+ */
+typedef stl_error_t (*stl_batch_cb_t)(stl_facet_t *facets, size_t count, void *arg);
+
+/* Stream a binary STL file through callback into a new output file, with
+ * reading, the callback and writing all running at the same time: a reader
+ * thread and a writer thread do the I/O while callback runs on the calling
+ * thread, with batches passed between them through a ring of buffers. Only
+ * a few batches are held in memory at once. callback may be NULL to just
+ * copy the file. Fails if the output file already exists.
+ */
+stl_error_t stl_pipeline_run(char *input_file, char *output_file, stl_batch_cb_t callback, void *arg);
+
 /* Rotate the STL object along the specified axis the specified
  * number of degrees.
  */
 stl_error_t stl_rotate(stl_axis_t axis, float degrees, stl_t *stl);
 
+/* Same as stl_rotate() but works on an array of facets, such as a batch
+ * returned by stl_reader_next_batch().
+ */
+stl_error_t stl_rotate_facets(stl_axis_t axis, float degrees, stl_facet_t *facets, size_t facets_count);
+
 /* Rotate the stl object along each axis by the specified percentages
  *
- * A value of 100.0 means don't scale that axis.
+ * A value of 100.0 means don't scale that axis. The normals are worked out
+ * again from the scaled corners (see stl_set_auto_normals()). An odd number
+ * of negative scales mirrors the object, and facets are rewound so the
+ * winding still agrees with the normals.
  */
 stl_error_t stl_scale(double pct_x, double pct_y, double pct_z, stl_t *stl);
 
+/* Same as stl_scale() but works on an array of facets
+ */
+stl_error_t stl_scale_facets(double pct_x, double pct_y, double pct_z, stl_facet_t *facets, size_t facets_count);
+
+/* 4x4 transform matrices, row major, applied to points as m * [x y z 1].
+ * Start from stl_matrix_identity(), then each builder adds its step after
+ * whatever the matrix already does, so
+ *
+ *   stl_matrix_identity(m);
+ *   stl_matrix_rotate(m, 1.0, 0.0, 0.0, 90.0);
+ *   stl_matrix_rotate(m, 0.0, 0.0, 1.0, 45.0);
+ *   stl_matrix_scale(m, 200.0, 200.0, 100.0);
+ *   stl_transform(m, stl);
+ *
+ * rotates around x, then z, then scales, in one pass over the facets.
+ */
+stl_error_t stl_matrix_identity(double m[16]);
+
+/* result = a * b, which does b then a. result may be a or b.
+ */
+stl_error_t stl_matrix_multiply(double result[16], const double a[16], const double b[16]);
+
+/* Rotate degrees around the vector (axis_x, axis_y, axis_z) through the
+ * origin. The vector doesn't need to be unit length but can't be zero.
+ */
+stl_error_t stl_matrix_rotate(double m[16], double axis_x, double axis_y, double axis_z, double degrees);
+
+/* Scale each axis by a percentage, 100.0 leaves the axis alone
+ */
+stl_error_t stl_matrix_scale(double m[16], double pct_x, double pct_y, double pct_z);
+
+stl_error_t stl_matrix_translate(double m[16], double x, double y, double z);
+
+/* Mirror across the plane through the origin at right angles to axis
+ */
+stl_error_t stl_matrix_mirror(double m[16], stl_axis_t axis);
+
+/* Apply an affine transform to every facet. Normals are transformed by the
+ * inverse transpose and kept unit length (zero normals stay zero), and
+ * facets are rewound when the transform mirrors them.
+ */
+stl_error_t stl_transform(const double m[16], stl_t *stl);
+
+/* Same as stl_transform() but works on an array of facets
+ */
+stl_error_t stl_transform_facets(const double m[16], stl_facet_t *facets, size_t facets_count);
+
+/* Same as stl_transform() but the facets are left alone for now. The
+ * transform is applied on the fly by the writers, the stats and
+ * stl_get_facets(), so a load, transform, save job only goes over the
+ * facets once. Deferring several transforms combines them into one.
+ *
+ * Anything that changes the facets applies the transform first.
+ */
+stl_error_t stl_transform_deferred(const double m[16], stl_t *stl);
+
+/* Apply any deferred transform to stl->facets now
+ */
+stl_error_t stl_flush_transform(stl_t *stl);
+
+/* Copy count facets from first on into facets, as they'd be with any
+ * deferred transform applied. Works on mapped objects too.
+ */
+stl_error_t stl_get_facets(const stl_t *stl, size_t first, size_t count, stl_facet_t *facets);
+
+/* Number of ways up stl_auto_orient() tries when asked for 0
+ */
+#define STL_ORIENT_CANDIDATES 1000
+
+/* Look for the way up that prints best. candidates directions are tried as
+ * up, the six axes first and the rest spread evenly over a sphere, and each
+ * is scored on
+ *
+ *   height_weight * height / height of the tallest candidate
+ *     + overhang_weight * overhang / surface area
+ *
+ * where the overhang is the area facing more than 45 degrees below
+ * horizontal, projected onto the bed. Facets lying on the bed don't count.
+ * The lowest score wins, the earliest one on a tie (so a part already
+ * sitting its best way up is left as it is), and m gets the rotation that
+ * stands it that way up, ready for stl_transform().
+ */
+stl_error_t stl_auto_orient(stl_t *stl, unsigned int candidates, double height_weight, double overhang_weight, double m[16]);
+
+/* Instruction sets the transform kernels can use. STL_SIMD_AUTO picks the
+ * best one the CPU supports, which is the default.
+ */
+#define STL_SIMD_AUTO    0
+#define STL_SIMD_SCALAR  1
+#define STL_SIMD_SSE2    2
+#define STL_SIMD_AVX2    3
+#define STL_SIMD_AVX512  4
+
+typedef unsigned int stl_simd_t;
+
+/* Largest difference between the results of any two STL_SIMD_ levels, as a
+ * fraction of the coordinate. They all do the same arithmetic in the same
+ * order, so there is none; only the bits of a NaN coming out of NaN or
+ * infinite input can differ.
+ */
+#define STL_SIMD_TOLERANCE 0.0
+
+/* Choose the kernels used by stl_transform(), stl_rotate(), stl_scale()
+ * and friends for the whole process. Returns STL_ERROR_UNSUPPORTED if the
+ * CPU (or the build) can't run that level.
+ */
+stl_error_t stl_set_simd(stl_simd_t level);
+
+/* The level in use
+ */
+stl_simd_t stl_get_simd(void);
+
 /* Make an STL object from a file containing 8 bit unsigned grayscale values
  */
 stl_error_t
 stl_from_heightmap_uchar_file(
 	char *filename,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
@@ -128,8 +559,8 @@ stl_error_t
 stl_from_heightmap_uchar(
 	const unsigned char *vals,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
@@ -142,8 +573,8 @@ stl_error_t
 stl_from_heightmap_char(
 	const signed char *vals,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
@@ -160,14 +591,30 @@ stl_error_t
 stl_from_heightmap_double(
 	const double *vals,
 	stl_origin_t origin,
-	unsigned int cols,
-	unsigned int rows,
+	size_t cols,
+	size_t rows,
 	double scale_pct,
 	double base_height,
 	double units_per_pixel,
 	stl_t **stl
 	);
 
+/* Same as stl_from_heightmap_double() but the facets are streamed straight to
+ * a new binary STL file instead of being held in memory. Nothing is left at
+ * output_file if it fails.
+ */
+stl_error_t
+stl_write_heightmap_double(
+	char *output_file,
+	const double *vals,
+	stl_origin_t origin,
+	size_t cols,
+	size_t rows,
+	double scale_pct,
+	double base_height,
+	double units_per_pixel
+	);
+
 /* Print to stdout the elements of the STL object
  */
 void stl_print(stl_t *stl);
@@ -176,8 +623,144 @@ void stl_print(stl_t *stl);
  */
 void stl_print_stats(stl_t *stl);
 
+/* The box lined up with the axes around every vertex. It's worked out the
+ * first time it's asked for and then kept, so asking again is cheap. Scales,
+ * mirrors, moves and generating normals keep it up to date, anything else
+ * that changes the facets drops it. Objects with no facets have no bounds.
+ */
+stl_error_t stl_get_bounds(stl_t *stl, stl_vertex_t *min, stl_vertex_t *max);
+
+/* Bounds, surface area, volume, centroid and degenerate facet count in one
+ * pass, shared across the CPUs for big meshes. The sums are compensated
+ * and always added up in the same order, so the results are the same
+ * whatever the number of threads.
+ */
+stl_error_t stl_compute_stats(stl_t *stl, stl_stats_t *stats);
+
+/* A tight box around every corner, turned to whatever angle fits best. The
+ * principal axes of the surface are a first guess, which is then turned a
+ * little at a time to shrink the box around points on the convex hull. The
+ * box is never bigger than the one lined up with the axes, and comes out
+ * the same whatever the number of threads. Objects with no facets get an
+ * empty box, ones with no finite corners give STL_ERROR_UNSUPPORTED.
+ */
+stl_error_t stl_compute_obb(stl_t *stl, stl_obb_t *obb);
+
+/* Create a new zeroed structure of arrays object with room for
+ * facets_count facets
+ */
+stl_error_t stl_soa_new(stl_soa_t **soa_new, size_t facets_count);
+
+void stl_soa_free(stl_soa_t *soa);
+
+/* Convert between the two layouts. The original is left as it was.
+ */
+stl_error_t stl_to_soa(stl_t *stl, stl_soa_t **soa_new);
+stl_error_t stl_from_soa(stl_soa_t *soa, stl_t **stl_new);
+
+/* Same as stl_transform(), with the same results, on a structure of
+ * arrays object
+ */
+stl_error_t stl_soa_transform(const double m[16], stl_soa_t *soa);
+
+/* Same as stl_print_stats() on a structure of arrays object
+ */
+void stl_soa_print_stats(stl_soa_t *soa);
+
+/* Write a structure of arrays object as a binary STL file, packing it a
+ * block at a time. Fails if the output file already exists.
+ */
+stl_error_t stl_soa_write_file(char *output_file, stl_soa_t *soa);
+
+/* Flags for stl_to_compact()
+ *
+ * STL_COMPACT_NORMALS: Keep the normals (4 more bytes a facet) rather than
+ *                      working them out again from the corners
+ */
+#define STL_COMPACT_NORMALS 0x01
+
+/* Pack an object into the compact form. The original is left as it was.
+ * Objects with corners that aren't finite numbers can't be packed and give
+ * STL_ERROR_UNSUPPORTED.
+ */
+stl_error_t stl_to_compact(stl_t *stl, unsigned int flags, stl_compact_t **compact_new);
+
+/* Unpack into a new object. Normals that weren't kept are worked out from
+ * the corners.
+ */
+stl_error_t stl_from_compact(stl_compact_t *compact, stl_t **stl_new);
+
+void stl_compact_free(stl_compact_t *compact);
+
+/* Bytes the compact object takes up, for comparing with facets_count *
+ * sizeof(stl_facet_t)
+ */
+size_t stl_compact_size(stl_compact_t *compact);
+
+/* Same as stl_transform() on a compact object, done by changing
+ * compact->matrix. Normals that were kept are moved through the transform
+ * and packed again.
+ */
+stl_error_t stl_compact_transform(const double m[16], stl_compact_t *compact);
+
+/* Same as stl_compute_stats() on a compact object, with the same results as
+ * unpacking it first
+ */
+stl_error_t stl_compact_compute_stats(stl_compact_t *compact, stl_stats_t *stats);
+
+/* Create a context with a pool of threads (counting the caller) for the
+ * *_ctx() functions to share their work across. Passing 0 for threads
+ * uses one thread per CPU. The threads wait around until stl_ctx_free().
+ *
+ * The *_ctx() functions cut the facets into cache sized chunks, and give
+ * exactly the same results as the plain versions whatever the number of
+ * threads. A NULL ctx runs everything on the calling thread. A context
+ * runs one call at a time; calls on the same context from several threads
+ * take turns.
+ */
+stl_error_t stl_ctx_new(stl_ctx_t **ctx_new, unsigned int threads);
+
+void stl_ctx_free(stl_ctx_t *ctx);
+
+/* Number of threads the context has, which may be fewer than asked for if
+ * the system ran out
+ */
+unsigned int stl_ctx_threads(stl_ctx_t *ctx);
+
+stl_error_t stl_rotate_ctx(stl_ctx_t *ctx, stl_axis_t axis, float degrees, stl_t *stl);
+stl_error_t stl_scale_ctx(stl_ctx_t *ctx, double pct_x, double pct_y, double pct_z, stl_t *stl);
+stl_error_t stl_transform_ctx(stl_ctx_t *ctx, const double m[16], stl_t *stl);
+void stl_print_stats_ctx(stl_ctx_t *ctx, stl_t *stl);
+stl_error_t stl_get_bounds_ctx(stl_ctx_t *ctx, stl_t *stl, stl_vertex_t *min, stl_vertex_t *max);
+stl_error_t stl_compute_stats_ctx(stl_ctx_t *ctx, stl_t *stl, stl_stats_t *stats);
+stl_error_t stl_compact_compute_stats_ctx(stl_ctx_t *ctx, stl_compact_t *compact, stl_stats_t *stats);
+stl_error_t stl_compute_obb_ctx(stl_ctx_t *ctx, stl_t *stl, stl_obb_t *obb);
+stl_error_t stl_auto_orient_ctx(stl_ctx_t *ctx, stl_t *stl, unsigned int candidates, double height_weight, double overhang_weight, double m[16]);
+
+/* Work out the normal of every facet from its corners: the cross product
+ * of the edges from the first corner to the other two, at unit length.
+ * Facets with no area get a zero normal.
+ */
+stl_error_t stl_gen_normals(stl_t *stl);
+stl_error_t stl_gen_normals_ctx(stl_ctx_t *ctx, stl_t *stl);
+
+/* Same as stl_gen_normals() but works on an array of facets
+ */
+stl_error_t stl_gen_normals_facets(stl_facet_t *facets, size_t facets_count);
+
+/* The normal of one facet from its three corners
+ */
 stl_error_t stl_gen_normal_vector(stl_vertex_t *verticies, stl_vertex_t *normal);
 
+/* stl_scale() and stl_scale_ctx() work the normals out again from the
+ * scaled corners. Callers that don't use normals can turn that off for one
+ * object, and its normals are left zero by a scale instead. On for every
+ * new object. The heightmap functions and stl_scale_facets() always work
+ * the normals out.
+ */
+void stl_set_auto_normals(stl_t *stl, int enabled);
+int stl_get_auto_normals(const stl_t *stl);
+
 #ifdef __cplusplus
 }
 #endif
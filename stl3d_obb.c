@@ -0,0 +1,891 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Oriented bounding boxes. Three passes over the facets, each shared
+ * across the context's threads a chunk at a time with the chunks' results
+ * combined in order afterwards:
+ *
+ * 1. The area weighted covariance of the surface, whose eigenvectors (the
+ *    principal axes) are a first guess at the box, and the box lined up
+ *    with the axes.
+ * 2. The corner furthest out along each of a spread of directions. These
+ *    are all on the convex hull, and stand in for it while the principal
+ *    axes are turned a little at a time to shrink the box around them.
+ * 3. The exact extent of every corner along the axes settled on, so the
+ *    box always holds the whole mesh.
+ *
+ * Corners that aren't finite numbers are left out.
+ */
+
+/* Directions spread over the sphere whose furthest corners stand in for
+ * the hull. The principal axes and the x, y and z axes both ways are
+ * added to these.
+ */
+#define STL_OBB_LATTICE    128
+#define STL_OBB_DIRECTIONS (STL_OBB_LATTICE + 12)
+
+/* First and last step for the turns tried by the search, in radians */
+#define STL_OBB_FIRST_STEP (STL_PI / 4.0)
+#define STL_OBB_LAST_STEP  (STL_PI / 18000.0)
+
+/* Facets fetched at a time within a chunk */
+#define STL_OBB_BLOCK 256
+
+/* Pass 1 totals for one chunk. Second moments are in the order xx, yy,
+ * zz, xy, xz, yz.
+ */
+typedef struct
+{
+	double area;
+	double centre[3];
+	double moment[6];
+
+	/* Plain corner sums, for meshes with no area at all */
+	double corners;
+	double corner_sum[3];
+	double corner_moment[6];
+
+	double min[3];
+	double max[3];
+} stl_obb_part_t;
+
+typedef struct
+{
+	const stl_t    *stl;
+
+	/* Everything is measured from here to keep the numbers small */
+	double         origin[3];
+
+	stl_obb_part_t *parts;
+
+	/* Pass 2: the directions, and per chunk the furthest corner along
+	 * each, chunk c direction k at c * STL_OBB_DIRECTIONS + k
+	 */
+	double         directions[STL_OBB_DIRECTIONS][3];
+	double         *far_value;
+	double         *far_point;
+
+	/* Pass 3: the axes, and per chunk the range along them, six to a
+	 * chunk
+	 */
+	double         axes[3][3];
+	double         *range;
+} stl_obb_calc_t;
+
+static int stl_obb_finite(const double *p)
+{
+	return (fabs(p[0]) < HUGE_VAL) && (fabs(p[1]) < HUGE_VAL) && (fabs(p[2]) < HUGE_VAL);
+}
+
+static double stl_obb_dot(const double *a, const double *b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* Corner j of facet, measured from the origin */
+static void stl_obb_corner(const stl_obb_calc_t *calc, const stl_facet_t *facet, int j, double *p)
+{
+	p[0] = facet->verticies[j].x - calc->origin[0];
+	p[1] = facet->verticies[j].y - calc->origin[1];
+	p[2] = facet->verticies[j].z - calc->origin[2];
+}
+
+/* Add x * (a a') to the second moments m */
+static void stl_obb_moment_add(double *m, const double *a, double x)
+{
+	m[0] += x * a[0] * a[0];
+	m[1] += x * a[1] * a[1];
+	m[2] += x * a[2] * a[2];
+	m[3] += x * a[0] * a[1];
+	m[4] += x * a[0] * a[2];
+	m[5] += x * a[1] * a[2];
+}
+
+/* Hand each block of facets in [first, first + count) to fn */
+static void stl_obb_blocks(const stl_obb_calc_t *calc, size_t first, size_t count, void (*fn)(const stl_obb_calc_t *, size_t, const stl_facet_t *, size_t), size_t chunk_index)
+{
+	size_t            i = 0;
+	size_t            block = 0;
+	const stl_facet_t *facets = NULL;
+	stl_facet_t       tmp[STL_OBB_BLOCK];
+
+	for(i = first; i < first + count; i += block)
+	{
+		block = first + count - i;
+		if(block > STL_OBB_BLOCK)
+		{
+			block = STL_OBB_BLOCK;
+		}
+
+		/* Decodes mapped facets and applies a pending transform on the way */
+		facets = _stl_get_facets(calc->stl, i, block, tmp);
+
+		fn(calc, chunk_index, facets, block);
+	}
+}
+
+static void stl_obb_moments_block(const stl_obb_calc_t *calc, size_t chunk_index, const stl_facet_t *facets, size_t count)
+{
+	stl_obb_part_t *part = &calc->parts[chunk_index];
+	size_t         i = 0;
+	int            j = 0;
+	int            k = 0;
+	int            finite = 0;
+	double         p[3][3];
+	double         c[3];
+	double         n[3];
+	double         area = 0.0;
+
+	for(i = 0; i < count; i++)
+	{
+		finite = 0;
+
+		for(j = 0; j < 3; j++)
+		{
+			stl_obb_corner(calc, &facets[i], j, p[j]);
+
+			if(!stl_obb_finite(p[j]))
+			{
+				continue;
+			}
+
+			finite++;
+
+			part->corners += 1.0;
+			stl_obb_moment_add(part->corner_moment, p[j], 1.0);
+
+			for(k = 0; k < 3; k++)
+			{
+				part->corner_sum[k] += p[j][k];
+				part->min[k] = (p[j][k] < part->min[k]) ? p[j][k] : part->min[k];
+				part->max[k] = (p[j][k] > part->max[k]) ? p[j][k] : part->max[k];
+			}
+		}
+
+		if(3 != finite)
+		{
+			continue;
+		}
+
+		n[0] = (p[1][1] - p[0][1]) * (p[2][2] - p[0][2]) - (p[1][2] - p[0][2]) * (p[2][1] - p[0][1]);
+		n[1] = (p[1][2] - p[0][2]) * (p[2][0] - p[0][0]) - (p[1][0] - p[0][0]) * (p[2][2] - p[0][2]);
+		n[2] = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+
+		area = sqrt(stl_obb_dot(n, n)) / 2.0;
+
+		if(!(area > 0.0))
+		{
+			continue;
+		}
+
+		/* The second moment of a solid triangle about the origin is
+		 * area / 12 * (9 c c' + p0 p0' + p1 p1' + p2 p2'), c its centroid
+		 */
+		for(k = 0; k < 3; k++)
+		{
+			c[k] = (p[0][k] + p[1][k] + p[2][k]) / 3.0;
+			part->centre[k] += area * c[k];
+		}
+
+		part->area += area;
+
+		stl_obb_moment_add(part->moment, c, 9.0 * area / 12.0);
+
+		for(j = 0; j < 3; j++)
+		{
+			stl_obb_moment_add(part->moment, p[j], area / 12.0);
+		}
+	}
+}
+
+static void stl_obb_moments_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_obb_calc_t *calc = (stl_obb_calc_t *)arg;
+	stl_obb_part_t *part = &calc->parts[chunk_index];
+	int            k = 0;
+
+	memset(part, 0x00, sizeof(*part));
+
+	for(k = 0; k < 3; k++)
+	{
+		part->min[k] = HUGE_VAL;
+		part->max[k] = -HUGE_VAL;
+	}
+
+	stl_obb_blocks(calc, first, count, stl_obb_moments_block, chunk_index);
+}
+
+static void stl_obb_far_block(const stl_obb_calc_t *calc, size_t chunk_index, const stl_facet_t *facets, size_t count)
+{
+	double *value = &calc->far_value[chunk_index * STL_OBB_DIRECTIONS];
+	double *point = &calc->far_point[chunk_index * STL_OBB_DIRECTIONS * 3];
+	size_t i = 0;
+	int    j = 0;
+	int    k = 0;
+	double p[3];
+	double d = 0.0;
+
+	for(i = 0; i < count; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			stl_obb_corner(calc, &facets[i], j, p);
+
+			if(!stl_obb_finite(p))
+			{
+				continue;
+			}
+
+			for(k = 0; k < STL_OBB_DIRECTIONS; k++)
+			{
+				d = stl_obb_dot(p, calc->directions[k]);
+
+				if(d > value[k])
+				{
+					value[k] = d;
+					memcpy(&point[3 * k], p, sizeof(p));
+				}
+			}
+		}
+	}
+}
+
+static void stl_obb_far_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_obb_calc_t *calc = (stl_obb_calc_t *)arg;
+	int            k = 0;
+
+	for(k = 0; k < STL_OBB_DIRECTIONS; k++)
+	{
+		calc->far_value[chunk_index * STL_OBB_DIRECTIONS + k] = -HUGE_VAL;
+	}
+
+	stl_obb_blocks(calc, first, count, stl_obb_far_block, chunk_index);
+}
+
+static void stl_obb_range_block(const stl_obb_calc_t *calc, size_t chunk_index, const stl_facet_t *facets, size_t count)
+{
+	double *range = &calc->range[chunk_index * 6];
+	size_t i = 0;
+	int    j = 0;
+	int    k = 0;
+	double p[3];
+	double d = 0.0;
+
+	for(i = 0; i < count; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			stl_obb_corner(calc, &facets[i], j, p);
+
+			if(!stl_obb_finite(p))
+			{
+				continue;
+			}
+
+			for(k = 0; k < 3; k++)
+			{
+				d = stl_obb_dot(p, calc->axes[k]);
+
+				range[k] = (d < range[k]) ? d : range[k];
+				range[3 + k] = (d > range[3 + k]) ? d : range[3 + k];
+			}
+		}
+	}
+}
+
+static void stl_obb_range_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_obb_calc_t *calc = (stl_obb_calc_t *)arg;
+	int            k = 0;
+
+	for(k = 0; k < 3; k++)
+	{
+		calc->range[chunk_index * 6 + k] = HUGE_VAL;
+		calc->range[chunk_index * 6 + 3 + k] = -HUGE_VAL;
+	}
+
+	stl_obb_blocks(calc, first, count, stl_obb_range_block, chunk_index);
+}
+
+/* Eigenvectors of the symmetric matrix a by Jacobi rotations, as the rows
+ * of v. a is destroyed.
+ */
+static void stl_obb_eigen(double a[3][3], double v[3][3])
+{
+	int    sweep = 0;
+	int    p = 0;
+	int    q = 0;
+	int    k = 0;
+	double theta = 0.0;
+	double t = 0.0;
+	double c = 0.0;
+	double s = 0.0;
+	double akp = 0.0;
+	double akq = 0.0;
+
+	memset(v, 0x00, 9 * sizeof(double));
+	v[0][0] = 1.0;
+	v[1][1] = 1.0;
+	v[2][2] = 1.0;
+
+	for(sweep = 0; sweep < 50; sweep++)
+	{
+		if((0.0 == a[0][1]) && (0.0 == a[0][2]) && (0.0 == a[1][2]))
+		{
+			break;
+		}
+
+		for(p = 0; p < 2; p++)
+		{
+			for(q = p + 1; q < 3; q++)
+			{
+				if(0.0 == a[p][q])
+				{
+					continue;
+				}
+
+				/* The rotation that zeroes a[p][q] */
+				theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				c = 1.0 / sqrt(t * t + 1.0);
+				s = t * c;
+
+				for(k = 0; k < 3; k++)
+				{
+					akp = a[k][p];
+					akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+
+				for(k = 0; k < 3; k++)
+				{
+					akp = a[p][k];
+					akq = a[q][k];
+					a[p][k] = c * akp - s * akq;
+					a[q][k] = s * akp + c * akq;
+				}
+
+				for(k = 0; k < 3; k++)
+				{
+					akp = v[p][k];
+					akq = v[q][k];
+					v[p][k] = c * akp - s * akq;
+					v[q][k] = s * akp + c * akq;
+				}
+			}
+		}
+	}
+}
+
+/* Turn axes b and c of the three about the third by angle */
+static void stl_obb_turn(double axes[3][3], int axis, double angle, double out[3][3])
+{
+	int    b = (axis + 1) % 3;
+	int    c = (axis + 2) % 3;
+	int    k = 0;
+	double cs = cos(angle);
+	double sn = sin(angle);
+
+	memcpy(out[axis], axes[axis], sizeof(out[axis]));
+
+	for(k = 0; k < 3; k++)
+	{
+		out[b][k] = cs * axes[b][k] + sn * axes[c][k];
+		out[c][k] = cs * axes[c][k] - sn * axes[b][k];
+	}
+}
+
+/* Make the axes exactly at right angles and unit length again after a lot
+ * of turning, keeping the first as close as it was
+ */
+static void stl_obb_orthonormalize(double axes[3][3])
+{
+	int    j = 0;
+	int    k = 0;
+	double d = 0.0;
+
+	for(j = 0; j < 3; j++)
+	{
+		for(k = 0; k < j; k++)
+		{
+			d = stl_obb_dot(axes[j], axes[k]);
+
+			axes[j][0] -= d * axes[k][0];
+			axes[j][1] -= d * axes[k][1];
+			axes[j][2] -= d * axes[k][2];
+		}
+
+		d = sqrt(stl_obb_dot(axes[j], axes[j]));
+
+		axes[j][0] /= d;
+		axes[j][1] /= d;
+		axes[j][2] /= d;
+	}
+}
+
+/* Side lengths of the box with these axes around count points */
+static void stl_obb_sides(const double *points, size_t count, double axes[3][3], double sides[3])
+{
+	size_t i = 0;
+	int    k = 0;
+	double d = 0.0;
+	double min[3];
+	double max[3];
+
+	for(k = 0; k < 3; k++)
+	{
+		min[k] = HUGE_VAL;
+		max[k] = -HUGE_VAL;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		for(k = 0; k < 3; k++)
+		{
+			d = stl_obb_dot(&points[3 * i], axes[k]);
+
+			min[k] = (d < min[k]) ? d : min[k];
+			max[k] = (d > max[k]) ? d : max[k];
+		}
+	}
+
+	for(k = 0; k < 3; k++)
+	{
+		sides[k] = max[k] - min[k];
+	}
+}
+
+/* Non-zero if box a is smaller than box b: less volume, or the same volume
+ * and less surface, or the same of both and shorter sides added up. A flat
+ * or thin mesh has no volume whichever way the box is turned, so it's the
+ * later two that find its box. Anything that isn't a number is never
+ * smaller.
+ */
+static int stl_obb_smaller(const double a[3], const double b[3])
+{
+	double va = a[0] * a[1] * a[2];
+	double vb = b[0] * b[1] * b[2];
+	double sa = a[0] * a[1] + a[1] * a[2] + a[2] * a[0];
+	double sb = b[0] * b[1] + b[1] * b[2] + b[2] * b[0];
+
+	if(va != vb)
+	{
+		return va < vb;
+	}
+
+	if(sa != sb)
+	{
+		return sa < sb;
+	}
+
+	return (a[0] + a[1] + a[2]) < (b[0] + b[1] + b[2]);
+}
+
+/* Turn the axes a step at a time about each of themselves for as long as
+ * the box around the points keeps shrinking, then try smaller steps.
+ * Leaves the side lengths in sides.
+ */
+static void stl_obb_search(const double *points, size_t count, double axes[3][3], double sides[3])
+{
+	int    axis = 0;
+	int    improved = 0;
+	double step = 0.0;
+	double sign = 0.0;
+	double trial_sides[3];
+	double trial[3][3];
+
+	stl_obb_sides(points, count, axes, sides);
+
+	for(step = STL_OBB_FIRST_STEP; step >= STL_OBB_LAST_STEP; step /= 2.0)
+	{
+		do
+		{
+			improved = 0;
+
+			for(axis = 0; axis < 3; axis++)
+			{
+				for(sign = -1.0; sign <= 1.0; sign += 2.0)
+				{
+					stl_obb_turn(axes, axis, sign * step, trial);
+
+					stl_obb_sides(points, count, trial, trial_sides);
+
+					if(stl_obb_smaller(trial_sides, sides))
+					{
+						memcpy(sides, trial_sides, sizeof(trial_sides));
+						memcpy(axes, trial, sizeof(trial));
+						improved = 1;
+					}
+				}
+			}
+		} while(improved);
+
+		stl_obb_orthonormalize(axes);
+		stl_obb_sides(points, count, axes, sides);
+	}
+}
+
+/* The directions for pass 2: a Fibonacci lattice, then the principal axes
+ * and x, y and z, each both ways
+ */
+static void stl_obb_directions(stl_obb_calc_t *calc, double pca[3][3])
+{
+	int    k = 0;
+	int    j = 0;
+	double r = 0.0;
+	double angle = 0.0;
+	double *d = NULL;
+
+	for(k = 0; k < STL_OBB_LATTICE; k++)
+	{
+		d = calc->directions[k];
+
+		d[2] = 1.0 - (2.0 * k + 1.0) / STL_OBB_LATTICE;
+		r = sqrt(1.0 - d[2] * d[2]);
+
+		/* The golden angle, pi * (3 - sqrt(5)) */
+		angle = k * (STL_PI * (3.0 - sqrt(5.0)));
+
+		d[0] = r * cos(angle);
+		d[1] = r * sin(angle);
+	}
+
+	for(j = 0; j < 3; j++)
+	{
+		for(k = 0; k < 3; k++)
+		{
+			calc->directions[STL_OBB_LATTICE + j][k] = pca[j][k];
+			calc->directions[STL_OBB_LATTICE + 3 + j][k] = -pca[j][k];
+			calc->directions[STL_OBB_LATTICE + 6 + j][k] = (j == k) ? 1.0 : 0.0;
+			calc->directions[STL_OBB_LATTICE + 9 + j][k] = (j == k) ? -1.0 : 0.0;
+		}
+	}
+}
+
+stl_error_t stl_compute_obb_ctx(stl_ctx_t *ctx, stl_t *stl, stl_obb_t *obb)
+{
+	stl_error_t    error = STL_SUCCESS;
+	size_t         i = 0;
+	size_t         chunks = 0;
+	size_t         count = 0;
+	size_t         facets_count = 0;
+	int            j = 0;
+	int            k = 0;
+	int            swap = 0;
+	int            order[3];
+	double         area = 0.0;
+	double         corners = 0.0;
+	double         centre[3];
+	double         moment[6];
+	double         corner_sum[3];
+	double         corner_moment[6];
+	double         mean[3];
+	double         cov[3][3];
+	double         pca[3][3];
+	double         axes[3][3];
+	double         min[3];
+	double         max[3];
+	double         lo[3];
+	double         hi[3];
+	double         cross[3];
+	double         sides[3];
+	double         xyz_sides[3];
+	double         aabb_sides[3];
+	double         value = 0.0;
+	double         *points = NULL;
+	stl_vertex_t   bounds_min;
+	stl_vertex_t   bounds_max;
+	stl_obb_calc_t calc;
+
+	memset(&calc, 0x00, sizeof(calc));
+
+	if((NULL == stl) || (NULL == obb))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* What an object with no facets gets */
+	if(STL_SUCCESS == error)
+	{
+		facets_count = stl->facets_count;
+
+		memset(obb, 0x00, sizeof(*obb));
+		obb->axes[0][0] = 1.0;
+		obb->axes[1][1] = 1.0;
+		obb->axes[2][2] = 1.0;
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		calc.stl = stl;
+
+		chunks = _stl_chunk_count(facets_count, STL_CTX_CHUNK_FACETS);
+
+		error = stl_get_bounds_ctx(ctx, stl, &bounds_min, &bounds_max);
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		calc.origin[0] = ((double)bounds_min.x + bounds_max.x) / 2.0;
+		calc.origin[1] = ((double)bounds_min.y + bounds_max.y) / 2.0;
+		calc.origin[2] = ((double)bounds_min.z + bounds_max.z) / 2.0;
+
+		/* Infinite corners, measure from the origin instead */
+		if(!stl_obb_finite(calc.origin))
+		{
+			memset(calc.origin, 0x00, sizeof(calc.origin));
+		}
+
+		calc.parts = (stl_obb_part_t *)_stl_alloc_array(chunks, sizeof(calc.parts[0]));
+		calc.range = (double *)_stl_alloc_array(chunks, 6 * sizeof(calc.range[0]));
+		calc.far_value = (double *)_stl_alloc_array(chunks, STL_OBB_DIRECTIONS * sizeof(calc.far_value[0]));
+		calc.far_point = (double *)_stl_alloc_array(chunks, 3 * STL_OBB_DIRECTIONS * sizeof(calc.far_point[0]));
+		points = (double *)malloc(3 * STL_OBB_DIRECTIONS * sizeof(points[0]));
+
+		if((NULL == calc.parts) || (NULL == calc.range) || (NULL == calc.far_value) ||
+			(NULL == calc.far_point) || (NULL == points))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		_stl_ctx_run(ctx, facets_count, STL_CTX_CHUNK_FACETS, stl_obb_moments_chunk, &calc);
+
+		memset(centre, 0x00, sizeof(centre));
+		memset(moment, 0x00, sizeof(moment));
+		memset(corner_sum, 0x00, sizeof(corner_sum));
+		memset(corner_moment, 0x00, sizeof(corner_moment));
+
+		for(k = 0; k < 3; k++)
+		{
+			min[k] = HUGE_VAL;
+			max[k] = -HUGE_VAL;
+		}
+
+		/* In chunk order, so it comes out the same every time */
+		for(i = 0; i < chunks; i++)
+		{
+			area += calc.parts[i].area;
+			corners += calc.parts[i].corners;
+
+			for(k = 0; k < 3; k++)
+			{
+				centre[k] += calc.parts[i].centre[k];
+				corner_sum[k] += calc.parts[i].corner_sum[k];
+
+				min[k] = (calc.parts[i].min[k] < min[k]) ? calc.parts[i].min[k] : min[k];
+				max[k] = (calc.parts[i].max[k] > max[k]) ? calc.parts[i].max[k] : max[k];
+			}
+
+			for(k = 0; k < 6; k++)
+			{
+				moment[k] += calc.parts[i].moment[k];
+				corner_moment[k] += calc.parts[i].corner_moment[k];
+			}
+		}
+
+		/* Nothing to put a box round */
+		if(0.0 == corners)
+		{
+			error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		/* Weighted by area, or by corner if the facets have none */
+		if(area > 0.0)
+		{
+			for(k = 0; k < 3; k++)
+			{
+				mean[k] = centre[k] / area;
+			}
+
+			for(k = 0; k < 6; k++)
+			{
+				moment[k] /= area;
+			}
+		}
+		else
+		{
+			for(k = 0; k < 3; k++)
+			{
+				mean[k] = corner_sum[k] / corners;
+			}
+
+			for(k = 0; k < 6; k++)
+			{
+				moment[k] = corner_moment[k] / corners;
+			}
+		}
+
+		cov[0][0] = moment[0] - mean[0] * mean[0];
+		cov[1][1] = moment[1] - mean[1] * mean[1];
+		cov[2][2] = moment[2] - mean[2] * mean[2];
+		cov[0][1] = cov[1][0] = moment[3] - mean[0] * mean[1];
+		cov[0][2] = cov[2][0] = moment[4] - mean[0] * mean[2];
+		cov[1][2] = cov[2][1] = moment[5] - mean[1] * mean[2];
+
+		stl_obb_eigen(cov, pca);
+		stl_obb_directions(&calc, pca);
+
+		_stl_ctx_run(ctx, facets_count, STL_CTX_CHUNK_FACETS, stl_obb_far_chunk, &calc);
+
+		/* The furthest corner each way, the earliest of any that tie */
+		for(k = 0; k < STL_OBB_DIRECTIONS; k++)
+		{
+			value = -HUGE_VAL;
+
+			for(i = 0; i < chunks; i++)
+			{
+				if(calc.far_value[i * STL_OBB_DIRECTIONS + k] > value)
+				{
+					value = calc.far_value[i * STL_OBB_DIRECTIONS + k];
+					memcpy(&points[3 * count], &calc.far_point[3 * (i * STL_OBB_DIRECTIONS + k)], 3 * sizeof(double));
+				}
+			}
+
+			if(value > -HUGE_VAL)
+			{
+				count++;
+			}
+		}
+
+		/* Start from the principal axes and from x, y and z, and keep
+		 * whichever ends up smaller
+		 */
+		memcpy(axes, pca, sizeof(axes));
+		stl_obb_search(points, count, axes, sides);
+
+		memset(pca, 0x00, sizeof(pca));
+		pca[0][0] = 1.0;
+		pca[1][1] = 1.0;
+		pca[2][2] = 1.0;
+
+		stl_obb_search(points, count, pca, xyz_sides);
+
+		if(stl_obb_smaller(xyz_sides, sides))
+		{
+			memcpy(axes, pca, sizeof(axes));
+		}
+
+		memcpy(calc.axes, axes, sizeof(axes));
+
+		_stl_ctx_run(ctx, facets_count, STL_CTX_CHUNK_FACETS, stl_obb_range_chunk, &calc);
+
+		/* The box lined up with x, y and z is exact already, and the
+		 * search is only a search
+		 */
+		for(k = 0; k < 3; k++)
+		{
+			lo[k] = HUGE_VAL;
+			hi[k] = -HUGE_VAL;
+
+			for(i = 0; i < chunks; i++)
+			{
+				lo[k] = (calc.range[i * 6 + k] < lo[k]) ? calc.range[i * 6 + k] : lo[k];
+				hi[k] = (calc.range[i * 6 + 3 + k] > hi[k]) ? calc.range[i * 6 + 3 + k] : hi[k];
+			}
+
+			sides[k] = hi[k] - lo[k];
+			aabb_sides[k] = max[k] - min[k];
+		}
+
+		if(!stl_obb_smaller(sides, aabb_sides))
+		{
+			memset(axes, 0x00, sizeof(axes));
+			axes[0][0] = 1.0;
+			axes[1][1] = 1.0;
+			axes[2][2] = 1.0;
+
+			memcpy(lo, min, sizeof(lo));
+			memcpy(hi, max, sizeof(hi));
+		}
+
+		/* Longest side first */
+		order[0] = 0;
+		order[1] = 1;
+		order[2] = 2;
+
+		for(j = 0; j < 2; j++)
+		{
+			for(k = 2; k > j; k--)
+			{
+				if((hi[order[k]] - lo[order[k]]) > (hi[order[k - 1]] - lo[order[k - 1]]))
+				{
+					swap = order[k];
+					order[k] = order[k - 1];
+					order[k - 1] = swap;
+				}
+			}
+		}
+
+		for(j = 0; j < 3; j++)
+		{
+			k = order[j];
+
+			memcpy(obb->axes[j], axes[k], sizeof(obb->axes[j]));
+			obb->size[j] = hi[k] - lo[k];
+
+			value = (lo[k] + hi[k]) / 2.0;
+
+			obb->centre[0] += value * axes[k][0];
+			obb->centre[1] += value * axes[k][1];
+			obb->centre[2] += value * axes[k][2];
+		}
+
+		obb->centre[0] += calc.origin[0];
+		obb->centre[1] += calc.origin[1];
+		obb->centre[2] += calc.origin[2];
+
+		/* Right handed */
+		cross[0] = obb->axes[0][1] * obb->axes[1][2] - obb->axes[0][2] * obb->axes[1][1];
+		cross[1] = obb->axes[0][2] * obb->axes[1][0] - obb->axes[0][0] * obb->axes[1][2];
+		cross[2] = obb->axes[0][0] * obb->axes[1][1] - obb->axes[0][1] * obb->axes[1][0];
+
+		if(stl_obb_dot(cross, obb->axes[2]) < 0.0)
+		{
+			obb->axes[2][0] = -obb->axes[2][0];
+			obb->axes[2][1] = -obb->axes[2][1];
+			obb->axes[2][2] = -obb->axes[2][2];
+		}
+
+		obb->volume = obb->size[0] * obb->size[1] * obb->size[2];
+	}
+
+	free(calc.parts);
+	free(calc.range);
+	free(calc.far_value);
+	free(calc.far_point);
+	free(points);
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_compute_obb(stl_t *stl, stl_obb_t *obb)
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_ctx_t   *ctx = NULL;
+
+	/* The answer is the same without a pool */
+	if(NULL != stl)
+	{
+		ctx = _stl_ctx_temp(stl->facets_count);
+	}
+
+	error = stl_compute_obb_ctx(ctx, stl, obb);
+
+	stl_ctx_free(ctx);
+
+	return STL_LOG_ERR(error);
+}
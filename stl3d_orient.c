@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Orientation search. The facets are copied once into separate float
+ * arrays (see _stl_orient_facets_t), measured from the middle of the
+ * bounding box, and then each chunk of facets is scored against every
+ * candidate while it's still in cache: first the lowest and highest corner
+ * along each candidate's up, then, once the bed for each candidate is
+ * known, the overhang. The per chunk results are added up in chunk order,
+ * so the threads don't change the answer.
+ */
+
+/* Facets with every corner within this fraction of the part's height of
+ * its lowest point are sitting on the bed
+ */
+#define STL_ORIENT_BED 1e-4
+
+/* cos(45 degrees). Facets whose normal is closer than this to straight
+ * down need support.
+ */
+#define STL_ORIENT_SUPPORT_COS 0.70710678118654752440
+
+/* Facets fetched at a time while copying */
+#define STL_ORIENT_BLOCK 256
+
+/* The facet arrays */
+#define STL_ORIENT_ARRAYS 13
+
+typedef struct
+{
+	const stl_t          *stl;
+	double               centre[3];
+	_stl_orient_facets_t facets;
+
+	size_t               candidates;
+
+	/* Unit up vector of each candidate, three floats each */
+	float                *up;
+
+	/* Per chunk, candidates of each: chunk c, candidate k is at
+	 * c * candidates + k
+	 */
+	float                *min;
+	float                *max;
+	double               *overhang;
+
+	/* Per chunk, total facet area */
+	double               *area;
+
+	/* Per candidate, the height of the bed */
+	float                *bed;
+} stl_orient_calc_t;
+
+/* Copy the facets into the arrays */
+static void stl_orient_copy_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_orient_calc_t    *calc = (stl_orient_calc_t *)arg;
+	_stl_orient_facets_t *f = &calc->facets;
+	size_t               i = 0;
+	size_t               k = 0;
+	size_t               block = 0;
+	int                  j = 0;
+	double               p[3][3];
+	double               a[3];
+	double               length = 0.0;
+	double               area = 0.0;
+	const stl_facet_t    *facets = NULL;
+	stl_facet_t          tmp[STL_ORIENT_BLOCK];
+
+	for(i = first; i < first + count; i += block)
+	{
+		block = first + count - i;
+		if(block > STL_ORIENT_BLOCK)
+		{
+			block = STL_ORIENT_BLOCK;
+		}
+
+		facets = _stl_get_facets(calc->stl, i, block, tmp);
+
+		for(k = 0; k < block; k++)
+		{
+			for(j = 0; j < 3; j++)
+			{
+				p[j][0] = facets[k].verticies[j].x - calc->centre[0];
+				p[j][1] = facets[k].verticies[j].y - calc->centre[1];
+				p[j][2] = facets[k].verticies[j].z - calc->centre[2];
+
+				f->x[j][i + k] = (float)p[j][0];
+				f->y[j][i + k] = (float)p[j][1];
+				f->z[j][i + k] = (float)p[j][2];
+			}
+
+			a[0] = ((p[1][1] - p[0][1]) * (p[2][2] - p[0][2]) - (p[1][2] - p[0][2]) * (p[2][1] - p[0][1])) / 2.0;
+			a[1] = ((p[1][2] - p[0][2]) * (p[2][0] - p[0][0]) - (p[1][0] - p[0][0]) * (p[2][2] - p[0][2])) / 2.0;
+			a[2] = ((p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0])) / 2.0;
+
+			length = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+
+			f->ax[i + k] = (float)a[0];
+			f->ay[i + k] = (float)a[1];
+			f->az[i + k] = (float)a[2];
+			f->threshold[i + k] = (float)(-length * STL_ORIENT_SUPPORT_COS);
+
+			/* Corners that aren't numbers don't add to the area */
+			if(length > 0.0)
+			{
+				area += length;
+			}
+		}
+	}
+
+	calc->area[chunk_index] = area;
+}
+
+static void stl_orient_range_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_orient_calc_t *calc = (stl_orient_calc_t *)arg;
+	size_t            k = 0;
+	size_t            at = chunk_index * calc->candidates;
+
+	for(k = 0; k < calc->candidates; k++)
+	{
+		calc->min[at + k] = (float)HUGE_VAL;
+		calc->max[at + k] = (float)-HUGE_VAL;
+
+		_stl_orient_range(&calc->facets, first, count, &calc->up[3 * k], &calc->min[at + k], &calc->max[at + k]);
+	}
+}
+
+static void stl_orient_overhang_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_orient_calc_t *calc = (stl_orient_calc_t *)arg;
+	size_t            k = 0;
+	size_t            at = chunk_index * calc->candidates;
+
+	for(k = 0; k < calc->candidates; k++)
+	{
+		calc->overhang[at + k] = _stl_orient_overhang(&calc->facets, first, count, &calc->up[3 * k], calc->bed[k]);
+	}
+}
+
+/* Candidate k of count as a unit vector: the six axes, +z first, then
+ * the rest spread evenly over the sphere (a Fibonacci lattice)
+ */
+static void stl_orient_candidate(size_t k, size_t count, double *up)
+{
+	static const double axes[6][3] =
+	{
+		{ 0.0,  0.0,  1.0 },
+		{ 0.0,  0.0, -1.0 },
+		{ 1.0,  0.0,  0.0 },
+		{-1.0,  0.0,  0.0 },
+		{ 0.0,  1.0,  0.0 },
+		{ 0.0, -1.0,  0.0 }
+	};
+	double n = 0.0;
+	double r = 0.0;
+	double angle = 0.0;
+
+	if(k < 6)
+	{
+		memcpy(up, axes[k], sizeof(axes[k]));
+		return;
+	}
+
+	n = (double)(count - 6);
+	k -= 6;
+
+	up[2] = 1.0 - (2.0 * k + 1.0) / n;
+	r = sqrt(1.0 - up[2] * up[2]);
+
+	/* The golden angle, pi * (3 - sqrt(5)) */
+	angle = k * (STL_PI * (3.0 - sqrt(5.0)));
+
+	up[0] = r * cos(angle);
+	up[1] = r * sin(angle);
+}
+
+/* The rotation that turns up to point along +z
+ */
+static stl_error_t stl_orient_matrix(const double *up, double m[16])
+{
+	stl_error_t error = STL_SUCCESS;
+	double      z = up[2];
+
+	error = stl_matrix_identity(m);
+
+	if((STL_SUCCESS == error) && (z <= -1.0))
+	{
+		error = stl_matrix_rotate(m, 1.0, 0.0, 0.0, 180.0);
+	}
+	else if((STL_SUCCESS == error) && ((0.0 != up[0]) || (0.0 != up[1])))
+	{
+		z = (z > 1.0) ? 1.0 : z;
+
+		/* Around up x z, by the angle between them */
+		error = stl_matrix_rotate(m, up[1], -up[0], 0.0, acos(z) * 180.0 / STL_PI);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Bytes for an array of count floats, rounded up to the alignment. Returns
+ * 0 if that doesn't fit in a size_t.
+ */
+static int stl_orient_array_size(size_t count, size_t *bytes)
+{
+	if(!_stl_size_mul(count, sizeof(float), bytes) || (*bytes > ((size_t)-1) - STL_ALIGN))
+	{
+		return 0;
+	}
+
+	*bytes = ((*bytes + STL_ALIGN - 1) / STL_ALIGN) * STL_ALIGN;
+
+	return 1;
+}
+
+stl_error_t stl_auto_orient_ctx(stl_ctx_t *ctx, stl_t *stl, unsigned int candidates, double height_weight, double overhang_weight, double m[16])
+{
+	stl_error_t       error = STL_SUCCESS;
+	size_t            i = 0;
+	size_t            k = 0;
+	size_t            facets_count = 0;
+	size_t            chunks = 0;
+	size_t            array_bytes = 0;
+	size_t            results = 0;
+	size_t            best = 0;
+	int               j = 0;
+	int               found = 0;
+	double            up[3];
+	double            area = 0.0;
+	double            tallest = 0.0;
+	double            score = 0.0;
+	double            best_score = 0.0;
+	double            *height = NULL;
+	double            *overhang = NULL;
+	float             min = 0.0f;
+	float             max = 0.0f;
+	unsigned char     *block = NULL;
+	stl_vertex_t      bounds_min;
+	stl_vertex_t      bounds_max;
+	stl_orient_calc_t calc;
+
+	memset(&calc, 0x00, sizeof(calc));
+
+	if((NULL == stl) || (NULL == m))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(0 == candidates)
+	{
+		candidates = STL_ORIENT_CANDIDATES;
+	}
+
+	/* Nothing to stand up, it stays as it is */
+	if(STL_SUCCESS == error)
+	{
+		facets_count = stl->facets_count;
+
+		error = stl_matrix_identity(m);
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		calc.stl = stl;
+		calc.candidates = candidates;
+
+		chunks = _stl_chunk_count(facets_count, STL_CTX_CHUNK_FACETS);
+
+		error = stl_get_bounds_ctx(ctx, stl, &bounds_min, &bounds_max);
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		calc.centre[0] = ((double)bounds_min.x + bounds_max.x) / 2.0;
+		calc.centre[1] = ((double)bounds_min.y + bounds_max.y) / 2.0;
+		calc.centre[2] = ((double)bounds_min.z + bounds_max.z) / 2.0;
+
+		/* Infinite corners, measure from the origin instead */
+		for(j = 0; j < 3; j++)
+		{
+			calc.centre[j] = (fabs(calc.centre[j]) < HUGE_VAL) ? calc.centre[j] : 0.0;
+		}
+
+		if(!stl_orient_array_size(facets_count, &array_bytes) ||
+			!_stl_size_mul(chunks, candidates, &results) ||
+			(array_bytes > ((size_t)-1) / STL_ORIENT_ARRAYS))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		block = (unsigned char *)_stl_alloc_aligned(STL_ORIENT_ARRAYS * array_bytes);
+		calc.up = (float *)_stl_alloc_array(candidates, 3 * sizeof(calc.up[0]));
+		calc.min = (float *)_stl_alloc_array(results, sizeof(calc.min[0]));
+		calc.max = (float *)_stl_alloc_array(results, sizeof(calc.max[0]));
+		calc.overhang = (double *)_stl_alloc_array(results, sizeof(calc.overhang[0]));
+		calc.area = (double *)_stl_alloc_array(chunks, sizeof(calc.area[0]));
+		calc.bed = (float *)_stl_alloc_array(candidates, sizeof(calc.bed[0]));
+		height = (double *)_stl_alloc_array(candidates, sizeof(height[0]));
+		overhang = (double *)_stl_alloc_array(candidates, sizeof(overhang[0]));
+
+		if((NULL == block) || (NULL == calc.up) || (NULL == calc.min) || (NULL == calc.max) ||
+			(NULL == calc.overhang) || (NULL == calc.area) || (NULL == calc.bed) ||
+			(NULL == height) || (NULL == overhang))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		for(j = 0; j < 3; j++)
+		{
+			calc.facets.x[j] = (float *)(block + (3 * j + 0) * array_bytes);
+			calc.facets.y[j] = (float *)(block + (3 * j + 1) * array_bytes);
+			calc.facets.z[j] = (float *)(block + (3 * j + 2) * array_bytes);
+		}
+
+		calc.facets.ax = (float *)(block + 9 * array_bytes);
+		calc.facets.ay = (float *)(block + 10 * array_bytes);
+		calc.facets.az = (float *)(block + 11 * array_bytes);
+		calc.facets.threshold = (float *)(block + 12 * array_bytes);
+
+		for(k = 0; k < candidates; k++)
+		{
+			stl_orient_candidate(k, candidates, up);
+
+			calc.up[3 * k + 0] = (float)up[0];
+			calc.up[3 * k + 1] = (float)up[1];
+			calc.up[3 * k + 2] = (float)up[2];
+		}
+
+		_stl_ctx_run(ctx, facets_count, STL_CTX_CHUNK_FACETS, stl_orient_copy_chunk, &calc);
+		_stl_ctx_run(ctx, facets_count, STL_CTX_CHUNK_FACETS, stl_orient_range_chunk, &calc);
+
+		for(k = 0; k < candidates; k++)
+		{
+			min = calc.min[k];
+			max = calc.max[k];
+
+			for(i = 1; i < chunks; i++)
+			{
+				min = (calc.min[i * candidates + k] < min) ? calc.min[i * candidates + k] : min;
+				max = (calc.max[i * candidates + k] > max) ? calc.max[i * candidates + k] : max;
+			}
+
+			height[k] = (double)max - min;
+			calc.bed[k] = (float)(min + STL_ORIENT_BED * height[k]);
+
+			tallest = (height[k] > tallest) ? height[k] : tallest;
+		}
+
+		_stl_ctx_run(ctx, facets_count, STL_CTX_CHUNK_FACETS, stl_orient_overhang_chunk, &calc);
+
+		for(i = 0; i < chunks; i++)
+		{
+			area += calc.area[i];
+		}
+
+		for(k = 0; k < candidates; k++)
+		{
+			overhang[k] = 0.0;
+
+			for(i = 0; i < chunks; i++)
+			{
+				overhang[k] += calc.overhang[i * candidates + k];
+			}
+		}
+
+		/* Lowest score wins, the earliest of any that tie. Candidates
+		 * whose score isn't a number never win.
+		 */
+		for(k = 0; k < candidates; k++)
+		{
+			score = 0.0;
+
+			if(tallest > 0.0)
+			{
+				score += height_weight * height[k] / tallest;
+			}
+
+			if(area > 0.0)
+			{
+				score += overhang_weight * overhang[k] / area;
+			}
+
+			if((score == score) && (!found || (score < best_score)))
+			{
+				best = k;
+				best_score = score;
+				found = 1;
+			}
+		}
+
+		stl_orient_candidate(best, candidates, up);
+
+		error = stl_orient_matrix(up, m);
+	}
+
+	_stl_free_aligned(block);
+	free(calc.up);
+	free(calc.min);
+	free(calc.max);
+	free(calc.overhang);
+	free(calc.area);
+	free(calc.bed);
+	free(height);
+	free(overhang);
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_auto_orient(stl_t *stl, unsigned int candidates, double height_weight, double overhang_weight, double m[16])
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_ctx_t   *ctx = NULL;
+
+	/* The answer is the same without a pool */
+	if(NULL != stl)
+	{
+		ctx = _stl_ctx_temp(stl->facets_count);
+	}
+
+	error = stl_auto_orient_ctx(ctx, stl, candidates, height_weight, overhang_weight, m);
+
+	stl_ctx_free(ctx);
+
+	return STL_LOG_ERR(error);
+}
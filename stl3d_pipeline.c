@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Read, transform and write a file at the same time. A reader thread fills
+ * batches from the input, the calling thread runs the callback on them and
+ * a writer thread writes them out, with the batches handed round a ring of
+ * buffers so the disk and the CPU are both kept busy.
+ */
+
+/* Three buffers: one being read, one being worked on, one being written */
+#define STL_PIPELINE_BUFFERS 3
+#define STL_PIPELINE_BATCH   65536
+
+typedef struct
+{
+	stl_reader_t     *reader;
+	stl_writer_t     *writer;
+	stl_batch_cb_t   callback;
+	void             *arg;
+
+	stl_facet_t      *buffers[STL_PIPELINE_BUFFERS];
+	size_t           counts[STL_PIPELINE_BUFFERS];
+
+	/* Number of batches through each stage so far. Batch n lives in
+	 * buffers[n % STL_PIPELINE_BUFFERS], and each stage only ever waits on
+	 * the one before it (the reader waits on the writer for a free buffer).
+	 */
+	size_t           read;
+	size_t           computed;
+	size_t           written;
+	int              eof;
+	stl_error_t      error;
+
+#ifndef _WIN32
+	pthread_mutex_t  lock;
+	pthread_cond_t   cond;
+#endif
+} stl_pipeline_t;
+
+#ifndef _WIN32
+static void *stl_pipeline_reader(void *arg)
+{
+	stl_pipeline_t *job = (stl_pipeline_t *)arg;
+	stl_error_t    error = STL_SUCCESS;
+	size_t         slot = 0;
+	size_t         count = 0;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&job->lock);
+
+		while((STL_SUCCESS == job->error) && (job->read - job->written == STL_PIPELINE_BUFFERS))
+		{
+			pthread_cond_wait(&job->cond, &job->lock);
+		}
+
+		error = job->error;
+		slot = job->read % STL_PIPELINE_BUFFERS;
+
+		pthread_mutex_unlock(&job->lock);
+
+		if(STL_SUCCESS != error)
+		{
+			break;
+		}
+
+		error = stl_reader_next_batch(job->reader, job->buffers[slot], STL_PIPELINE_BATCH, &count);
+
+		pthread_mutex_lock(&job->lock);
+
+		if(STL_SUCCESS != error)
+		{
+			job->error = error;
+		}
+		else if(0 == count)
+		{
+			job->eof = 1;
+		}
+		else
+		{
+			job->counts[slot] = count;
+			job->read++;
+		}
+
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+
+		if((STL_SUCCESS != error) || (0 == count))
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *stl_pipeline_writer(void *arg)
+{
+	stl_pipeline_t *job = (stl_pipeline_t *)arg;
+	stl_error_t    error = STL_SUCCESS;
+	size_t         slot = 0;
+	int            done = 0;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&job->lock);
+
+		while((STL_SUCCESS == job->error) && (job->written == job->computed) &&
+			!(job->eof && (job->computed == job->read)))
+		{
+			pthread_cond_wait(&job->cond, &job->lock);
+		}
+
+		error = job->error;
+		done = (job->written == job->computed);
+		slot = job->written % STL_PIPELINE_BUFFERS;
+
+		pthread_mutex_unlock(&job->lock);
+
+		if((STL_SUCCESS != error) || done)
+		{
+			break;
+		}
+
+		error = stl_writer_append(job->writer, job->buffers[slot], job->counts[slot]);
+
+		pthread_mutex_lock(&job->lock);
+
+		if(STL_SUCCESS != error)
+		{
+			job->error = error;
+		}
+		else
+		{
+			job->written++;
+		}
+
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+
+		if(STL_SUCCESS != error)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* The compute stage, run on the calling thread
+ */
+static void stl_pipeline_compute(stl_pipeline_t *job)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      slot = 0;
+	int         done = 0;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&job->lock);
+
+		while((STL_SUCCESS == job->error) && (job->computed == job->read) && !job->eof)
+		{
+			pthread_cond_wait(&job->cond, &job->lock);
+		}
+
+		error = job->error;
+		done = (job->computed == job->read);
+		slot = job->computed % STL_PIPELINE_BUFFERS;
+
+		pthread_mutex_unlock(&job->lock);
+
+		if((STL_SUCCESS != error) || done)
+		{
+			break;
+		}
+
+		if(NULL != job->callback)
+		{
+			error = job->callback(job->buffers[slot], job->counts[slot], job->arg);
+		}
+
+		pthread_mutex_lock(&job->lock);
+
+		if(STL_SUCCESS != error)
+		{
+			job->error = error;
+		}
+		else
+		{
+			job->computed++;
+		}
+
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+
+		if(STL_SUCCESS != error)
+		{
+			break;
+		}
+	}
+}
+#endif
+
+/* One batch at a time on the calling thread, for when there are no threads
+ * to overlap with
+ */
+static stl_error_t stl_pipeline_serial(stl_pipeline_t *job)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      count = 0;
+
+	for(;;)
+	{
+		error = stl_reader_next_batch(job->reader, job->buffers[0], STL_PIPELINE_BATCH, &count);
+		if((STL_SUCCESS != error) || (0 == count))
+		{
+			break;
+		}
+
+		if(NULL != job->callback)
+		{
+			error = job->callback(job->buffers[0], count, job->arg);
+		}
+
+		if(STL_SUCCESS == error)
+		{
+			error = stl_writer_append(job->writer, job->buffers[0], count);
+		}
+
+		if(STL_SUCCESS != error)
+		{
+			break;
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_pipeline_run(char *input_file, char *output_file, stl_batch_cb_t callback, void *arg)
+{
+	stl_error_t    error = STL_SUCCESS;
+	stl_error_t    close_error = STL_SUCCESS;
+	unsigned int   i = 0;
+	size_t         facets_count = 0;
+	unsigned char  header[STL_HEADER_SIZE];
+	stl_pipeline_t job;
+#ifndef _WIN32
+	pthread_t      reader_thread;
+	pthread_t      writer_thread;
+	int            reader_started = 0;
+	int            writer_started = 0;
+#endif
+
+	if((NULL == input_file) || (NULL == output_file))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	memset(&job, 0x00, sizeof(job));
+	job.callback = callback;
+	job.arg = arg;
+
+	error = stl_reader_open(input_file, header, &facets_count, &job.reader);
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_writer_open(output_file, header, facets_count, &job.writer);
+	}
+
+	for(i = 0; (STL_SUCCESS == error) && (i < STL_PIPELINE_BUFFERS); i++)
+	{
+		job.buffers[i] = (stl_facet_t *)malloc(STL_PIPELINE_BATCH * sizeof(job.buffers[i][0]));
+		if(NULL == job.buffers[i])
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+#ifndef _WIN32
+	if(STL_SUCCESS == error)
+	{
+		pthread_mutex_init(&job.lock, NULL);
+		pthread_cond_init(&job.cond, NULL);
+
+		/* The writer goes first, so if either can't be started nothing has
+		 * been read yet
+		 */
+		writer_started = (0 == pthread_create(&writer_thread, NULL, stl_pipeline_writer, &job));
+		if(writer_started)
+		{
+			reader_started = (0 == pthread_create(&reader_thread, NULL, stl_pipeline_reader, &job));
+		}
+
+		if(reader_started && writer_started)
+		{
+			stl_pipeline_compute(&job);
+		}
+		else
+		{
+			/* Stop the writer if it did start */
+			pthread_mutex_lock(&job.lock);
+			job.error = STL_ERROR;
+			pthread_cond_broadcast(&job.cond);
+			pthread_mutex_unlock(&job.lock);
+		}
+
+		if(reader_started)
+		{
+			pthread_join(reader_thread, NULL);
+		}
+
+		if(writer_started)
+		{
+			pthread_join(writer_thread, NULL);
+		}
+
+		pthread_cond_destroy(&job.cond);
+		pthread_mutex_destroy(&job.lock);
+
+		/* Couldn't get the threads, do it the slow way */
+		if(!reader_started || !writer_started)
+		{
+			job.error = stl_pipeline_serial(&job);
+		}
+
+		error = job.error;
+	}
+#else
+	if(STL_SUCCESS == error)
+	{
+		error = stl_pipeline_serial(&job);
+	}
+#endif
+
+	if(NULL != job.writer)
+	{
+		close_error = stl_writer_close(job.writer);
+		job.writer = NULL;
+
+		if(STL_SUCCESS == error)
+		{
+			error = close_error;
+		}
+	}
+
+	if(NULL != job.reader)
+	{
+		stl_reader_close(job.reader);
+		job.reader = NULL;
+	}
+
+	for(i = 0; i < STL_PIPELINE_BUFFERS; i++)
+	{
+		free(job.buffers[i]);
+	}
+
+	return STL_LOG_ERR(error);
+}
@@ -1,14 +1,28 @@
+/* For O_DIRECT and renameat2() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "stl3d_lib.h"
+#include "stl3d_internal.h"
 
 
 /* This routine packs 4 little endian bytes from buffer into a 32 bit number,
  * converting it to the platforms native endian-ness.
  */
-static unsigned int stl_pack_le32(
+unsigned int _stl_pack_le32(
 	const unsigned char *buffer
 	)
 {
@@ -33,7 +47,7 @@ static unsigned short stl_pack_le16(
 /* Takes a 32 bit integer in the platform's native endianness and converts
  * it to a 4 character array in little endian format suitable for writing to disc.
  */
-static stl_error_t stl_unpack_le32(const unsigned int val, unsigned char *buffer)
+stl_error_t _stl_unpack_le32(const unsigned int val, unsigned char *buffer)
 {
 	stl_error_t error = STL_SUCCESS;
 
@@ -74,92 +88,203 @@ static stl_error_t stl_unpack_le16(const unsigned short val, unsigned char *buff
 	return STL_LOG_ERR(error);
 }
 
-static stl_error_t stl_read_next_vertex(FILE *fp, stl_vertex_t *vertex)
+/* Unpack one facet from the 50 byte layout used in the file. The floats are
+ * stored in the platform's native format, the same as reading them with
+ * fread() does.
+ */
+void _stl_decode_facet(const unsigned char *buffer, stl_facet_t *facet)
 {
-	stl_error_t error = STL_SUCCESS;
-	int         res = 0;
-	float       vals[3];
+	memcpy(&facet->normal, buffer, sizeof(facet->normal));
+	memcpy(facet->verticies, buffer + sizeof(facet->normal), sizeof(facet->verticies));
 
-	if((NULL == fp) || (NULL == vertex))
-	{
-		error = STL_LOG_ERR(STL_ERROR);
-	}
+	facet->abc = stl_pack_le16(buffer + 48);
+}
 
-	if(STL_SUCCESS == error)
+/* Returns non-zero when the platform stores integers little endian, in which
+ * case the file layout of a facet matches the start of stl_facet_t.
+ */
+static int stl_is_little_endian(void)
+{
+	const unsigned short one = 1;
+
+	return (*(const unsigned char *)&one == 1);
+}
+
+/* Unpack count consecutive facets from a buffer holding them in the file
+ * layout.
+ */
+void _stl_decode_facets(const unsigned char *buffer, stl_facet_t *facets, size_t count)
+{
+	size_t i = 0;
+
+	if(stl_is_little_endian())
 	{
-		res = fread(vals, 1, sizeof(vals), fp);
-		if(sizeof(vals) != res)
+		/* 12 native floats followed by a little endian 16 bit count is
+		 * exactly how stl_facet_t starts, so copy it straight across.
+		 */
+		for(i = 0; i < count; i++)
 		{
-			error = STL_LOG_ERR(STL_ERROR);
+			memcpy(&facets[i], buffer + (i * STL_FACET_SIZE), STL_FACET_SIZE);
 		}
 	}
-
-	if(STL_SUCCESS == error)
+	else
 	{
-		vertex->x = vals[0];
-		vertex->y = vals[1];
-		vertex->z = vals[2];
+		for(i = 0; i < count; i++)
+		{
+			_stl_decode_facet(buffer + (i * STL_FACET_SIZE), &facets[i]);
+		}
 	}
+}
 
-	return STL_LOG_ERR(error);
+/* Pack one facet into the 50 byte layout used in the file
+ */
+void _stl_encode_facet(const stl_facet_t *facet, unsigned char *buffer)
+{
+	memcpy(buffer, &facet->normal, sizeof(facet->normal));
+	memcpy(buffer + sizeof(facet->normal), facet->verticies, sizeof(facet->verticies));
+
+	stl_unpack_le16(facet->abc, buffer + 48);
 }
 
-static stl_error_t stl_read_next_facet(FILE *fp, stl_facet_t *facet)
+/* Pack count consecutive facets into the file layout
+ */
+void _stl_encode_facets(const stl_facet_t *facets, size_t count, unsigned char *buffer)
 {
-	stl_error_t   error = STL_SUCCESS;
-	int           res = 0;
-	unsigned char uint16_bytes[2];
+	size_t i = 0;
 
-	if((NULL == fp) || (NULL == facet))
+	if(stl_is_little_endian())
 	{
-		error = STL_LOG_ERR(STL_ERROR);
+		for(i = 0; i < count; i++)
+		{
+			memcpy(buffer + (i * STL_FACET_SIZE), &facets[i], STL_FACET_SIZE);
+		}
 	}
-
-	if(STL_SUCCESS == error)
+	else
 	{
-		error = stl_read_next_vertex(fp, &(facet->normal));
+		for(i = 0; i < count; i++)
+		{
+			_stl_encode_facet(&facets[i], buffer + (i * STL_FACET_SIZE));
+		}
 	}
+}
 
-	if(STL_SUCCESS == error)
+static stl_error_t stl_map(const char *filename, int writable, void **base, size_t *size)
+{
+	stl_error_t error = STL_SUCCESS;
+#ifndef _WIN32
+	int         fd = -1;
+	struct stat st;
+	void        *addr = NULL;
+
+	if((NULL == filename) || (NULL == base) || (NULL == size))
 	{
-		error = stl_read_next_vertex(fp, &(facet->verticies[0]));
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		error = stl_read_next_vertex(fp, &(facet->verticies[1]));
+		fd = open(filename, O_RDONLY);
+		if(fd < 0)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		error = stl_read_next_vertex(fp, &(facet->verticies[2]));
+		if((fstat(fd, &st) != 0) || (st.st_size <= 0))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		res = fread(uint16_bytes, 1, sizeof(uint16_bytes), fp);
-		if(sizeof(uint16_bytes) != res)
+		addr = mmap(NULL, (size_t)st.st_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_PRIVATE, fd, 0);
+		if(MAP_FAILED == addr)
 		{
-			error = STL_LOG_ERR(STL_ERROR);
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
 		}
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		facet->abc = stl_pack_le16(uint16_bytes);
+		/* Facets are walked front to back */
+		madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+		*base = addr;
+		*size = (size_t)st.st_size;
 	}
 
-	return STL_LOG_ERR(error);
+	if(fd >= 0)
+	{
+		close(fd);
+		fd = -1;
+	}
+#else
+	(void)filename;
+	(void)writable;
+	(void)base;
+	(void)size;
+
+	error = STL_ERROR_UNSUPPORTED;
+#endif
+
+	return error;
+}
+
+stl_error_t _stl_map_readonly(const char *filename, void **base, size_t *size)
+{
+	return stl_map(filename, 0, base, size);
+}
+
+stl_error_t _stl_map_private(const char *filename, void **base, size_t *size)
+{
+	return stl_map(filename, 1, base, size);
+}
+
+void _stl_unmap(void *base, size_t size)
+{
+#ifndef _WIN32
+	if(NULL != base)
+	{
+		munmap(base, size);
+	}
+#endif
+}
+
+/* Size of an open file, or 0 if it can't be found out. The file position
+ * is left where it was.
+ */
+static size_t stl_file_size(FILE *fp)
+{
+	long pos = 0;
+	long size = 0;
+
+	pos = ftell(fp);
+	if((pos < 0) || (fseek(fp, 0, SEEK_END) != 0))
+	{
+		return 0;
+	}
+
+	size = ftell(fp);
+	fseek(fp, pos, SEEK_SET);
+
+	return (size < 0) ? 0 : (size_t)size;
 }
 
 stl_error_t stl_read_file(char *input_file, stl_t **stl_new)
 {
 	stl_error_t   error = STL_SUCCESS;
-	FILE          *fp;
-	unsigned int  i = 0;
-	int           res = 0;
-	unsigned char uint32_bytes[4];
+	FILE          *fp = NULL;
+	size_t        i = 0;
+	size_t        chunk = 0;
+	size_t        res = 0;
+	size_t        size = 0;
+	unsigned char bytes[STL_FACETS_OFFSET];
+	unsigned char *buffer = NULL;
 	stl_t         *stl = NULL;
+	int           dispatched = 0;
 
 	if((NULL == input_file) || (NULL == stl_new))
 	{
@@ -177,69 +302,107 @@ stl_error_t stl_read_file(char *input_file, stl_t **stl_new)
 
 	if(STL_SUCCESS == error)
 	{
-		stl = (stl_t *)malloc(sizeof(*stl));
-		if(NULL == stl)
+		res = fread(bytes, 1, sizeof(bytes), fp);
+		size = stl_file_size(fp);
+
+		if(_stl_is_gzip(bytes, res))
 		{
-			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
-		}
-	}
+			fclose(fp);
+			fp = NULL;
 
-	if(STL_SUCCESS == error)
-	{
-		memset(stl, 0x00, sizeof(*stl));
+			error = _stl_read_gzip_file(input_file, stl_new);
+			dispatched = 1;
+		}
+		else if(_stl_looks_ascii(bytes, res, size))
+		{
+			/* ASCII STL files start with "solid" at the start of the file,
+			 * but so do the headers of some binary files. Only treat it as
+			 * ASCII if it really looks like text.
+			 */
+			fclose(fp);
+			fp = NULL;
 
-		res = fread(stl->header, 1, STL_HEADER_SIZE, fp);
-		if(STL_HEADER_SIZE != res)
+			error = _stl_read_ascii_file(input_file, stl_new);
+			dispatched = 1;
+		}
+		else if(sizeof(bytes) != res)
 		{
 			error = STL_LOG_ERR(STL_ERROR);
 		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		/* Make sure we are not dealing with an ASCII STL file. Not supported yet.
-		 * ASCII STL files start with "solid" at the start of the file.
-		 */
-		if(memcmp(stl->header, "solid", strlen("solid")) == 0)
+		stl = (stl_t *)malloc(sizeof(*stl));
+		if(NULL == stl)
 		{
-			error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+		else
+		{
+			memset(stl, 0x00, sizeof(*stl));
 		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
+	{
+		memcpy(stl->header, bytes, STL_HEADER_SIZE);
+	}
+
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		res = fread(uint32_bytes, 1, sizeof(uint32_bytes), fp);
-		if(sizeof(uint32_bytes) != res)
+		stl->facets_count = _stl_pack_le32(bytes + STL_HEADER_SIZE);
+
+		/* The file has to hold every facet it claims to have, or a short
+		 * file could ask for a huge array
+		 */
+		if((size < STL_FACETS_OFFSET) || ((size - STL_FACETS_OFFSET) / STL_FACET_SIZE < stl->facets_count))
 		{
 			error = STL_LOG_ERR(STL_ERROR);
 		}
 	}
 
-	if(STL_SUCCESS == error)
+	/* Not cleared first, every facet is read in over it */
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		stl->facets_count = stl_pack_le32(uint32_bytes);
-
-		stl->facets = (stl_facet_t *)malloc(stl->facets_count * sizeof(stl_facet_t));
+		stl->facets = (stl_facet_t *)_stl_alloc_array(stl->facets_count, sizeof(stl_facet_t));
 		if(NULL == stl->facets)
 		{
 			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
 		}
-		else
+	}
+
+	/* Read the facets a chunk at a time and unpack each chunk in one go,
+	 * rather than calling fread() for every vertex.
+	 */
+	if((STL_SUCCESS == error) && (0 == dispatched))
+	{
+		buffer = (unsigned char *)malloc(STL_READ_CHUNK_FACETS * STL_FACET_SIZE);
+		if(NULL == buffer)
 		{
-			memset(stl->facets, 0x00, sizeof(stl->facets[0]) * stl->facets_count);
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
 		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		for(i = 0; i < stl->facets_count; i++)
+		for(i = 0; i < stl->facets_count; i += chunk)
 		{
-			error = stl_read_next_facet(fp, &(stl->facets[i]));
-			if(STL_SUCCESS != error)
+			chunk = stl->facets_count - i;
+			if(chunk > STL_READ_CHUNK_FACETS)
 			{
+				chunk = STL_READ_CHUNK_FACETS;
+			}
+
+			res = fread(buffer, STL_FACET_SIZE, chunk, fp);
+			if(chunk != res)
+			{
+				error = STL_LOG_ERR(STL_ERROR);
 				break;
 			}
-		}		
+
+			_stl_decode_facets(buffer, &(stl->facets[i]), chunk);
+		}
 	}
 
 	/* Cleanup */
@@ -248,11 +411,17 @@ stl_error_t stl_read_file(char *input_file, stl_t **stl_new)
 		stl_free(stl);
 		stl = NULL;
 	}
-	else
+	else if(0 == dispatched)
 	{
 		*stl_new = stl;
 	}
 
+	if(NULL != buffer)
+	{
+		free(buffer);
+		buffer = NULL;
+	}
+
 	if(NULL != fp)
 	{
 		fclose(fp);
@@ -262,162 +431,998 @@ stl_error_t stl_read_file(char *input_file, stl_t **stl_new)
 	return STL_LOG_ERR(error);
 }
 
-static stl_error_t stl_write_next_vertex(FILE *fp, stl_vertex_t *vertex)
-{
-	stl_error_t error = STL_SUCCESS;
-	int         res = 0;
-	float       vals[3];
+/* Below this many facets per thread it isn't worth starting more threads */
+#define STL_PARALLEL_MIN_FACETS 65536
 
-	if((NULL == fp) || (NULL == vertex))
+typedef struct
+{
+	int          fd;
+	stl_t        *stl;
+	unsigned int threads;
+	stl_error_t  *errors;
+} stl_parallel_read_t;
+
+#ifndef _WIN32
+/* Read and unpack this thread's share of the facets straight into place
+ */
+static void stl_read_facets_range(unsigned int index, void *arg)
+{
+	stl_parallel_read_t *job = (stl_parallel_read_t *)arg;
+	stl_error_t         error = STL_SUCCESS;
+	unsigned char       *buffer = NULL;
+	size_t              first = 0;
+	size_t              last = 0;
+	size_t              i = 0;
+	size_t              chunk = 0;
+	size_t              got = 0;
+	ssize_t             res = 0;
+
+	/* Worked out in 64 bits so it can't wrap where size_t is 32 */
+	first = (size_t)(((unsigned long long)job->stl->facets_count * index) / job->threads);
+	last = (size_t)(((unsigned long long)job->stl->facets_count * (index + 1)) / job->threads);
+
+	buffer = (unsigned char *)malloc(STL_READ_CHUNK_FACETS * STL_FACET_SIZE);
+	if(NULL == buffer)
 	{
-		error = STL_LOG_ERR(STL_ERROR);
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
 	}
 
-	if(STL_SUCCESS == error)
+	for(i = first; (STL_SUCCESS == error) && (i < last); i += chunk)
 	{
-		vals[0] = vertex->x;
-		vals[1] = vertex->y;
-		vals[2] = vertex->z;
+		chunk = last - i;
+		if(chunk > STL_READ_CHUNK_FACETS)
+		{
+			chunk = STL_READ_CHUNK_FACETS;
+		}
 
-		res = fwrite(vals, 1, sizeof(vals), fp);
-		if(sizeof(vals) != res)
+		/* pread() may come back short, keep going until the chunk is in */
+		for(got = 0; got < chunk * STL_FACET_SIZE; got += (size_t)res)
 		{
-			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+			res = pread(job->fd, buffer + got, (chunk * STL_FACET_SIZE) - got,
+				(off_t)(STL_FACETS_OFFSET + (i * STL_FACET_SIZE) + got));
+			if(res <= 0)
+			{
+				error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+				break;
+			}
+		}
+
+		if(STL_SUCCESS == error)
+		{
+			_stl_decode_facets(buffer, &(job->stl->facets[i]), chunk);
 		}
 	}
 
-	return STL_LOG_ERR(error);
+	free(buffer);
 
+	job->errors[index] = error;
 }
+#endif
 
-static stl_error_t stl_write_next_facet(FILE *fp, stl_facet_t *facet)
+stl_error_t stl_read_file_parallel(char *input_file, unsigned int threads, stl_t **newstl)
 {
-	stl_error_t   error = STL_SUCCESS;
-	int           res = 0;
-	unsigned char uint16_bytes[2];
+#ifndef _WIN32
+	stl_error_t         error = STL_SUCCESS;
+	unsigned int        i = 0;
+	ssize_t             res = 0;
+	size_t              size = 0;
+	unsigned char       bytes[STL_FACETS_OFFSET];
+	stl_parallel_read_t job;
+	struct stat         st;
+	stl_t               *stl = NULL;
+	int                 dispatched = 0;
+
+	if((NULL == input_file) || (NULL == newstl))
+	{
+		return STL_LOG_ERR(STL_ERROR);
+	}
 
-	if((NULL == fp) || (NULL == facet))
+	memset(&job, 0x00, sizeof(job));
+
+	job.fd = open(input_file, O_RDONLY);
+	if(job.fd < 0)
 	{
 		error = STL_LOG_ERR(STL_ERROR);
 	}
 
 	if(STL_SUCCESS == error)
 	{
-		error = stl_write_next_vertex(fp, &(facet->normal));
+		res = pread(job.fd, bytes, sizeof(bytes), 0);
+		if(((ssize_t)sizeof(bytes) != res) || _stl_is_gzip(bytes, sizeof(bytes)))
+		{
+			/* Might still be a very small ASCII file, and compressed files
+			 * have to be inflated from the start
+			 */
+			close(job.fd);
+			job.fd = -1;
+
+			error = stl_read_file(input_file, newstl);
+			dispatched = 1;
+		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		error = stl_write_next_vertex(fp, &(facet->verticies[0]));
+		/* Text files can't be split up by offset, parse those the normal way */
+		size = (0 == fstat(job.fd, &st)) ? (size_t)st.st_size : 0;
+
+		if(_stl_looks_ascii(bytes, sizeof(bytes), size))
+		{
+			close(job.fd);
+			job.fd = -1;
+
+			error = _stl_read_ascii_file(input_file, newstl);
+			dispatched = 1;
+		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		error = stl_write_next_vertex(fp, &(facet->verticies[1]));
+		stl = (stl_t *)malloc(sizeof(*stl));
+		if(NULL == stl)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+		else
+		{
+			memset(stl, 0x00, sizeof(*stl));
+		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		error = stl_write_next_vertex(fp, &(facet->verticies[2]));
+		memcpy(stl->header, bytes, STL_HEADER_SIZE);
+		stl->facets_count = _stl_pack_le32(bytes + STL_HEADER_SIZE);
+
+		/* The file has to hold every facet it claims to have */
+		if((size < STL_FACETS_OFFSET) || ((size - STL_FACETS_OFFSET) / STL_FACET_SIZE < stl->facets_count))
+		{
+			error = STL_LOG_ERR(STL_ERROR);
+		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		error = stl_unpack_le16(facet->abc, uint16_bytes);
+		/* Not cleared first, every facet gets written by one of the threads,
+		 * and leaving the pages untouched lets each thread fault in its own
+		 * part of the array.
+		 */
+		stl->facets = (stl_facet_t *)_stl_alloc_array(stl->facets_count, sizeof(stl_facet_t));
+		if(NULL == stl->facets)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		res = fwrite(uint16_bytes, 1, sizeof(uint16_bytes), fp);
-		if(sizeof(uint16_bytes) != res)
+
+		if(0 == threads)
 		{
-			error = STL_LOG_ERR(STL_ERROR);
+			threads = _stl_cpu_count();
+		}
+
+		/* Don't split small files into tiny pieces */
+		if(threads > (stl->facets_count / STL_PARALLEL_MIN_FACETS))
+		{
+			threads = (unsigned int)(stl->facets_count / STL_PARALLEL_MIN_FACETS);
+		}
+
+		if(0 == threads)
+		{
+			threads = 1;
+		}
+
+		job.stl = stl;
+		job.threads = threads;
+		job.errors = (stl_error_t *)calloc(threads, sizeof(job.errors[0]));
+		if(NULL == job.errors)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
 		}
 	}
 
+	if((STL_SUCCESS == error) && (0 == dispatched))
+	{
+		error = _stl_run_threads(threads, stl_read_facets_range, &job);
+	}
+
+	for(i = 0; (STL_SUCCESS == error) && (0 == dispatched) && (i < threads); i++)
+	{
+		error = job.errors[i];
+	}
+
+	/* Cleanup */
+	if(NULL != job.errors)
+	{
+		free(job.errors);
+		job.errors = NULL;
+	}
+
+	if(job.fd >= 0)
+	{
+		close(job.fd);
+		job.fd = -1;
+	}
+
+	if(STL_SUCCESS != error)
+	{
+		stl_free(stl);
+		stl = NULL;
+	}
+	else if(0 == dispatched)
+	{
+		*newstl = stl;
+	}
+
 	return STL_LOG_ERR(error);
+#else
+	/* No pread() here, read it the normal way */
+	(void)threads;
+
+	return stl_read_file(input_file, newstl);
+#endif
 }
 
-stl_error_t stl_write_file(char *output_file, stl_t *stl)
+stl_error_t stl_map_file(char *input_file, stl_t **stl_new)
 {
-	stl_error_t  error = STL_SUCCESS;
-	int           res = 0;
-	unsigned int  i = 0;
-	FILE          *fp = NULL;
-	unsigned char buffer[4];
+	stl_error_t         error = STL_SUCCESS;
+	void                *base = NULL;
+	size_t              size = 0;
+	const unsigned char *bytes = NULL;
+	stl_t               *stl = NULL;
+	int                 dispatched = 0;
 
-	if((NULL == output_file) || (NULL == stl))
+	if((NULL == input_file) || (NULL == stl_new))
 	{
 		return STL_LOG_ERR(STL_ERROR);
 	}
 
-	if(STL_SUCCESS == error)
-	{
-		/* Check if exists. If it does, fail */
-		fp = fopen(output_file, "rb");
-		if(NULL != fp)
-		{
-			fprintf(stderr, "Error: Output file %s already exists\n", output_file);
-			fclose(fp);
-			fp = NULL;
+	error = _stl_map_readonly(input_file, &base, &size);
 
-			error = STL_LOG_ERR(STL_ERROR);
-		}
+	/* No mmap() on this platform, fall back to reading a copy */
+	if(STL_ERROR_UNSUPPORTED == error)
+	{
+		error = stl_read_file(input_file, stl_new);
+		dispatched = 1;
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		/* Now create the new file */
-		fp = fopen(output_file, "wb");
-		if(NULL == fp)
+		bytes = (const unsigned char *)base;
+
+		/* Nothing to map in a compressed file, inflate a copy instead */
+		if(_stl_is_gzip(bytes, size))
 		{
-			fprintf(stderr, "Error: Could not create Output file %s\n", output_file);
+			_stl_unmap(base, size);
+			base = NULL;
 
+			error = _stl_read_gzip_file(input_file, stl_new);
+			dispatched = 1;
+		}
+		else if(_stl_looks_ascii(bytes, size, size))
+		{
+			/* There is no packed view of an ASCII file, parse it out of
+			 * the mapping into an ordinary object instead.
+			 */
+			error = _stl_parse_ascii((const char *)bytes, size, stl_new);
+			dispatched = 1;
+		}
+		else if(size < STL_FACETS_OFFSET)
+		{
 			error = STL_LOG_ERR(STL_ERROR);
 		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		res = fwrite(stl->header, 1, STL_HEADER_SIZE, fp);
-		if(STL_HEADER_SIZE != res)
+		stl = (stl_t *)malloc(sizeof(*stl));
+		if(NULL == stl)
 		{
-			error = STL_LOG_ERR(STL_ERROR);
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+		else
+		{
+			memset(stl, 0x00, sizeof(*stl));
 		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		error = stl_unpack_le32(stl->facets_count, buffer);
-	}
+		memcpy(stl->header, bytes, STL_HEADER_SIZE);
+		stl->facets_count = _stl_pack_le32(bytes + STL_HEADER_SIZE);
 
-	if(STL_SUCCESS == error)
-	{
-		res = fwrite(buffer, 1, 4, fp);
-		if(4 != res)
+		/* The file has to hold every facet it claims to have */
+		if((size - STL_FACETS_OFFSET) / STL_FACET_SIZE < stl->facets_count)
 		{
-			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+			error = STL_LOG_ERR(STL_ERROR);
 		}
 	}
 
-	if(STL_SUCCESS == error)
+	if((STL_SUCCESS == error) && (0 == dispatched))
 	{
-		for(i = 0; i < stl->facets_count; i++)
-		{
-			error = stl_write_next_facet(fp, &(stl->facets[i]));
+		stl->mapped_facets = bytes + STL_FACETS_OFFSET;
+		stl->map_base = base;
+		stl->map_size = size;
+		base = NULL;
 
-			if(STL_SUCCESS != error)
-			{
-				break;
-			}
+		*stl_new = stl;
+		stl = NULL;
+	}
+
+	/* Cleanup */
+	if(NULL != stl)
+	{
+		stl_free(stl);
+		stl = NULL;
+	}
+
+	if(NULL != base)
+	{
+		_stl_unmap(base, size);
+		base = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Create a new output file for writing. Fails if the file already exists.
+ * The "x" mode makes the check and the create a single step, so two jobs
+ * racing for the same name can't both end up writing to it.
+ *
+ * Callers hand the stream large blocks, so stdio's own buffering is turned
+ * off and each fwrite() goes straight to the file.
+ */
+stl_error_t _stl_create_file(const char *output_file, FILE **fp_new)
+{
+	stl_error_t error = STL_SUCCESS;
+	FILE        *fp = NULL;
+
+	if((NULL == output_file) || (NULL == fp_new))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		errno = 0;
+		fp = fopen(output_file, "wbx");
+		if(NULL == fp)
+		{
+			if(EEXIST == errno)
+			{
+				fprintf(stderr, "Error: Output file %s already exists\n", output_file);
+			}
+			else
+			{
+				fprintf(stderr, "Error: Could not create Output file %s\n", output_file);
+			}
+
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		setvbuf(fp, NULL, _IONBF, 0);
+
+		*fp_new = fp;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_write_file(char *output_file, stl_t *stl)
+{
+	stl_error_t   error = STL_SUCCESS;
+	size_t        res = 0;
+	size_t        i = 0;
+	size_t        chunk = 0;
+	size_t        used = 0;
+	FILE          *fp = NULL;
+	unsigned char *buffer = NULL;
+	stl_facet_t   *scratch = NULL;
+	int           dispatched = 0;
+
+	if((NULL == output_file) || (NULL == stl))
+	{
+		return STL_LOG_ERR(STL_ERROR);
+	}
+
+	/* The count in the file is only 32 bits */
+	if(stl->facets_count > STL_MAX_FILE_FACETS)
+	{
+		error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+	}
+
+	if((STL_SUCCESS == error) && _stl_has_gzip_suffix(output_file))
+	{
+		error = _stl_write_gzip_file(output_file, stl);
+		dispatched = 1;
+	}
+
+	if((STL_SUCCESS == error) && (0 == dispatched))
+	{
+		buffer = (unsigned char *)malloc(STL_FACETS_OFFSET + (STL_WRITE_CHUNK_FACETS * STL_FACET_SIZE));
+		if(NULL == buffer)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	/* A pending transform is applied a chunk at a time on the way out */
+	if((STL_SUCCESS == error) && (0 == dispatched) && (NULL != stl->pending))
+	{
+		scratch = (stl_facet_t *)malloc(STL_WRITE_CHUNK_FACETS * sizeof(scratch[0]));
+		if(NULL == scratch)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
 		}
 	}
 
+	if((STL_SUCCESS == error) && (0 == dispatched))
+	{
+		error = _stl_create_file(output_file, &fp);
+	}
+
+	if((STL_SUCCESS == error) && (0 == dispatched))
+	{
+		/* The header and count go out together with the first block */
+		memcpy(buffer, stl->header, STL_HEADER_SIZE);
+		error = _stl_unpack_le32((unsigned int)stl->facets_count, buffer + STL_HEADER_SIZE);
+		used = STL_FACETS_OFFSET;
+	}
+
+	/* A mapped object already holds the facets in file format, so they
+	 * can be written out as-is.
+	 */
+	if((STL_SUCCESS == error) && (0 == dispatched) && (NULL != stl->mapped_facets) && (NULL == stl->pending))
+	{
+		res = fwrite(buffer, 1, used, fp);
+		if(used != res)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		if(STL_SUCCESS == error)
+		{
+			res = fwrite(stl->mapped_facets, STL_FACET_SIZE, stl->facets_count, fp);
+			if(stl->facets_count != res)
+			{
+				error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+			}
+		}
+	}
+	else if((STL_SUCCESS == error) && (0 == dispatched))
+	{
+		i = 0;
+
+		do
+		{
+			chunk = stl->facets_count - i;
+			if(chunk > STL_WRITE_CHUNK_FACETS)
+			{
+				chunk = STL_WRITE_CHUNK_FACETS;
+			}
+
+			_stl_encode_facets(_stl_get_facets(stl, i, chunk, scratch), chunk, buffer + used);
+			used += chunk * STL_FACET_SIZE;
+
+			res = fwrite(buffer, 1, used, fp);
+			if(used != res)
+			{
+				error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+				break;
+			}
+
+			used = 0;
+			i += chunk;
+		} while(i < stl->facets_count);
+	}
+
 	if(NULL != fp)
 	{
-		fclose(fp);
+		if((0 != fclose(fp)) && (STL_SUCCESS == error))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
 		fp = NULL;
 	}
 
+	if(NULL != buffer)
+	{
+		free(buffer);
+		buffer = NULL;
+	}
+
+	free(scratch);
+
+	return STL_LOG_ERR(error);
+}
+
+#ifndef _WIN32
+/* Direct I/O has to be done in whole, aligned blocks. 4K covers the logical
+ * block size of any disk we're likely to meet.
+ */
+#define STL_DIRECT_ALIGN       4096
+#define STL_DIRECT_BUFFER_SIZE (256 * STL_DIRECT_ALIGN)
+
+/* Output side of stl_write_file_ex(). Bytes are gathered in an aligned
+ * buffer and go out a full buffer at a time.
+ */
+typedef struct
+{
+	int           fd;
+	int           direct;
+	unsigned char *buffer;
+	size_t        buffer_size;
+	size_t        used;
+} stl_out_t;
+
+static stl_error_t stl_out_write(int fd, const unsigned char *data, size_t len)
+{
+	stl_error_t error = STL_SUCCESS;
+	ssize_t     res = 0;
+
+	while((STL_SUCCESS == error) && (len > 0))
+	{
+		res = write(fd, data, len);
+		if(res >= 0)
+		{
+			data += res;
+			len -= (size_t)res;
+		}
+		else if(EINTR != errno)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+static stl_error_t stl_out_put(stl_out_t *out, const unsigned char *data, size_t len)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      chunk = 0;
+
+	while((STL_SUCCESS == error) && (len > 0))
+	{
+		chunk = out->buffer_size - out->used;
+		if(chunk > len)
+		{
+			chunk = len;
+		}
+
+		memcpy(out->buffer + out->used, data, chunk);
+		out->used += chunk;
+		data += chunk;
+		len -= chunk;
+
+		if(out->used == out->buffer_size)
+		{
+			error = stl_out_write(out->fd, out->buffer, out->used);
+			out->used = 0;
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Encode the facets straight into the output buffer. Only a facet that
+ * straddles the end of the buffer takes the extra copy. scratch has room
+ * for STL_WRITE_CHUNK_FACETS facets and is only needed when a transform is
+ * pending.
+ */
+static stl_error_t stl_out_put_facets(stl_out_t *out, const stl_t *stl, stl_facet_t *scratch)
+{
+	stl_error_t   error = STL_SUCCESS;
+	size_t        i = 0;
+	size_t        chunk = 0;
+	unsigned char tmp[STL_FACET_SIZE];
+
+	while((STL_SUCCESS == error) && (i < stl->facets_count))
+	{
+		chunk = (out->buffer_size - out->used) / STL_FACET_SIZE;
+
+		if(0 == chunk)
+		{
+			_stl_encode_facets(_stl_get_facets(stl, i, 1, scratch), 1, tmp);
+			error = stl_out_put(out, tmp, sizeof(tmp));
+			i++;
+			continue;
+		}
+
+		if(chunk > stl->facets_count - i)
+		{
+			chunk = stl->facets_count - i;
+		}
+
+		if(chunk > STL_WRITE_CHUNK_FACETS)
+		{
+			chunk = STL_WRITE_CHUNK_FACETS;
+		}
+
+		_stl_encode_facets(_stl_get_facets(stl, i, chunk, scratch), chunk, out->buffer + out->used);
+		out->used += chunk * STL_FACET_SIZE;
+		i += chunk;
+
+		if(out->used == out->buffer_size)
+		{
+			error = stl_out_write(out->fd, out->buffer, out->used);
+			out->used = 0;
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Write whatever is left. Direct I/O can only write whole blocks, so the
+ * tail is padded out and the file cut back to size afterwards.
+ */
+static stl_error_t stl_out_finish(stl_out_t *out, off_t total)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      padded = out->used;
+
+	if(out->direct && (0 != (padded % STL_DIRECT_ALIGN)))
+	{
+		padded += STL_DIRECT_ALIGN - (padded % STL_DIRECT_ALIGN);
+		memset(out->buffer + out->used, 0x00, padded - out->used);
+	}
+
+	if(padded > 0)
+	{
+		error = stl_out_write(out->fd, out->buffer, padded);
+		out->used = 0;
+	}
+
+	if((STL_SUCCESS == error) && (0 != ftruncate(out->fd, total)))
+	{
+		error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Make the directory entry for a new file durable too
+ */
+static void stl_sync_dir(const char *file)
+{
+	char       *dir = NULL;
+	char       *slash = NULL;
+	int        fd = -1;
+
+	dir = (char *)malloc(strlen(file) + 2);
+	if(NULL == dir)
+	{
+		return;
+	}
+
+	strcpy(dir, file);
+	slash = strrchr(dir, '/');
+	if(NULL == slash)
+	{
+		strcpy(dir, ".");
+	}
+	else
+	{
+		slash[1] = '\0';
+	}
+
+	fd = open(dir, O_RDONLY);
+	if(fd >= 0)
+	{
+		fsync(fd);
+		close(fd);
+	}
+
+	free(dir);
+}
+
+/* rename() that fails with EEXIST rather than replace the output. Where
+ * there's no such call, fails with ENOSYS.
+ */
+static int stl_rename_noreplace(const char *temp_file, const char *output_file)
+{
+#if defined(RENAME_NOREPLACE)
+	return renameat2(AT_FDCWD, temp_file, AT_FDCWD, output_file, RENAME_NOREPLACE);
+#elif defined(RENAME_EXCL)
+	return renamex_np(temp_file, output_file, RENAME_EXCL);
+#else
+	errno = ENOSYS;
+
+	return -1;
+#endif
+}
+
+/* Move a finished temp file into place. link() fails if the output already
+ * exists, so the never-overwrite rule of stl_write_file() still holds, and
+ * other jobs only ever see the complete file. Filesystems without hard
+ * links get a rename that won't replace the output either, and where there
+ * isn't one of those the write fails rather than risk it.
+ */
+static stl_error_t stl_publish_file(const char *temp_file, const char *output_file)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if(0 == link(temp_file, output_file))
+	{
+		unlink(temp_file);
+	}
+	else if(EEXIST == errno)
+	{
+		fprintf(stderr, "Error: Output file %s already exists\n", output_file);
+		error = STL_LOG_ERR(STL_ERROR);
+	}
+	else if(0 != stl_rename_noreplace(temp_file, output_file))
+	{
+		if(EEXIST == errno)
+		{
+			fprintf(stderr, "Error: Output file %s already exists\n", output_file);
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+		else if((ENOSYS == errno) || (EINVAL == errno))
+		{
+			/* No rename here, or this filesystem, that won't overwrite */
+			fprintf(stderr, "Error: Could not safely create Output file %s\n", output_file);
+			error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+		}
+		else
+		{
+			fprintf(stderr, "Error: Could not create Output file %s\n", output_file);
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		stl_sync_dir(output_file);
+	}
+
+	return STL_LOG_ERR(error);
+}
+#endif
+
+#ifndef _WIN32
+/* Write a binary STL file through a plain file descriptor, with the extras
+ * stl_write_file_ex() offers. The arguments have already been checked.
+ */
+static stl_error_t stl_write_binary_ex(char *output_file, stl_t *stl, unsigned int flags)
+{
+	stl_error_t   error = STL_SUCCESS;
+	int           res = 0;
+	int           created = 0;
+	unsigned int  attempt = 0;
+	char          *temp_file = NULL;
+	const char    *path = output_file;
+	off_t         total = 0;
+	unsigned char header[STL_FACETS_OFFSET];
+	stl_out_t     out;
+	stl_facet_t   *scratch = NULL;
+
+	memset(&out, 0x00, sizeof(out));
+	out.fd = -1;
+
+	total = (off_t)STL_FACETS_OFFSET + ((off_t)stl->facets_count * STL_FACET_SIZE);
+
+	if(flags & STL_WRITE_ATOMIC)
+	{
+		/* Fail now rather than after writing the whole file. The link() at
+		 * the end is what really decides.
+		 */
+		if(0 == access(output_file, F_OK))
+		{
+			fprintf(stderr, "Error: Output file %s already exists\n", output_file);
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+
+		if(STL_SUCCESS == error)
+		{
+			temp_file = (char *)malloc(strlen(output_file) + 32);
+			if(NULL == temp_file)
+			{
+				error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+			}
+		}
+
+		if(STL_SUCCESS == error)
+		{
+			/* Next to the output so the final link() stays on one filesystem */
+			for(attempt = 0; attempt < 100; attempt++)
+			{
+				sprintf(temp_file, "%s.tmp%ld.%u", output_file, (long)getpid(), attempt);
+
+				out.fd = open(temp_file, O_WRONLY | O_CREAT | O_EXCL, 0666);
+				if((out.fd >= 0) || (EEXIST != errno))
+				{
+					break;
+				}
+			}
+
+			path = temp_file;
+		}
+	}
+	else
+	{
+		out.fd = open(output_file, O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if((out.fd < 0) && (EEXIST == errno))
+		{
+			fprintf(stderr, "Error: Output file %s already exists\n", output_file);
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if(out.fd < 0)
+		{
+			fprintf(stderr, "Error: Could not create Output file %s\n", path);
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+		else
+		{
+			created = 1;
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		/* The final size is known, so let the filesystem allocate it in one
+		 * go. Running out of space is caught here instead of part way
+		 * through; filesystems that can't preallocate just carry on.
+		 */
+		res = posix_fallocate(out.fd, 0, total);
+		if(ENOSPC == res)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+#ifdef O_DIRECT
+	if((STL_SUCCESS == error) && (flags & STL_WRITE_DIRECT))
+	{
+		/* Not every filesystem takes O_DIRECT, those get a normal write */
+		res = fcntl(out.fd, F_GETFL);
+		if((res >= 0) && (0 == fcntl(out.fd, F_SETFL, res | O_DIRECT)))
+		{
+			out.direct = 1;
+		}
+	}
+#endif
+
+	if(STL_SUCCESS == error)
+	{
+		out.buffer_size = STL_DIRECT_BUFFER_SIZE;
+		if(0 != posix_memalign((void **)&out.buffer, STL_DIRECT_ALIGN, out.buffer_size))
+		{
+			out.buffer = NULL;
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (NULL != stl->pending))
+	{
+		scratch = (stl_facet_t *)malloc(STL_WRITE_CHUNK_FACETS * sizeof(scratch[0]));
+		if(NULL == scratch)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memcpy(header, stl->header, STL_HEADER_SIZE);
+		error = _stl_unpack_le32((unsigned int)stl->facets_count, header + STL_HEADER_SIZE);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_out_put(&out, header, sizeof(header));
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if((NULL != stl->mapped_facets) && (NULL == stl->pending))
+		{
+			error = stl_out_put(&out, stl->mapped_facets, stl->facets_count * STL_FACET_SIZE);
+		}
+		else
+		{
+			error = stl_out_put_facets(&out, stl, scratch);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_out_finish(&out, total);
+	}
+
+	if((STL_SUCCESS == error) && (flags & STL_WRITE_ATOMIC) && (0 != fsync(out.fd)))
+	{
+		error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+	}
+
+	if(out.fd >= 0)
+	{
+		if((0 != close(out.fd)) && (STL_SUCCESS == error))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		out.fd = -1;
+	}
+
+	if((STL_SUCCESS == error) && (NULL != temp_file))
+	{
+		error = stl_publish_file(temp_file, output_file);
+	}
+
+	/* Don't leave a partial file behind */
+	if((STL_SUCCESS != error) && created)
+	{
+		unlink(path);
+	}
+
+	free(temp_file);
+	free(out.buffer);
+	free(scratch);
+
+	return STL_LOG_ERR(error);
+}
+#endif
+
+stl_error_t stl_write_file_ex(char *output_file, stl_t *stl, unsigned int flags)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	/* Flags this doesn't know about are more likely a mistake than something
+	 * that can safely be left out
+	 */
+	if((NULL == output_file) || (NULL == stl) || (0 != (flags & ~(STL_WRITE_ATOMIC | STL_WRITE_DIRECT))))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* The count in the file is only 32 bits */
+	if((STL_SUCCESS == error) && (stl->facets_count > STL_MAX_FILE_FACETS))
+	{
+		error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+	}
+
+#ifdef _WIN32
+	/* None of the extras are available here, only a plain exclusive write */
+	if((STL_SUCCESS == error) && (0 != flags))
+	{
+		error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_write_file(output_file, stl);
+	}
+#else
+	/* Compressed output can't be preallocated, written around the page cache
+	 * or published from a temp file. Plain writes only, don't quietly drop
+	 * what the caller asked for.
+	 */
+	if((STL_SUCCESS == error) && _stl_has_gzip_suffix(output_file))
+	{
+		if(0 != flags)
+		{
+			error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+		}
+		else
+		{
+			error = stl_write_file(output_file, stl);
+		}
+	}
+	else if(STL_SUCCESS == error)
+	{
+		error = stl_write_binary_ex(output_file, stl, flags);
+	}
+#endif
+
 	return STL_LOG_ERR(error);
 }
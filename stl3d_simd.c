@@ -0,0 +1,1406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Vectorized kernels for the facet transforms and normals, picked at run
+ * time from what the CPU supports. Build with STL_NO_SIMD defined to only use the
+ * plain C versions.
+ *
+ * The transform kernels all work in double and do the same operations in
+ * the same order as the plain C one, so every level gives the same result
+ * bit for bit (see STL_SIMD_TOLERANCE). The scale kernel works in float
+ * like the plain C one and matches it exactly too, as do the normal
+ * kernels. So do the orientation search kernels, which work in float.
+ *
+ * That only holds if the compiler leaves multiplies and adds alone. GCC and
+ * clang would otherwise fuse them into FMAs in the AVX2 and AVX-512
+ * functions, which round once instead of twice, so this file has to be
+ * built with -ffp-contract=off (see the Makefile). MSVC doesn't contract
+ * without /fp:contract.
+ *
+ * Each facet is 12 floats (normal, then the three corners) followed by the
+ * attribute bytes, so the kernels work a facet at a time straight on the
+ * array rather than shuffling groups of facets around.
+ */
+
+#if !defined(STL_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define STL_SIMD_X86
+#define STL_SIMD_HAVE_AVX
+#define STL_TARGET(isa) __attribute__((target(isa)))
+#elif !defined(STL_NO_SIMD) && defined(_MSC_VER) && defined(_M_X64)
+/* SSE2 is always there on x64 */
+#include <emmintrin.h>
+#define STL_SIMD_X86
+#define STL_TARGET(isa)
+#endif
+
+/* Level in use, STL_SIMD_AUTO until the first call works it out */
+static stl_simd_t stl_simd_level = STL_SIMD_AUTO;
+
+
+static void stl_xform_scalar(const _stl_xform_t *xform, stl_facet_t *facets, size_t facets_count)
+{
+	size_t       i = 0;
+	int          j = 0;
+	const double *m = xform->m;
+	const double *n = xform->n;
+	double       x = 0.0;
+	double       y = 0.0;
+	double       z = 0.0;
+	double       px = 0.0;
+	double       py = 0.0;
+	double       pz = 0.0;
+	double       length = 0.0;
+	stl_vertex_t *vertex = NULL;
+	stl_vertex_t tmp;
+
+	for(i = 0; i < facets_count; i++)
+	{
+		x = facets[i].normal.x;
+		y = facets[i].normal.y;
+		z = facets[i].normal.z;
+
+		px = n[0] * x + n[1] * y + n[2] * z;
+		py = n[3] * x + n[4] * y + n[5] * z;
+		pz = n[6] * x + n[7] * y + n[8] * z;
+
+		if(xform->normalize)
+		{
+			length = sqrt(px * px + py * py + pz * pz);
+
+			if(length > 0.0)
+			{
+				px /= length;
+				py /= length;
+				pz /= length;
+			}
+		}
+
+		facets[i].normal.x = (float)px;
+		facets[i].normal.y = (float)py;
+		facets[i].normal.z = (float)pz;
+
+		for(j = 0; j < 3; j++)
+		{
+			vertex = &facets[i].verticies[j];
+
+			x = vertex->x;
+			y = vertex->y;
+			z = vertex->z;
+
+			vertex->x = (float)(m[0] * x + m[1] * y + m[2] * z + m[3]);
+			vertex->y = (float)(m[4] * x + m[5] * y + m[6] * z + m[7]);
+			vertex->z = (float)(m[8] * x + m[9] * y + m[10] * z + m[11]);
+		}
+
+		if(xform->flip)
+		{
+			tmp = facets[i].verticies[1];
+			facets[i].verticies[1] = facets[i].verticies[2];
+			facets[i].verticies[2] = tmp;
+		}
+	}
+}
+
+static void stl_scale_scalar(const float scale[3], stl_facet_t *facets, size_t facets_count)
+{
+	size_t i = 0;
+	int    j = 0;
+
+	for(i = 0; i < facets_count; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			facets[i].verticies[j].x *= scale[0];
+			facets[i].verticies[j].y *= scale[1];
+			facets[i].verticies[j].z *= scale[2];
+		}
+
+		facets[i].normal.x = 0.0;
+		facets[i].normal.y = 0.0;
+		facets[i].normal.z = 0.0;
+	}
+}
+
+/* Normals from the corners: the cross product of the two edges leaving the
+ * first corner, scaled to unit length. Facets with no area get a zero
+ * normal.
+ */
+static void stl_normals_scalar(stl_facet_t *facets, size_t facets_count)
+{
+	size_t             i = 0;
+	const stl_vertex_t *v = NULL;
+	double             ax = 0.0;
+	double             ay = 0.0;
+	double             az = 0.0;
+	double             bx = 0.0;
+	double             by = 0.0;
+	double             bz = 0.0;
+	double             nx = 0.0;
+	double             ny = 0.0;
+	double             nz = 0.0;
+	double             length = 0.0;
+	double             inv = 0.0;
+
+	for(i = 0; i < facets_count; i++)
+	{
+		v = facets[i].verticies;
+
+		ax = (double)v[1].x - v[0].x;
+		ay = (double)v[1].y - v[0].y;
+		az = (double)v[1].z - v[0].z;
+
+		bx = (double)v[2].x - v[0].x;
+		by = (double)v[2].y - v[0].y;
+		bz = (double)v[2].z - v[0].z;
+
+		nx = ay * bz - az * by;
+		ny = az * bx - ax * bz;
+		nz = ax * by - ay * bx;
+
+		length = sqrt(nx * nx + ny * ny + nz * nz);
+
+		if(length > 0.0)
+		{
+			inv = 1.0 / length;
+			nx *= inv;
+			ny *= inv;
+			nz *= inv;
+		}
+
+		facets[i].normal.x = (float)nx;
+		facets[i].normal.y = (float)ny;
+		facets[i].normal.z = (float)nz;
+	}
+}
+
+#ifdef STL_SIMD_X86
+
+/* Same as the normalize step in stl_xform_scalar() on one normal already
+ * transformed into p[0..2]
+ */
+static void stl_normalize(double *p)
+{
+	double length = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+
+	if(length > 0.0)
+	{
+		p[0] /= length;
+		p[1] /= length;
+		p[2] /= length;
+	}
+}
+
+STL_TARGET("sse2")
+static void stl_xform_sse2(const _stl_xform_t *xform, stl_facet_t *facets, size_t facets_count)
+{
+	size_t       i = 0;
+	int          j = 0;
+	const double *m = xform->m;
+	const double *n = xform->n;
+	__m128d      mxy[4];
+	__m128d      nxy[3];
+	__m128d      x;
+	__m128d      y;
+	__m128d      z;
+	__m128d      rxy;
+	__m128d      rz;
+	double       p[3];
+	float        out[4][3];
+
+	/* Columns of the matrices, x and y rows in one register, z on its own */
+	for(j = 0; j < 4; j++)
+	{
+		mxy[j] = _mm_set_pd(m[4 + j], m[j]);
+	}
+
+	for(j = 0; j < 3; j++)
+	{
+		nxy[j] = _mm_set_pd(n[3 + j], n[j]);
+	}
+
+	for(i = 0; i < facets_count; i++)
+	{
+		x = _mm_set1_pd(facets[i].normal.x);
+		y = _mm_set1_pd(facets[i].normal.y);
+		z = _mm_set1_pd(facets[i].normal.z);
+
+		rxy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(nxy[0], x), _mm_mul_pd(nxy[1], y)), _mm_mul_pd(nxy[2], z));
+		rz = _mm_add_sd(_mm_add_sd(_mm_mul_sd(_mm_set_sd(n[6]), x), _mm_mul_sd(_mm_set_sd(n[7]), y)),
+			_mm_mul_sd(_mm_set_sd(n[8]), z));
+
+		_mm_storeu_pd(p, rxy);
+		_mm_store_sd(&p[2], rz);
+
+		if(xform->normalize)
+		{
+			stl_normalize(p);
+		}
+
+		out[0][0] = (float)p[0];
+		out[0][1] = (float)p[1];
+		out[0][2] = (float)p[2];
+
+		for(j = 0; j < 3; j++)
+		{
+			x = _mm_set1_pd(facets[i].verticies[j].x);
+			y = _mm_set1_pd(facets[i].verticies[j].y);
+			z = _mm_set1_pd(facets[i].verticies[j].z);
+
+			rxy = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(mxy[0], x), _mm_mul_pd(mxy[1], y)),
+				_mm_mul_pd(mxy[2], z)), mxy[3]);
+			rz = _mm_add_sd(_mm_add_sd(_mm_add_sd(_mm_mul_sd(_mm_set_sd(m[8]), x), _mm_mul_sd(_mm_set_sd(m[9]), y)),
+				_mm_mul_sd(_mm_set_sd(m[10]), z)), _mm_set_sd(m[11]));
+
+			_mm_storel_pi((__m64 *)out[1 + j], _mm_cvtpd_ps(rxy));
+			_mm_store_ss(&out[1 + j][2], _mm_cvtsd_ss(_mm_setzero_ps(), rz));
+		}
+
+		memcpy(&facets[i].normal, out[0], sizeof(out[0]));
+		memcpy(&facets[i].verticies[0], out[1], sizeof(out[1]));
+		memcpy(&facets[i].verticies[1], out[xform->flip ? 3 : 2], sizeof(out[2]));
+		memcpy(&facets[i].verticies[2], out[xform->flip ? 2 : 3], sizeof(out[3]));
+	}
+}
+
+/* Multiplies the 12 floats of each facet by (0 0 0 sx sy sz sx sy sz sx sy
+ * sz) three at a time, masking the normal to zero afterwards so it comes
+ * out as 0.0 whatever was there before, like the plain C version.
+ */
+STL_TARGET("sse2")
+static void stl_scale_sse2(const float scale[3], stl_facet_t *facets, size_t facets_count)
+{
+	size_t i = 0;
+	float  *p = NULL;
+	__m128 s0 = _mm_set_ps(scale[0], 1.0f, 1.0f, 1.0f);
+	__m128 s1 = _mm_set_ps(scale[1], scale[0], scale[2], scale[1]);
+	__m128 s2 = _mm_set_ps(scale[2], scale[1], scale[0], scale[2]);
+	__m128 keep = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+	for(i = 0; i < facets_count; i++)
+	{
+		p = &facets[i].normal.x;
+
+		_mm_storeu_ps(p, _mm_and_ps(_mm_mul_ps(_mm_loadu_ps(p), s0), keep));
+		_mm_storeu_ps(p + 4, _mm_mul_ps(_mm_loadu_ps(p + 4), s1));
+		_mm_storeu_ps(p + 8, _mm_mul_ps(_mm_loadu_ps(p + 8), s2));
+	}
+}
+
+/* Same sums as stl_normals_scalar() on two facets at a time. c holds the
+ * nine corner coordinates of each, n gets the normals.
+ */
+STL_TARGET("sse2")
+static void stl_normals_sse2_two(const __m128d *c, __m128d *n)
+{
+	__m128d ax = _mm_sub_pd(c[3], c[0]);
+	__m128d ay = _mm_sub_pd(c[4], c[1]);
+	__m128d az = _mm_sub_pd(c[5], c[2]);
+	__m128d bx = _mm_sub_pd(c[6], c[0]);
+	__m128d by = _mm_sub_pd(c[7], c[1]);
+	__m128d bz = _mm_sub_pd(c[8], c[2]);
+	__m128d length;
+	__m128d inv;
+	__m128d keep;
+	int     j = 0;
+
+	n[0] = _mm_sub_pd(_mm_mul_pd(ay, bz), _mm_mul_pd(az, by));
+	n[1] = _mm_sub_pd(_mm_mul_pd(az, bx), _mm_mul_pd(ax, bz));
+	n[2] = _mm_sub_pd(_mm_mul_pd(ax, by), _mm_mul_pd(ay, bx));
+
+	length = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(n[0], n[0]), _mm_mul_pd(n[1], n[1])), _mm_mul_pd(n[2], n[2])));
+	inv = _mm_div_pd(_mm_set1_pd(1.0), length);
+	keep = _mm_cmpgt_pd(length, _mm_setzero_pd());
+
+	/* Only scaled where the length is above zero, like the plain C one */
+	for(j = 0; j < 3; j++)
+	{
+		n[j] = _mm_or_pd(_mm_and_pd(keep, _mm_mul_pd(n[j], inv)), _mm_andnot_pd(keep, n[j]));
+	}
+}
+
+STL_TARGET("sse2")
+static void stl_normals_sse2(stl_facet_t *facets, size_t facets_count)
+{
+	size_t      i = 0;
+	int         j = 0;
+	const float *a = NULL;
+	const float *b = NULL;
+	__m128d     c[9];
+	__m128d     n[3];
+	float       out[3][4];
+
+	for(i = 0; i + 2 <= facets_count; i += 2)
+	{
+		a = &facets[i].verticies[0].x;
+		b = &facets[i + 1].verticies[0].x;
+
+		for(j = 0; j < 9; j++)
+		{
+			c[j] = _mm_set_pd(b[j], a[j]);
+		}
+
+		stl_normals_sse2_two(c, n);
+
+		for(j = 0; j < 3; j++)
+		{
+			_mm_storeu_ps(out[j], _mm_cvtpd_ps(n[j]));
+		}
+
+		facets[i].normal.x = out[0][0];
+		facets[i].normal.y = out[1][0];
+		facets[i].normal.z = out[2][0];
+
+		facets[i + 1].normal.x = out[0][1];
+		facets[i + 1].normal.y = out[1][1];
+		facets[i + 1].normal.z = out[2][1];
+	}
+
+	stl_normals_scalar(facets + i, facets_count - i);
+}
+
+#endif  /* STL_SIMD_X86 */
+
+#ifdef STL_SIMD_HAVE_AVX
+
+/* Rows x, y and z of cols * p in one register, the fourth lane unused. p
+ * holds a point in its low three lanes.
+ */
+STL_TARGET("avx2")
+static __m256d stl_xform_avx2_one(const __m256d *cols, __m256d p)
+{
+	return _mm256_add_pd(_mm256_add_pd(
+		_mm256_mul_pd(cols[0], _mm256_permute4x64_pd(p, 0x00)),
+		_mm256_mul_pd(cols[1], _mm256_permute4x64_pd(p, 0x55))),
+		_mm256_mul_pd(cols[2], _mm256_permute4x64_pd(p, 0xAA)));
+}
+
+/* Each result is stored as four floats, the fourth landing on the x of the
+ * next one along before that is stored over it. The last corner only gets
+ * three so the attribute bytes are left alone.
+ */
+STL_TARGET("avx2")
+static void stl_xform_avx2(const _stl_xform_t *xform, stl_facet_t *facets, size_t facets_count)
+{
+	size_t       i = 0;
+	int          j = 0;
+	const double *m = xform->m;
+	const double *n = xform->n;
+	float        *f = NULL;
+	__m256d      mcol[4];
+	__m256d      ncol[3];
+	__m256d      r;
+	__m128       out[4];
+	__m128       tmp;
+	double       p[4];
+
+	for(j = 0; j < 4; j++)
+	{
+		mcol[j] = _mm256_set_pd(0.0, m[8 + j], m[4 + j], m[j]);
+	}
+
+	for(j = 0; j < 3; j++)
+	{
+		ncol[j] = _mm256_set_pd(0.0, n[6 + j], n[3 + j], n[j]);
+	}
+
+	for(i = 0; i < facets_count; i++)
+	{
+		f = &facets[i].normal.x;
+
+		/* The load for the last corner picks up the attribute bytes as its
+		 * fourth float, which goes nowhere
+		 */
+		r = stl_xform_avx2_one(ncol, _mm256_cvtps_pd(_mm_loadu_ps(f)));
+
+		if(xform->normalize)
+		{
+			_mm256_storeu_pd(p, r);
+			stl_normalize(p);
+			r = _mm256_loadu_pd(p);
+		}
+
+		out[0] = _mm256_cvtpd_ps(r);
+
+		for(j = 0; j < 3; j++)
+		{
+			r = _mm256_add_pd(stl_xform_avx2_one(mcol, _mm256_cvtps_pd(_mm_loadu_ps(f + 3 + 3 * j))), mcol[3]);
+			out[1 + j] = _mm256_cvtpd_ps(r);
+		}
+
+		if(xform->flip)
+		{
+			tmp = out[2];
+			out[2] = out[3];
+			out[3] = tmp;
+		}
+
+		_mm_storeu_ps(f, out[0]);
+		_mm_storeu_ps(f + 3, out[1]);
+		_mm_storeu_ps(f + 6, out[2]);
+		_mm_storel_pi((__m64 *)(f + 9), out[3]);
+		_mm_store_ss(f + 11, _mm_movehl_ps(out[3], out[3]));
+	}
+
+	_mm256_zeroupper();
+}
+
+/* Two results at once, cols * a in the low half and cols * b in the high
+ * half. v holds the points as doubles, xi/yi/zi pick out their coordinates.
+ */
+STL_TARGET("avx512f")
+static __m512d stl_xform_avx512_two(const __m512d *cols, __m512d v, __m512i xi, __m512i yi, __m512i zi)
+{
+	return _mm512_add_pd(_mm512_add_pd(
+		_mm512_mul_pd(cols[0], _mm512_permutexvar_pd(xi, v)),
+		_mm512_mul_pd(cols[1], _mm512_permutexvar_pd(yi, v))),
+		_mm512_mul_pd(cols[2], _mm512_permutexvar_pd(zi, v)));
+}
+
+STL_TARGET("avx512f")
+static void stl_xform_avx512(const _stl_xform_t *xform, stl_facet_t *facets, size_t facets_count)
+{
+	size_t       i = 0;
+	int          j = 0;
+	const double *m = xform->m;
+	const double *n = xform->n;
+	float        *f = NULL;
+	__m512d      nmcol[4];
+	__m512d      mmcol[4];
+	__m512d      front;
+	__m512d      back;
+	__m512i      front_x = _mm512_set_epi64(3, 3, 3, 3, 0, 0, 0, 0);
+	__m512i      front_y = _mm512_set_epi64(4, 4, 4, 4, 1, 1, 1, 1);
+	__m512i      front_z = _mm512_set_epi64(5, 5, 5, 5, 2, 2, 2, 2);
+	__m512i      back_x = _mm512_set_epi64(5, 5, 5, 5, 2, 2, 2, 2);
+	__m512i      back_y = _mm512_set_epi64(6, 6, 6, 6, 3, 3, 3, 3);
+	__m512i      back_z = _mm512_set_epi64(7, 7, 7, 7, 4, 4, 4, 4);
+	__m512i      pack = _mm512_set_epi32(15, 11, 7, 3, 14, 13, 12, 10, 9, 8, 6, 5, 4, 2, 1, 0);
+	__m512       packed;
+	double       p[8];
+
+	/* The normal goes through n alongside the first corner through m, then
+	 * the other two corners together. The normal gets no translation, and
+	 * is left out of the add rather than adding 0.0 so -0.0 stays -0.0.
+	 */
+	for(j = 0; j < 4; j++)
+	{
+		mmcol[j] = _mm512_set_pd(0.0, m[8 + j], m[4 + j], m[j], 0.0, m[8 + j], m[4 + j], m[j]);
+
+		if(j < 3)
+		{
+			nmcol[j] = _mm512_set_pd(0.0, m[8 + j], m[4 + j], m[j], 0.0, n[6 + j], n[3 + j], n[j]);
+		}
+		else
+		{
+			nmcol[j] = mmcol[j];
+		}
+	}
+
+	for(i = 0; i < facets_count; i++)
+	{
+		f = &facets[i].normal.x;
+
+		/* Floats 0-7 hold the normal and first corner, 4-11 the other two
+		 * corners, so neither load reaches past the facet
+		 */
+		front = stl_xform_avx512_two(nmcol, _mm512_cvtps_pd(_mm256_loadu_ps(f)), front_x, front_y, front_z);
+		front = _mm512_mask_add_pd(front, 0xF0, front, nmcol[3]);
+
+		back = stl_xform_avx512_two(mmcol, _mm512_cvtps_pd(_mm256_loadu_ps(f + 4)), back_x, back_y, back_z);
+		back = _mm512_add_pd(back, mmcol[3]);
+
+		if(xform->normalize)
+		{
+			_mm512_storeu_pd(p, front);
+			stl_normalize(p);
+			front = _mm512_loadu_pd(p);
+		}
+
+		if(xform->flip)
+		{
+			back = _mm512_shuffle_f64x2(back, back, 0x4E);
+		}
+
+		/* Squeeze out the unused fourth lanes and write the 12 floats */
+		packed = _mm512_castpd_ps(_mm512_insertf64x4(
+			_mm512_castpd256_pd512(_mm256_castps_pd(_mm512_cvtpd_ps(front))),
+			_mm256_castps_pd(_mm512_cvtpd_ps(back)), 1));
+		packed = _mm512_permutexvar_ps(pack, packed);
+
+		_mm256_storeu_ps(f, _mm512_castps512_ps256(packed));
+		_mm_storeu_ps(f + 8, _mm512_extractf32x4_ps(packed, 2));
+	}
+
+	_mm256_zeroupper();
+}
+
+/* The normal kernels below pick the corners of a group of facets out of
+ * the array with gathers, one coordinate of every facet per register, and
+ * work on those.
+ */
+#define STL_FACET_FLOATS ((int)(sizeof(stl_facet_t) / sizeof(float)))
+
+STL_TARGET("avx2")
+static void stl_normals_avx2_four(const __m256d *c, __m256d *n)
+{
+	__m256d ax = _mm256_sub_pd(c[3], c[0]);
+	__m256d ay = _mm256_sub_pd(c[4], c[1]);
+	__m256d az = _mm256_sub_pd(c[5], c[2]);
+	__m256d bx = _mm256_sub_pd(c[6], c[0]);
+	__m256d by = _mm256_sub_pd(c[7], c[1]);
+	__m256d bz = _mm256_sub_pd(c[8], c[2]);
+	__m256d length;
+	__m256d inv;
+	__m256d keep;
+	int     j = 0;
+
+	n[0] = _mm256_sub_pd(_mm256_mul_pd(ay, bz), _mm256_mul_pd(az, by));
+	n[1] = _mm256_sub_pd(_mm256_mul_pd(az, bx), _mm256_mul_pd(ax, bz));
+	n[2] = _mm256_sub_pd(_mm256_mul_pd(ax, by), _mm256_mul_pd(ay, bx));
+
+	length = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(n[0], n[0]),
+		_mm256_mul_pd(n[1], n[1])), _mm256_mul_pd(n[2], n[2])));
+	inv = _mm256_div_pd(_mm256_set1_pd(1.0), length);
+	keep = _mm256_cmp_pd(length, _mm256_setzero_pd(), _CMP_GT_OQ);
+
+	for(j = 0; j < 3; j++)
+	{
+		n[j] = _mm256_blendv_pd(n[j], _mm256_mul_pd(n[j], inv), keep);
+	}
+}
+
+/* Eight facets at a time. AVX2 has no scatter, so the normals go back one
+ * float at a time.
+ */
+STL_TARGET("avx2")
+static void stl_normals_avx2(stl_facet_t *facets, size_t facets_count)
+{
+	size_t  i = 0;
+	int     j = 0;
+	float   *base = NULL;
+	__m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(STL_FACET_FLOATS));
+	__m256  g;
+	__m256d lo[9];
+	__m256d hi[9];
+	__m256d nlo[3];
+	__m256d nhi[3];
+	float   out[3][8];
+
+	for(i = 0; i + 8 <= facets_count; i += 8)
+	{
+		base = &facets[i].verticies[0].x;
+
+		for(j = 0; j < 9; j++)
+		{
+			g = _mm256_i32gather_ps(base + j, idx, 4);
+			lo[j] = _mm256_cvtps_pd(_mm256_castps256_ps128(g));
+			hi[j] = _mm256_cvtps_pd(_mm256_extractf128_ps(g, 1));
+		}
+
+		stl_normals_avx2_four(lo, nlo);
+		stl_normals_avx2_four(hi, nhi);
+
+		for(j = 0; j < 3; j++)
+		{
+			_mm_storeu_ps(out[j], _mm256_cvtpd_ps(nlo[j]));
+			_mm_storeu_ps(out[j] + 4, _mm256_cvtpd_ps(nhi[j]));
+		}
+
+		for(j = 0; j < 8; j++)
+		{
+			facets[i + j].normal.x = out[0][j];
+			facets[i + j].normal.y = out[1][j];
+			facets[i + j].normal.z = out[2][j];
+		}
+	}
+
+	_mm256_zeroupper();
+
+	stl_normals_scalar(facets + i, facets_count - i);
+}
+
+STL_TARGET("avx512f")
+static void stl_normals_avx512_eight(const __m512d *c, __m512d *n)
+{
+	__m512d  ax = _mm512_sub_pd(c[3], c[0]);
+	__m512d  ay = _mm512_sub_pd(c[4], c[1]);
+	__m512d  az = _mm512_sub_pd(c[5], c[2]);
+	__m512d  bx = _mm512_sub_pd(c[6], c[0]);
+	__m512d  by = _mm512_sub_pd(c[7], c[1]);
+	__m512d  bz = _mm512_sub_pd(c[8], c[2]);
+	__m512d  length;
+	__m512d  inv;
+	__mmask8 keep;
+	int      j = 0;
+
+	n[0] = _mm512_sub_pd(_mm512_mul_pd(ay, bz), _mm512_mul_pd(az, by));
+	n[1] = _mm512_sub_pd(_mm512_mul_pd(az, bx), _mm512_mul_pd(ax, bz));
+	n[2] = _mm512_sub_pd(_mm512_mul_pd(ax, by), _mm512_mul_pd(ay, bx));
+
+	length = _mm512_sqrt_pd(_mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(n[0], n[0]),
+		_mm512_mul_pd(n[1], n[1])), _mm512_mul_pd(n[2], n[2])));
+	inv = _mm512_div_pd(_mm512_set1_pd(1.0), length);
+	keep = _mm512_cmp_pd_mask(length, _mm512_setzero_pd(), _CMP_GT_OQ);
+
+	for(j = 0; j < 3; j++)
+	{
+		n[j] = _mm512_mask_mul_pd(n[j], keep, n[j], inv);
+	}
+}
+
+/* Sixteen facets at a time, gathered and scattered straight to and from
+ * the array
+ */
+STL_TARGET("avx512f")
+static void stl_normals_avx512(stl_facet_t *facets, size_t facets_count)
+{
+	size_t  i = 0;
+	int     j = 0;
+	float   *base = NULL;
+	__m512i idx = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32(STL_FACET_FLOATS));
+	__m512  g;
+	__m512d lo[9];
+	__m512d hi[9];
+	__m512d nlo[3];
+	__m512d nhi[3];
+	__m512  out;
+
+	for(i = 0; i + 16 <= facets_count; i += 16)
+	{
+		base = &facets[i].verticies[0].x;
+
+		for(j = 0; j < 9; j++)
+		{
+			g = _mm512_i32gather_ps(idx, base + j, 4);
+			lo[j] = _mm512_cvtps_pd(_mm512_castps512_ps256(g));
+			hi[j] = _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(g), 1)));
+		}
+
+		stl_normals_avx512_eight(lo, nlo);
+		stl_normals_avx512_eight(hi, nhi);
+
+		for(j = 0; j < 3; j++)
+		{
+			out = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(nlo[j]))),
+				_mm256_castps_pd(_mm512_cvtpd_ps(nhi[j])), 1));
+			_mm512_i32scatter_ps(&facets[i].normal.x + j, idx, out, 4);
+		}
+	}
+
+	_mm256_zeroupper();
+
+	stl_normals_scalar(facets + i, facets_count - i);
+}
+
+#endif  /* STL_SIMD_HAVE_AVX */
+
+/* Kernels for a transform over separate x, y and z arrays, as held by
+ * stl_soa_t, in place and several corners to a register. m is the top
+ * three rows of the matrix.
+ */
+static void stl_points_scalar(const double m[12], float *x, float *y, float *z, size_t count)
+{
+	size_t i = 0;
+	double px = 0.0;
+	double py = 0.0;
+	double pz = 0.0;
+
+	for(i = 0; i < count; i++)
+	{
+		px = x[i];
+		py = y[i];
+		pz = z[i];
+
+		x[i] = (float)(m[0] * px + m[1] * py + m[2] * pz + m[3]);
+		y[i] = (float)(m[4] * px + m[5] * py + m[6] * pz + m[7]);
+		z[i] = (float)(m[8] * px + m[9] * py + m[10] * pz + m[11]);
+	}
+}
+
+#ifdef STL_SIMD_X86
+
+STL_TARGET("sse2")
+static __m128d stl_points_sse2_row(const __m128d *r, __m128d vx, __m128d vy, __m128d vz)
+{
+	return _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(r[0], vx), _mm_mul_pd(r[1], vy)), _mm_mul_pd(r[2], vz)), r[3]);
+}
+
+STL_TARGET("sse2")
+static void stl_points_sse2(const double m[12], float *x, float *y, float *z, size_t count)
+{
+	size_t  i = 0;
+	int     j = 0;
+	__m128d r[12];
+	__m128d vx;
+	__m128d vy;
+	__m128d vz;
+
+	for(j = 0; j < 12; j++)
+	{
+		r[j] = _mm_set1_pd(m[j]);
+	}
+
+	/* Two corners at a time */
+	for(i = 0; i + 2 <= count; i += 2)
+	{
+		vx = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double *)(x + i))));
+		vy = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double *)(y + i))));
+		vz = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double *)(z + i))));
+
+		_mm_storel_pi((__m64 *)(x + i), _mm_cvtpd_ps(stl_points_sse2_row(&r[0], vx, vy, vz)));
+		_mm_storel_pi((__m64 *)(y + i), _mm_cvtpd_ps(stl_points_sse2_row(&r[4], vx, vy, vz)));
+		_mm_storel_pi((__m64 *)(z + i), _mm_cvtpd_ps(stl_points_sse2_row(&r[8], vx, vy, vz)));
+	}
+
+	stl_points_scalar(m, x + i, y + i, z + i, count - i);
+}
+
+#endif  /* STL_SIMD_X86 */
+
+#ifdef STL_SIMD_HAVE_AVX
+
+STL_TARGET("avx2")
+static __m128 stl_points_avx2_row(const __m256d *r, __m256d vx, __m256d vy, __m256d vz)
+{
+	return _mm256_cvtpd_ps(_mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+		_mm256_mul_pd(r[0], vx), _mm256_mul_pd(r[1], vy)), _mm256_mul_pd(r[2], vz)), r[3]));
+}
+
+STL_TARGET("avx2")
+static void stl_points_avx2(const double m[12], float *x, float *y, float *z, size_t count)
+{
+	size_t  i = 0;
+	int     j = 0;
+	__m256d r[12];
+	__m256d vx;
+	__m256d vy;
+	__m256d vz;
+
+	for(j = 0; j < 12; j++)
+	{
+		r[j] = _mm256_set1_pd(m[j]);
+	}
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		vx = _mm256_cvtps_pd(_mm_loadu_ps(x + i));
+		vy = _mm256_cvtps_pd(_mm_loadu_ps(y + i));
+		vz = _mm256_cvtps_pd(_mm_loadu_ps(z + i));
+
+		_mm_storeu_ps(x + i, stl_points_avx2_row(&r[0], vx, vy, vz));
+		_mm_storeu_ps(y + i, stl_points_avx2_row(&r[4], vx, vy, vz));
+		_mm_storeu_ps(z + i, stl_points_avx2_row(&r[8], vx, vy, vz));
+	}
+
+	_mm256_zeroupper();
+
+	stl_points_scalar(m, x + i, y + i, z + i, count - i);
+}
+
+STL_TARGET("avx512f")
+static __m256 stl_points_avx512_row(const __m512d *r, __m512d vx, __m512d vy, __m512d vz)
+{
+	return _mm512_cvtpd_ps(_mm512_add_pd(_mm512_add_pd(_mm512_add_pd(
+		_mm512_mul_pd(r[0], vx), _mm512_mul_pd(r[1], vy)), _mm512_mul_pd(r[2], vz)), r[3]));
+}
+
+STL_TARGET("avx512f")
+static void stl_points_avx512(const double m[12], float *x, float *y, float *z, size_t count)
+{
+	size_t  i = 0;
+	int     j = 0;
+	__m512d r[12];
+	__m512d vx;
+	__m512d vy;
+	__m512d vz;
+
+	for(j = 0; j < 12; j++)
+	{
+		r[j] = _mm512_set1_pd(m[j]);
+	}
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		vx = _mm512_cvtps_pd(_mm256_loadu_ps(x + i));
+		vy = _mm512_cvtps_pd(_mm256_loadu_ps(y + i));
+		vz = _mm512_cvtps_pd(_mm256_loadu_ps(z + i));
+
+		_mm256_storeu_ps(x + i, stl_points_avx512_row(&r[0], vx, vy, vz));
+		_mm256_storeu_ps(y + i, stl_points_avx512_row(&r[4], vx, vy, vz));
+		_mm256_storeu_ps(z + i, stl_points_avx512_row(&r[8], vx, vy, vz));
+	}
+
+	_mm256_zeroupper();
+
+	stl_points_scalar(m, x + i, y + i, z + i, count - i);
+}
+
+#endif  /* STL_SIMD_HAVE_AVX */
+
+/* Kernels for the orientation search. Heights are worked out in float in
+ * the same order everywhere. The overhang sums are spread over 8 running
+ * totals by facet, (i - first) % 8, at every width, and the AVX-512 kernel
+ * adds its two halves in turn, so every level adds the same numbers in the
+ * same order and gives the same answer.
+ */
+#define STL_ORIENT_LANES 8
+
+static float stl_orient_height(const _stl_orient_facets_t *f, int j, size_t i, const float *up)
+{
+	return f->x[j][i] * up[0] + f->y[j][i] * up[1] + f->z[j][i] * up[2];
+}
+
+static void stl_range_scalar(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float *min, float *max)
+{
+	size_t i = 0;
+	int    j = 0;
+	float  h = 0.0f;
+
+	for(i = first; i < first + count; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			h = stl_orient_height(f, j, i, up);
+
+			*min = (h < *min) ? h : *min;
+			*max = (h > *max) ? h : *max;
+		}
+	}
+}
+
+/* Add the overhang of facets [first, first + count) into sums, facet
+ * first + k going to sums[k % 8]
+ */
+static void stl_overhang_add(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float bed, float *sums)
+{
+	size_t i = 0;
+	float  h[3];
+	float  top = 0.0f;
+	float  s = 0.0f;
+	int    j = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			h[j] = stl_orient_height(f, j, first + i, up);
+		}
+
+		top = (h[1] > h[0]) ? h[1] : h[0];
+		top = (h[2] > top) ? h[2] : top;
+
+		s = f->ax[first + i] * up[0] + f->ay[first + i] * up[1] + f->az[first + i] * up[2];
+
+		sums[i % STL_ORIENT_LANES] += ((s < f->threshold[first + i]) && (top > bed)) ? -s : 0.0f;
+	}
+}
+
+static double stl_overhang_total(const float *sums)
+{
+	double total = 0.0;
+	int    j = 0;
+
+	for(j = 0; j < STL_ORIENT_LANES; j++)
+	{
+		total += sums[j];
+	}
+
+	return total;
+}
+
+static double stl_overhang_scalar(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float bed)
+{
+	float sums[STL_ORIENT_LANES];
+
+	memset(sums, 0x00, sizeof(sums));
+
+	stl_overhang_add(f, first, count, up, bed, sums);
+
+	return stl_overhang_total(sums);
+}
+
+#ifdef STL_SIMD_X86
+
+STL_TARGET("sse2")
+static __m128 stl_height_sse2(const _stl_orient_facets_t *f, int j, size_t i, const __m128 *u)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(f->x[j] + i), u[0]),
+		_mm_mul_ps(_mm_loadu_ps(f->y[j] + i), u[1])), _mm_mul_ps(_mm_loadu_ps(f->z[j] + i), u[2]));
+}
+
+STL_TARGET("sse2")
+static void stl_range_sse2(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float *min, float *max)
+{
+	size_t i = 0;
+	int    j = 0;
+	__m128 u[3];
+	__m128 h;
+	__m128 lo = _mm_set1_ps(*min);
+	__m128 hi = _mm_set1_ps(*max);
+	float  lanes[8];
+
+	for(j = 0; j < 3; j++)
+	{
+		u[j] = _mm_set1_ps(up[j]);
+	}
+
+	for(i = first; i + 4 <= first + count; i += 4)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			h = stl_height_sse2(f, j, i, u);
+
+			lo = _mm_min_ps(h, lo);
+			hi = _mm_max_ps(h, hi);
+		}
+	}
+
+	_mm_storeu_ps(lanes, lo);
+	_mm_storeu_ps(lanes + 4, hi);
+
+	for(j = 0; j < 4; j++)
+	{
+		*min = (lanes[j] < *min) ? lanes[j] : *min;
+		*max = (lanes[4 + j] > *max) ? lanes[4 + j] : *max;
+	}
+
+	stl_range_scalar(f, i, first + count - i, up, min, max);
+}
+
+/* Overhang of the four facets from i on */
+STL_TARGET("sse2")
+static __m128 stl_overhang_sse2_four(const _stl_orient_facets_t *f, size_t i, const __m128 *u, __m128 bed, __m128 sign)
+{
+	__m128 top;
+	__m128 s;
+	__m128 need;
+
+	top = _mm_max_ps(stl_height_sse2(f, 1, i, u), stl_height_sse2(f, 0, i, u));
+	top = _mm_max_ps(stl_height_sse2(f, 2, i, u), top);
+
+	s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(f->ax + i), u[0]),
+		_mm_mul_ps(_mm_loadu_ps(f->ay + i), u[1])), _mm_mul_ps(_mm_loadu_ps(f->az + i), u[2]));
+
+	need = _mm_and_ps(_mm_cmplt_ps(s, _mm_loadu_ps(f->threshold + i)), _mm_cmpgt_ps(top, bed));
+
+	return _mm_and_ps(need, _mm_xor_ps(s, sign));
+}
+
+STL_TARGET("sse2")
+static double stl_overhang_sse2(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float bed)
+{
+	size_t i = 0;
+	int    j = 0;
+	__m128 u[3];
+	__m128 b = _mm_set1_ps(bed);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 sum_lo = _mm_setzero_ps();
+	__m128 sum_hi = _mm_setzero_ps();
+	float  sums[STL_ORIENT_LANES];
+
+	for(j = 0; j < 3; j++)
+	{
+		u[j] = _mm_set1_ps(up[j]);
+	}
+
+	for(i = first; i + 8 <= first + count; i += 8)
+	{
+		sum_lo = _mm_add_ps(sum_lo, stl_overhang_sse2_four(f, i, u, b, sign));
+		sum_hi = _mm_add_ps(sum_hi, stl_overhang_sse2_four(f, i + 4, u, b, sign));
+	}
+
+	_mm_storeu_ps(sums, sum_lo);
+	_mm_storeu_ps(sums + 4, sum_hi);
+
+	stl_overhang_add(f, i, first + count - i, up, bed, sums);
+
+	return stl_overhang_total(sums);
+}
+
+#endif  /* STL_SIMD_X86 */
+
+#ifdef STL_SIMD_HAVE_AVX
+
+STL_TARGET("avx2")
+static __m256 stl_height_avx2(const _stl_orient_facets_t *f, int j, size_t i, const __m256 *u)
+{
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(f->x[j] + i), u[0]),
+		_mm256_mul_ps(_mm256_loadu_ps(f->y[j] + i), u[1])), _mm256_mul_ps(_mm256_loadu_ps(f->z[j] + i), u[2]));
+}
+
+STL_TARGET("avx2")
+static void stl_range_avx2(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float *min, float *max)
+{
+	size_t i = 0;
+	int    j = 0;
+	__m256 u[3];
+	__m256 h;
+	__m256 lo = _mm256_set1_ps(*min);
+	__m256 hi = _mm256_set1_ps(*max);
+	float  lanes[16];
+
+	for(j = 0; j < 3; j++)
+	{
+		u[j] = _mm256_set1_ps(up[j]);
+	}
+
+	for(i = first; i + 8 <= first + count; i += 8)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			h = stl_height_avx2(f, j, i, u);
+
+			lo = _mm256_min_ps(h, lo);
+			hi = _mm256_max_ps(h, hi);
+		}
+	}
+
+	_mm256_storeu_ps(lanes, lo);
+	_mm256_storeu_ps(lanes + 8, hi);
+
+	_mm256_zeroupper();
+
+	for(j = 0; j < 8; j++)
+	{
+		*min = (lanes[j] < *min) ? lanes[j] : *min;
+		*max = (lanes[8 + j] > *max) ? lanes[8 + j] : *max;
+	}
+
+	stl_range_scalar(f, i, first + count - i, up, min, max);
+}
+
+STL_TARGET("avx2")
+static double stl_overhang_avx2(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float bed)
+{
+	size_t i = 0;
+	int    j = 0;
+	__m256 u[3];
+	__m256 b = _mm256_set1_ps(bed);
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 sum = _mm256_setzero_ps();
+	__m256 top;
+	__m256 s;
+	__m256 need;
+	float  sums[STL_ORIENT_LANES];
+
+	for(j = 0; j < 3; j++)
+	{
+		u[j] = _mm256_set1_ps(up[j]);
+	}
+
+	for(i = first; i + 8 <= first + count; i += 8)
+	{
+		top = _mm256_max_ps(stl_height_avx2(f, 1, i, u), stl_height_avx2(f, 0, i, u));
+		top = _mm256_max_ps(stl_height_avx2(f, 2, i, u), top);
+
+		s = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(f->ax + i), u[0]),
+			_mm256_mul_ps(_mm256_loadu_ps(f->ay + i), u[1])), _mm256_mul_ps(_mm256_loadu_ps(f->az + i), u[2]));
+
+		need = _mm256_and_ps(_mm256_cmp_ps(s, _mm256_loadu_ps(f->threshold + i), _CMP_LT_OQ),
+			_mm256_cmp_ps(top, b, _CMP_GT_OQ));
+
+		sum = _mm256_add_ps(sum, _mm256_and_ps(need, _mm256_xor_ps(s, sign)));
+	}
+
+	_mm256_storeu_ps(sums, sum);
+
+	_mm256_zeroupper();
+
+	stl_overhang_add(f, i, first + count - i, up, bed, sums);
+
+	return stl_overhang_total(sums);
+}
+
+STL_TARGET("avx512f")
+static __m512 stl_height_avx512(const _stl_orient_facets_t *f, int j, size_t i, const __m512 *u)
+{
+	return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(f->x[j] + i), u[0]),
+		_mm512_mul_ps(_mm512_loadu_ps(f->y[j] + i), u[1])), _mm512_mul_ps(_mm512_loadu_ps(f->z[j] + i), u[2]));
+}
+
+STL_TARGET("avx512f")
+static void stl_range_avx512(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float *min, float *max)
+{
+	size_t i = 0;
+	int    j = 0;
+	__m512 u[3];
+	__m512 h;
+	__m512 lo = _mm512_set1_ps(*min);
+	__m512 hi = _mm512_set1_ps(*max);
+	float  lanes[32];
+
+	for(j = 0; j < 3; j++)
+	{
+		u[j] = _mm512_set1_ps(up[j]);
+	}
+
+	for(i = first; i + 16 <= first + count; i += 16)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			h = stl_height_avx512(f, j, i, u);
+
+			lo = _mm512_min_ps(h, lo);
+			hi = _mm512_max_ps(h, hi);
+		}
+	}
+
+	_mm512_storeu_ps(lanes, lo);
+	_mm512_storeu_ps(lanes + 16, hi);
+
+	_mm256_zeroupper();
+
+	for(j = 0; j < 16; j++)
+	{
+		*min = (lanes[j] < *min) ? lanes[j] : *min;
+		*max = (lanes[16 + j] > *max) ? lanes[16 + j] : *max;
+	}
+
+	stl_range_scalar(f, i, first + count - i, up, min, max);
+}
+
+STL_TARGET("avx512f")
+static double stl_overhang_avx512(const _stl_orient_facets_t *f, size_t first, size_t count, const float *up, float bed)
+{
+	size_t    i = 0;
+	int       j = 0;
+	__m512    u[3];
+	__m512    b = _mm512_set1_ps(bed);
+	__m512    top;
+	__m512    s;
+	__m512    o;
+	__mmask16 need;
+	__m256    sum = _mm256_setzero_ps();
+	float     sums[STL_ORIENT_LANES];
+
+	for(j = 0; j < 3; j++)
+	{
+		u[j] = _mm512_set1_ps(up[j]);
+	}
+
+	for(i = first; i + 16 <= first + count; i += 16)
+	{
+		top = _mm512_max_ps(stl_height_avx512(f, 1, i, u), stl_height_avx512(f, 0, i, u));
+		top = _mm512_max_ps(stl_height_avx512(f, 2, i, u), top);
+
+		s = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(f->ax + i), u[0]),
+			_mm512_mul_ps(_mm512_loadu_ps(f->ay + i), u[1])), _mm512_mul_ps(_mm512_loadu_ps(f->az + i), u[2]));
+
+		need = _mm512_cmp_ps_mask(s, _mm512_loadu_ps(f->threshold + i), _CMP_LT_OQ) &
+			_mm512_cmp_ps_mask(top, b, _CMP_GT_OQ);
+
+		o = _mm512_maskz_sub_ps(need, _mm512_setzero_ps(), s);
+
+		/* The first eight facets, then the next eight, like the others */
+		sum = _mm256_add_ps(sum, _mm512_castps512_ps256(o));
+		sum = _mm256_add_ps(sum, _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(o), 1)));
+	}
+
+	_mm256_storeu_ps(sums, sum);
+
+	_mm256_zeroupper();
+
+	stl_overhang_add(f, i, first + count - i, up, bed, sums);
+
+	return stl_overhang_total(sums);
+}
+
+#endif  /* STL_SIMD_HAVE_AVX */
+
+/* Best level this CPU can run
+ */
+static stl_simd_t stl_simd_detect(void)
+{
+#if defined(STL_SIMD_HAVE_AVX)
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx512f"))
+	{
+		return STL_SIMD_AVX512;
+	}
+
+	if(__builtin_cpu_supports("avx2"))
+	{
+		return STL_SIMD_AVX2;
+	}
+
+	if(__builtin_cpu_supports("sse2"))
+	{
+		return STL_SIMD_SSE2;
+	}
+#elif defined(STL_SIMD_X86)
+	return STL_SIMD_SSE2;
+#endif
+
+	return STL_SIMD_SCALAR;
+}
+
+stl_error_t stl_set_simd(stl_simd_t level)
+{
+	stl_simd_t best = stl_simd_detect();
+
+	if(STL_SIMD_AUTO == level)
+	{
+		level = best;
+	}
+
+	if((level < STL_SIMD_SCALAR) || (level > best))
+	{
+		return STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+	}
+
+	stl_simd_level = level;
+
+	return STL_SUCCESS;
+}
+
+stl_simd_t stl_get_simd(void)
+{
+	/* Threads racing here all store the same value */
+	if(STL_SIMD_AUTO == stl_simd_level)
+	{
+		stl_simd_level = stl_simd_detect();
+	}
+
+	return stl_simd_level;
+}
+
+void _stl_xform_facets(const _stl_xform_t *xform, stl_facet_t *facets, size_t facets_count)
+{
+	switch(stl_get_simd())
+	{
+#ifdef STL_SIMD_HAVE_AVX
+	case STL_SIMD_AVX512:
+		stl_xform_avx512(xform, facets, facets_count);
+		break;
+
+	case STL_SIMD_AVX2:
+		stl_xform_avx2(xform, facets, facets_count);
+		break;
+#endif
+#ifdef STL_SIMD_X86
+	case STL_SIMD_SSE2:
+		stl_xform_sse2(xform, facets, facets_count);
+		break;
+#endif
+	default:
+		stl_xform_scalar(xform, facets, facets_count);
+		break;
+	}
+}
+
+void _stl_xform_points(const double m[12], float *x, float *y, float *z, size_t count)
+{
+	switch(stl_get_simd())
+	{
+#ifdef STL_SIMD_HAVE_AVX
+	case STL_SIMD_AVX512:
+		stl_points_avx512(m, x, y, z, count);
+		break;
+
+	case STL_SIMD_AVX2:
+		stl_points_avx2(m, x, y, z, count);
+		break;
+#endif
+#ifdef STL_SIMD_X86
+	case STL_SIMD_SSE2:
+		stl_points_sse2(m, x, y, z, count);
+		break;
+#endif
+	default:
+		stl_points_scalar(m, x, y, z, count);
+		break;
+	}
+}
+
+void _stl_scale_facets(const float scale[3], stl_facet_t *facets, size_t facets_count)
+{
+	/* Scaling is a few multiplies per facet and waits on memory whatever
+	 * the width, so the SSE2 version does for all the x86 levels
+	 */
+#ifdef STL_SIMD_X86
+	if(STL_SIMD_SCALAR != stl_get_simd())
+	{
+		stl_scale_sse2(scale, facets, facets_count);
+		return;
+	}
+#endif
+
+	stl_scale_scalar(scale, facets, facets_count);
+}
+
+void _stl_normals_facets(stl_facet_t *facets, size_t facets_count)
+{
+	switch(stl_get_simd())
+	{
+#ifdef STL_SIMD_HAVE_AVX
+	case STL_SIMD_AVX512:
+		stl_normals_avx512(facets, facets_count);
+		break;
+
+	case STL_SIMD_AVX2:
+		stl_normals_avx2(facets, facets_count);
+		break;
+#endif
+#ifdef STL_SIMD_X86
+	case STL_SIMD_SSE2:
+		stl_normals_sse2(facets, facets_count);
+		break;
+#endif
+	default:
+		stl_normals_scalar(facets, facets_count);
+		break;
+	}
+}
+
+void _stl_orient_range(const _stl_orient_facets_t *facets, size_t first, size_t count, const float up[3], float *min, float *max)
+{
+	switch(stl_get_simd())
+	{
+#ifdef STL_SIMD_HAVE_AVX
+	case STL_SIMD_AVX512:
+		stl_range_avx512(facets, first, count, up, min, max);
+		break;
+
+	case STL_SIMD_AVX2:
+		stl_range_avx2(facets, first, count, up, min, max);
+		break;
+#endif
+#ifdef STL_SIMD_X86
+	case STL_SIMD_SSE2:
+		stl_range_sse2(facets, first, count, up, min, max);
+		break;
+#endif
+	default:
+		stl_range_scalar(facets, first, count, up, min, max);
+		break;
+	}
+}
+
+double _stl_orient_overhang(const _stl_orient_facets_t *facets, size_t first, size_t count, const float up[3], float bed)
+{
+	switch(stl_get_simd())
+	{
+#ifdef STL_SIMD_HAVE_AVX
+	case STL_SIMD_AVX512:
+		return stl_overhang_avx512(facets, first, count, up, bed);
+
+	case STL_SIMD_AVX2:
+		return stl_overhang_avx2(facets, first, count, up, bed);
+#endif
+#ifdef STL_SIMD_X86
+	case STL_SIMD_SSE2:
+		return stl_overhang_sse2(facets, first, count, up, bed);
+#endif
+	default:
+		return stl_overhang_scalar(facets, first, count, up, bed);
+	}
+}
@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Structure of arrays objects. Every array lives in one aligned block,
+ * each starting on its own STL_ALIGN boundary, so the per coordinate loops
+ * below run over plain contiguous floats and vectorize.
+ */
+
+/* Bytes taken by an array of count elements of size bytes, rounded up to
+ * the alignment. Returns 0 if that doesn't fit in a size_t.
+ */
+static int stl_soa_array_size(size_t count, size_t size, size_t *bytes)
+{
+	if(!_stl_size_mul(count, size, bytes) || (*bytes > ((size_t)-1) - STL_ALIGN))
+	{
+		return 0;
+	}
+
+	*bytes = ((*bytes + STL_ALIGN - 1) / STL_ALIGN) * STL_ALIGN;
+
+	return 1;
+}
+
+stl_error_t stl_soa_new(stl_soa_t **soa_new, size_t facets_count)
+{
+	stl_error_t   error = STL_SUCCESS;
+	size_t        corners = 0;
+	size_t        corner_bytes = 0;
+	size_t        normal_bytes = 0;
+	size_t        abc_bytes = 0;
+	size_t        array_bytes = 0;
+	size_t        total = 0;
+	unsigned char *block = NULL;
+	stl_soa_t     *soa = NULL;
+
+	if(NULL == soa_new)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* Three corner arrays, three normal arrays and the attributes */
+	if(STL_SUCCESS == error)
+	{
+		if(!_stl_size_mul(facets_count, 3, &corners) ||
+			!stl_soa_array_size(corners, sizeof(float), &corner_bytes) ||
+			!stl_soa_array_size(facets_count, sizeof(float), &normal_bytes) ||
+			!stl_soa_array_size(facets_count, sizeof(unsigned short), &abc_bytes))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		array_bytes = corner_bytes + normal_bytes;
+
+		if((array_bytes < corner_bytes) ||
+			!_stl_size_mul(array_bytes, 3, &total) ||
+			(total > ((size_t)-1) - abc_bytes))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		total += abc_bytes;
+
+		soa = (stl_soa_t *)malloc(sizeof(*soa));
+		if(NULL == soa)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(soa, 0x00, sizeof(*soa));
+
+		block = (unsigned char *)_stl_alloc_aligned(total);
+		if(NULL == block)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(block, 0x00, total);
+
+		soa->block = block;
+		soa->facets_count = facets_count;
+
+		soa->x = (float *)block;
+		soa->y = (float *)(block + corner_bytes);
+		soa->z = (float *)(block + 2 * corner_bytes);
+
+		block += 3 * corner_bytes;
+
+		soa->normal_x = (float *)block;
+		soa->normal_y = (float *)(block + normal_bytes);
+		soa->normal_z = (float *)(block + 2 * normal_bytes);
+
+		soa->abc = (unsigned short *)(block + 3 * normal_bytes);
+
+		*soa_new = soa;
+		soa = NULL;
+	}
+
+	free(soa);
+
+	return STL_LOG_ERR(error);
+}
+
+void stl_soa_free(stl_soa_t *soa)
+{
+	if(NULL == soa)
+	{
+		return;
+	}
+
+	_stl_free_aligned(soa->block);
+	soa->block = NULL;
+
+	free(soa);
+}
+
+/* Copy count facets starting at facet first in and out of the arrays
+ */
+static void stl_soa_put(stl_soa_t *soa, size_t first, const stl_facet_t *facets, size_t count)
+{
+	size_t i = 0;
+	size_t j = 0;
+	size_t k = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		k = first + i;
+
+		soa->normal_x[k] = facets[i].normal.x;
+		soa->normal_y[k] = facets[i].normal.y;
+		soa->normal_z[k] = facets[i].normal.z;
+
+		for(j = 0; j < 3; j++)
+		{
+			soa->x[3 * k + j] = facets[i].verticies[j].x;
+			soa->y[3 * k + j] = facets[i].verticies[j].y;
+			soa->z[3 * k + j] = facets[i].verticies[j].z;
+		}
+
+		soa->abc[k] = facets[i].abc;
+	}
+}
+
+static void stl_soa_get(const stl_soa_t *soa, size_t first, stl_facet_t *facets, size_t count)
+{
+	size_t i = 0;
+	size_t j = 0;
+	size_t k = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		k = first + i;
+
+		facets[i].normal.x = soa->normal_x[k];
+		facets[i].normal.y = soa->normal_y[k];
+		facets[i].normal.z = soa->normal_z[k];
+
+		for(j = 0; j < 3; j++)
+		{
+			facets[i].verticies[j].x = soa->x[3 * k + j];
+			facets[i].verticies[j].y = soa->y[3 * k + j];
+			facets[i].verticies[j].z = soa->z[3 * k + j];
+		}
+
+		facets[i].abc = soa->abc[k];
+	}
+}
+
+stl_error_t stl_to_soa(stl_t *stl, stl_soa_t **soa_new)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      i = 0;
+	stl_facet_t tmp;
+	stl_soa_t   *soa = NULL;
+
+	if((NULL == stl) || (NULL == soa_new))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_soa_new(&soa, stl->facets_count);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memcpy(soa->header, stl->header, STL_HEADER_SIZE);
+
+		if((NULL != stl->facets) && (NULL == stl->pending))
+		{
+			stl_soa_put(soa, 0, stl->facets, stl->facets_count);
+		}
+		else
+		{
+			/* Mapped or with a transform pending, a facet at a time
+			 * rather than copying the whole file to the heap first
+			 */
+			for(i = 0; i < stl->facets_count; i++)
+			{
+				stl_soa_put(soa, i, _stl_get_facet(stl, i, &tmp), 1);
+			}
+		}
+
+		*soa_new = soa;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_from_soa(stl_soa_t *soa, stl_t **stl_out)
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_t       *stl = NULL;
+
+	if((NULL == soa) || (NULL == stl_out))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_new(&stl, soa->facets_count);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memcpy(stl->header, soa->header, STL_HEADER_SIZE);
+		stl_soa_get(soa, 0, stl->facets, soa->facets_count);
+
+		*stl_out = stl;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_soa_transform(const double m[16], stl_soa_t *soa)
+{
+	stl_error_t  error = STL_SUCCESS;
+	size_t       i = 0;
+	double       px = 0.0;
+	double       py = 0.0;
+	double       pz = 0.0;
+	double       length = 0.0;
+	float        tmp = 0.0f;
+	float        *nx = NULL;
+	float        *ny = NULL;
+	float        *nz = NULL;
+	_stl_xform_t xform;
+
+	if((NULL == m) || (NULL == soa))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_xform_prepare(m, &xform);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		/* One pass over the corners, several at a time. Same arithmetic
+		 * in the same order as the facet kernels.
+		 */
+		_stl_xform_points(xform.m, soa->x, soa->y, soa->z, 3 * soa->facets_count);
+
+		nx = soa->normal_x;
+		ny = soa->normal_y;
+		nz = soa->normal_z;
+
+		for(i = 0; i < soa->facets_count; i++)
+		{
+			px = xform.n[0] * nx[i] + xform.n[1] * ny[i] + xform.n[2] * nz[i];
+			py = xform.n[3] * nx[i] + xform.n[4] * ny[i] + xform.n[5] * nz[i];
+			pz = xform.n[6] * nx[i] + xform.n[7] * ny[i] + xform.n[8] * nz[i];
+
+			if(xform.normalize)
+			{
+				length = sqrt(px * px + py * py + pz * pz);
+
+				if(length > 0.0)
+				{
+					px /= length;
+					py /= length;
+					pz /= length;
+				}
+			}
+
+			nx[i] = (float)px;
+			ny[i] = (float)py;
+			nz[i] = (float)pz;
+		}
+
+		/* Mirrored, swap the second and third corners to keep the winding */
+		for(i = 0; xform.flip && (i < soa->facets_count); i++)
+		{
+			tmp = soa->x[3 * i + 1]; soa->x[3 * i + 1] = soa->x[3 * i + 2]; soa->x[3 * i + 2] = tmp;
+			tmp = soa->y[3 * i + 1]; soa->y[3 * i + 1] = soa->y[3 * i + 2]; soa->y[3 * i + 2] = tmp;
+			tmp = soa->z[3 * i + 1]; soa->z[3 * i + 1] = soa->z[3 * i + 2]; soa->z[3 * i + 2] = tmp;
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Smallest and largest of count floats, ignoring NaNs like the comparisons
+ * in stl_print_stats() do. Four of each are kept so the compares don't all
+ * wait on each other.
+ */
+static void stl_soa_range(const float *v, size_t count, double *min, double *max)
+{
+	size_t i = 0;
+	int    j = 0;
+	float  lo[4];
+	float  hi[4];
+
+	for(j = 0; j < 4; j++)
+	{
+		lo[j] = v[0];
+		hi[j] = v[0];
+	}
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		for(j = 0; j < 4; j++)
+		{
+			lo[j] = (v[i + j] < lo[j]) ? v[i + j] : lo[j];
+			hi[j] = (v[i + j] > hi[j]) ? v[i + j] : hi[j];
+		}
+	}
+
+	for(; i < count; i++)
+	{
+		lo[0] = (v[i] < lo[0]) ? v[i] : lo[0];
+		hi[0] = (v[i] > hi[0]) ? v[i] : hi[0];
+	}
+
+	*min = lo[0];
+	*max = hi[0];
+
+	for(j = 1; j < 4; j++)
+	{
+		*min = (lo[j] < *min) ? lo[j] : *min;
+		*max = (hi[j] > *max) ? hi[j] : *max;
+	}
+}
+
+void stl_soa_print_stats(stl_soa_t *soa)
+{
+	double min_x = 0.0;
+	double min_y = 0.0;
+	double min_z = 0.0;
+
+	double max_x = 0.0;
+	double max_y = 0.0;
+	double max_z = 0.0;
+
+	if(NULL == soa)
+	{
+		printf("NULL stl\n");
+		return;
+	}
+
+	printf("stl->facets_count: %llu\n", (unsigned long long)soa->facets_count);
+
+	if(soa->facets_count == 0)
+	{
+		return;
+	}
+
+	stl_soa_range(soa->x, 3 * soa->facets_count, &min_x, &max_x);
+	stl_soa_range(soa->y, 3 * soa->facets_count, &min_y, &max_y);
+	stl_soa_range(soa->z, 3 * soa->facets_count, &min_z, &max_z);
+
+	printf("min_x: %f   max_x: %f   width: %f\n", min_x, max_x, max_x - min_x);
+	printf("min_y: %f   max_y: %f   width: %f\n", min_y, max_y, max_y - min_y);
+	printf("min_z: %f   max_z: %f   width: %f\n", min_z, max_z, max_z - min_z);
+}
+
+/* Uncompressed side of stl_soa_write_file() */
+static stl_error_t stl_soa_write_packed(char *output_file, stl_soa_t *soa)
+{
+	stl_error_t   error = STL_SUCCESS;
+	size_t        res = 0;
+	size_t        i = 0;
+	size_t        chunk = 0;
+	size_t        used = 0;
+	FILE          *fp = NULL;
+	unsigned char *buffer = NULL;
+	stl_facet_t   *facets = NULL;
+
+	buffer = (unsigned char *)malloc(STL_FACETS_OFFSET + (STL_WRITE_CHUNK_FACETS * STL_FACET_SIZE));
+	facets = (stl_facet_t *)malloc(STL_WRITE_CHUNK_FACETS * sizeof(facets[0]));
+	if((NULL == buffer) || (NULL == facets))
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_create_file(output_file, &fp);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		/* The header and count go out together with the first block */
+		memcpy(buffer, soa->header, STL_HEADER_SIZE);
+		error = _stl_unpack_le32((unsigned int)soa->facets_count, buffer + STL_HEADER_SIZE);
+		used = STL_FACETS_OFFSET;
+	}
+
+	/* A block at a time: gather from the arrays, pack, write */
+	while(STL_SUCCESS == error)
+	{
+		chunk = soa->facets_count - i;
+		if(chunk > STL_WRITE_CHUNK_FACETS)
+		{
+			chunk = STL_WRITE_CHUNK_FACETS;
+		}
+
+		stl_soa_get(soa, i, facets, chunk);
+		_stl_encode_facets(facets, chunk, buffer + used);
+		used += chunk * STL_FACET_SIZE;
+
+		res = fwrite(buffer, 1, used, fp);
+		if(used != res)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		used = 0;
+		i += chunk;
+
+		if(i >= soa->facets_count)
+		{
+			break;
+		}
+	}
+
+	if(NULL != fp)
+	{
+		if((0 != fclose(fp)) && (STL_SUCCESS == error))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		fp = NULL;
+	}
+
+	free(facets);
+	free(buffer);
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_soa_write_file(char *output_file, stl_soa_t *soa)
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_t       *stl = NULL;
+
+	if((NULL == output_file) || (NULL == soa))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* The count in the file is only 32 bits */
+	if((STL_SUCCESS == error) && (soa->facets_count > STL_MAX_FILE_FACETS))
+	{
+		error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		if(_stl_has_gzip_suffix(output_file))
+		{
+			/* Compressed output wants the whole object, go the long way round */
+			error = stl_from_soa(soa, &stl);
+
+			if(STL_SUCCESS == error)
+			{
+				error = stl_write_file(output_file, stl);
+			}
+		}
+		else
+		{
+			error = stl_soa_write_packed(output_file, soa);
+		}
+	}
+
+	stl_free(stl);
+
+	return STL_LOG_ERR(error);
+}
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Everything in stl_stats_t comes out of one pass over the facets. The
+ * facets are cut into STL_CTX_CHUNK_FACETS chunks whether or not there are
+ * threads, each chunk keeps its own compensated sums, and the chunks are
+ * added up in order at the end. So the answer doesn't depend on how many
+ * threads did the work, or which thread did which chunk.
+ */
+
+/* Facets fetched at a time within a chunk */
+#define STL_STATS_BLOCK 256
+
+/* A running sum that keeps the rounding error of each add in c (Neumaier's
+ * version of Kahan summation), so long sums of small areas and volumes
+ * don't drift
+ */
+typedef struct
+{
+	double sum;
+	double c;
+} stl_sum_t;
+
+/* The totals for one chunk */
+typedef struct
+{
+	stl_sum_t area;
+	stl_sum_t volume;
+
+	/* Volume and area weighted sums of the centres, relative to origin */
+	stl_sum_t volume_centre[3];
+	stl_sum_t area_centre[3];
+
+	double    min[3];
+	double    max[3];
+	size_t    degenerate;
+} stl_stats_part_t;
+
+typedef struct
+{
+	/* One or the other */
+	const stl_t         *stl;
+	const stl_compact_t *compact;
+
+	/* Corner 0 of facet 0. Volumes are measured from here rather than
+	 * from (0, 0, 0), which keeps the numbers small for meshes a long way
+	 * from the origin.
+	 */
+	double              origin[3];
+
+	stl_stats_part_t    *parts;
+} stl_stats_calc_t;
+
+static void stl_sum_add(stl_sum_t *s, double x)
+{
+	double t = s->sum + x;
+
+	if(fabs(s->sum) >= fabs(x))
+	{
+		s->c += (s->sum - t) + x;
+	}
+	else
+	{
+		s->c += (x - t) + s->sum;
+	}
+
+	s->sum = t;
+}
+
+static double stl_sum_get(const stl_sum_t *s)
+{
+	return s->sum + s->c;
+}
+
+static void stl_stats_facet(stl_stats_part_t *part, const double *origin, const stl_facet_t *facet)
+{
+	unsigned int j = 0;
+	double       p[3][3];
+	double       a[3];
+	double       b[3];
+	double       n[3];
+	double       length = 0.0;
+	double       area = 0.0;
+	double       volume = 0.0;
+
+	for(j = 0; j < 3; j++)
+	{
+		p[j][0] = facet->verticies[j].x;
+		p[j][1] = facet->verticies[j].y;
+		p[j][2] = facet->verticies[j].z;
+
+		part->min[0] = (p[j][0] < part->min[0]) ? p[j][0] : part->min[0];
+		part->min[1] = (p[j][1] < part->min[1]) ? p[j][1] : part->min[1];
+		part->min[2] = (p[j][2] < part->min[2]) ? p[j][2] : part->min[2];
+
+		part->max[0] = (p[j][0] > part->max[0]) ? p[j][0] : part->max[0];
+		part->max[1] = (p[j][1] > part->max[1]) ? p[j][1] : part->max[1];
+		part->max[2] = (p[j][2] > part->max[2]) ? p[j][2] : part->max[2];
+
+		p[j][0] -= origin[0];
+		p[j][1] -= origin[1];
+		p[j][2] -= origin[2];
+	}
+
+	for(j = 0; j < 3; j++)
+	{
+		a[j] = p[1][j] - p[0][j];
+		b[j] = p[2][j] - p[0][j];
+	}
+
+	n[0] = a[1] * b[2] - a[2] * b[1];
+	n[1] = a[2] * b[0] - a[0] * b[2];
+	n[2] = a[0] * b[1] - a[1] * b[0];
+
+	length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+	/* No area, or corners that aren't numbers */
+	if(!(length > 0.0))
+	{
+		part->degenerate++;
+		return;
+	}
+
+	/* The tetrahedron from the origin to the facet. p[0] . (a x b) is the
+	 * same as p[0] . (p[1] x p[2]).
+	 */
+	area = length / 2.0;
+	volume = (p[0][0] * n[0] + p[0][1] * n[1] + p[0][2] * n[2]) / 6.0;
+
+	stl_sum_add(&part->area, area);
+	stl_sum_add(&part->volume, volume);
+
+	/* The tetrahedron's centre is a quarter of its corners (one of which
+	 * is the origin), the facet's is a third
+	 */
+	for(j = 0; j < 3; j++)
+	{
+		stl_sum_add(&part->volume_centre[j], volume * (p[0][j] + p[1][j] + p[2][j]) / 4.0);
+		stl_sum_add(&part->area_centre[j], area * (p[0][j] + p[1][j] + p[2][j]) / 3.0);
+	}
+}
+
+static void stl_stats_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_stats_calc_t  *calc = (stl_stats_calc_t *)arg;
+	stl_stats_part_t  *part = &calc->parts[chunk_index];
+	size_t            i = 0;
+	size_t            j = 0;
+	size_t            block = 0;
+	const stl_facet_t *facets = NULL;
+	stl_facet_t       tmp[STL_STATS_BLOCK];
+
+	memset(part, 0x00, sizeof(*part));
+	memcpy(part->min, calc->origin, sizeof(part->min));
+	memcpy(part->max, calc->origin, sizeof(part->max));
+
+	for(i = first; i < first + count; i += block)
+	{
+		block = first + count - i;
+		if(block > STL_STATS_BLOCK)
+		{
+			block = STL_STATS_BLOCK;
+		}
+
+		if(NULL != calc->compact)
+		{
+			_stl_compact_get_facets(calc->compact, i, block, 0, tmp);
+			facets = tmp;
+		}
+		else
+		{
+			/* Decodes mapped facets and applies a pending transform on
+			 * the way
+			 */
+			facets = _stl_get_facets(calc->stl, i, block, tmp);
+		}
+
+		for(j = 0; j < block; j++)
+		{
+			stl_stats_facet(part, calc->origin, &facets[j]);
+		}
+	}
+}
+
+/* The stats for whichever of stl and compact isn't NULL
+ */
+static stl_error_t stl_stats_run(stl_ctx_t *ctx, const stl_t *stl, const stl_compact_t *compact, stl_stats_t *stats)
+{
+	stl_error_t       error = STL_SUCCESS;
+	size_t            i = 0;
+	unsigned int      j = 0;
+	size_t            chunks = 0;
+	double            area = 0.0;
+	double            volume = 0.0;
+	stl_sum_t         total_area;
+	stl_sum_t         total_volume;
+	stl_sum_t         volume_centre[3];
+	stl_sum_t         area_centre[3];
+	double            min[3];
+	double            max[3];
+	size_t            facets_count = 0;
+	const stl_facet_t *facet = NULL;
+	stl_facet_t       tmp;
+	stl_stats_calc_t  calc;
+
+	facets_count = (NULL != compact) ? compact->facets_count : stl->facets_count;
+
+	memset(stats, 0x00, sizeof(*stats));
+	stats->facets_count = facets_count;
+
+	memset(&calc, 0x00, sizeof(calc));
+	calc.stl = stl;
+	calc.compact = compact;
+
+	/* Nothing to add up, the zeroed stats are the answer */
+	if(0 != facets_count)
+	{
+		if(NULL != compact)
+		{
+			_stl_compact_get_facets(compact, 0, 1, 0, &tmp);
+			facet = &tmp;
+		}
+		else
+		{
+			facet = _stl_get_facet(stl, 0, &tmp);
+		}
+		calc.origin[0] = facet->verticies[0].x;
+		calc.origin[1] = facet->verticies[0].y;
+		calc.origin[2] = facet->verticies[0].z;
+
+		chunks = _stl_chunk_count(facets_count, STL_CTX_CHUNK_FACETS);
+
+		calc.parts = (stl_stats_part_t *)_stl_alloc_array(chunks, sizeof(calc.parts[0]));
+		if(NULL == calc.parts)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && (0 != facets_count))
+	{
+		_stl_ctx_run(ctx, facets_count, STL_CTX_CHUNK_FACETS, stl_stats_chunk, &calc);
+
+		memset(&total_area, 0x00, sizeof(total_area));
+		memset(&total_volume, 0x00, sizeof(total_volume));
+		memset(volume_centre, 0x00, sizeof(volume_centre));
+		memset(area_centre, 0x00, sizeof(area_centre));
+		memcpy(min, calc.origin, sizeof(min));
+		memcpy(max, calc.origin, sizeof(max));
+
+		/* In chunk order, so it comes out the same every time */
+		for(i = 0; i < chunks; i++)
+		{
+			stl_sum_add(&total_area, stl_sum_get(&calc.parts[i].area));
+			stl_sum_add(&total_volume, stl_sum_get(&calc.parts[i].volume));
+
+			for(j = 0; j < 3; j++)
+			{
+				stl_sum_add(&volume_centre[j], stl_sum_get(&calc.parts[i].volume_centre[j]));
+				stl_sum_add(&area_centre[j], stl_sum_get(&calc.parts[i].area_centre[j]));
+
+				min[j] = (calc.parts[i].min[j] < min[j]) ? calc.parts[i].min[j] : min[j];
+				max[j] = (calc.parts[i].max[j] > max[j]) ? calc.parts[i].max[j] : max[j];
+			}
+
+			stats->degenerate_facets += calc.parts[i].degenerate;
+		}
+
+		area = stl_sum_get(&total_area);
+		volume = stl_sum_get(&total_volume);
+
+		stats->surface_area = area;
+		stats->volume = volume;
+
+		/* The centre of the solid, or of the surface if it doesn't enclose
+		 * anything
+		 */
+		for(j = 0; j < 3; j++)
+		{
+			if(0.0 != volume)
+			{
+				stats->centroid[j] = calc.origin[j] + stl_sum_get(&volume_centre[j]) / volume;
+			}
+			else if(0.0 != area)
+			{
+				stats->centroid[j] = calc.origin[j] + stl_sum_get(&area_centre[j]) / area;
+			}
+			else
+			{
+				stats->centroid[j] = calc.origin[j];
+			}
+		}
+
+		/* Every value came from a float, so nothing is lost keeping them */
+		stats->bounds_min.x = (float)min[0];
+		stats->bounds_min.y = (float)min[1];
+		stats->bounds_min.z = (float)min[2];
+
+		stats->bounds_max.x = (float)max[0];
+		stats->bounds_max.y = (float)max[1];
+		stats->bounds_max.z = (float)max[2];
+	}
+
+	free(calc.parts);
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_compute_stats_ctx(stl_ctx_t *ctx, stl_t *stl, stl_stats_t *stats)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if((NULL == stl) || (NULL == stats))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_stats_run(ctx, stl, NULL, stats);
+	}
+
+	/* Saves a scan for stl_get_bounds() later */
+	if((STL_SUCCESS == error) && (0 != stl->facets_count))
+	{
+		stl->bounds_min = stats->bounds_min;
+		stl->bounds_max = stats->bounds_max;
+		stl->has_bounds = 1;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_compute_stats(stl_t *stl, stl_stats_t *stats)
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_ctx_t   *ctx = NULL;
+
+	/* The answer is the same without a pool */
+	if(NULL != stl)
+	{
+		ctx = _stl_ctx_temp(stl->facets_count);
+	}
+
+	error = stl_compute_stats_ctx(ctx, stl, stats);
+
+	stl_ctx_free(ctx);
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_compact_compute_stats_ctx(stl_ctx_t *ctx, stl_compact_t *compact, stl_stats_t *stats)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if((NULL == compact) || (NULL == stats))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = stl_stats_run(ctx, NULL, compact, stats);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_compact_compute_stats(stl_compact_t *compact, stl_stats_t *stats)
+{
+	stl_error_t error = STL_SUCCESS;
+	stl_ctx_t   *ctx = NULL;
+
+	if(NULL != compact)
+	{
+		ctx = _stl_ctx_temp(compact->facets_count);
+	}
+
+	error = stl_compact_compute_stats_ctx(ctx, compact, stats);
+
+	stl_ctx_free(ctx);
+
+	return STL_LOG_ERR(error);
+}
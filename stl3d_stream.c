@@ -0,0 +1,688 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Streaming access to binary STL files. Only one staging buffer of facets
+ * is held at a time, so a read-transform-write job runs in constant memory
+ * no matter how large the file is.
+ */
+
+struct stl_reader_s
+{
+	FILE          *fp;
+	size_t        facets_count;
+	size_t        facets_left;
+	unsigned char *buffer;
+};
+
+struct stl_writer_s
+{
+	FILE          *fp;
+	size_t        facets_count;
+	size_t        facets_written;
+	size_t        used;
+	unsigned char *buffer;
+
+	/* Count is written by stl_writer_close(), see STL_FACETS_COUNT_DEFERRED */
+	int           deferred;
+	/* Set once the header has left the staging buffer */
+	int           flushed;
+};
+
+
+stl_error_t stl_reader_open(char *input_file, unsigned char *header, size_t *facets_count, stl_reader_t **reader_new)
+{
+	stl_error_t   error = STL_SUCCESS;
+	size_t        res = 0;
+	unsigned char file_header[STL_FACETS_OFFSET];
+	stl_reader_t  *reader = NULL;
+
+	if((NULL == input_file) || (NULL == reader_new))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	reader = (stl_reader_t *)malloc(sizeof(*reader));
+	if(NULL == reader)
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(reader, 0x00, sizeof(*reader));
+
+		reader->buffer = (unsigned char *)malloc(STL_READ_CHUNK_FACETS * STL_FACET_SIZE);
+		if(NULL == reader->buffer)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		reader->fp = fopen(input_file, "rb");
+		if(NULL == reader->fp)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		res = fread(file_header, 1, sizeof(file_header), reader->fp);
+		if(sizeof(file_header) != res)
+		{
+			error = STL_LOG_ERR(STL_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		/* Streaming is only done for binary STL files */
+		if(_stl_looks_ascii(file_header, sizeof(file_header), 0))
+		{
+			error = STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		reader->facets_count = _stl_pack_le32(file_header + STL_HEADER_SIZE);
+		reader->facets_left = reader->facets_count;
+
+		if(NULL != header)
+		{
+			memcpy(header, file_header, STL_HEADER_SIZE);
+		}
+
+		if(NULL != facets_count)
+		{
+			*facets_count = reader->facets_count;
+		}
+
+		*reader_new = reader;
+		reader = NULL;
+	}
+
+	if(NULL != reader)
+	{
+		stl_reader_close(reader);
+		reader = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_reader_next_batch(stl_reader_t *reader, stl_facet_t *facets, size_t max_facets, size_t *facets_read)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      total = 0;
+	size_t      chunk = 0;
+	size_t      res = 0;
+
+	if((NULL == reader) || (NULL == facets) || (NULL == facets_read))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(max_facets > reader->facets_left)
+	{
+		max_facets = reader->facets_left;
+	}
+
+	while(total < max_facets)
+	{
+		chunk = max_facets - total;
+		if(chunk > STL_READ_CHUNK_FACETS)
+		{
+			chunk = STL_READ_CHUNK_FACETS;
+		}
+
+		res = fread(reader->buffer, STL_FACET_SIZE, chunk, reader->fp);
+		if(chunk != res)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+			break;
+		}
+
+		_stl_decode_facets(reader->buffer, &facets[total], chunk);
+
+		total += chunk;
+	}
+
+	reader->facets_left -= total;
+	*facets_read = total;
+
+	return STL_LOG_ERR(error);
+}
+
+void stl_reader_close(stl_reader_t *reader)
+{
+	if(NULL == reader)
+	{
+		return;
+	}
+
+	if(NULL != reader->fp)
+	{
+		fclose(reader->fp);
+		reader->fp = NULL;
+	}
+
+	if(NULL != reader->buffer)
+	{
+		free(reader->buffer);
+		reader->buffer = NULL;
+	}
+
+	free(reader);
+}
+
+/* Write out whatever is sitting in the writer's staging buffer
+ */
+static stl_error_t stl_writer_flush(stl_writer_t *writer)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      res = 0;
+
+	if(writer->used > 0)
+	{
+		res = fwrite(writer->buffer, 1, writer->used, writer->fp);
+		if(writer->used != res)
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+
+		writer->used = 0;
+		writer->flushed = 1;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_writer_open(char *output_file, const unsigned char *header, size_t facets_count, stl_writer_t **writer_new)
+{
+	stl_error_t  error = STL_SUCCESS;
+	stl_writer_t *writer = NULL;
+
+	if((NULL == output_file) || (NULL == header) || (NULL == writer_new))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* The count in the file is only 32 bits */
+	if((facets_count > STL_MAX_FILE_FACETS) && (STL_FACETS_COUNT_DEFERRED != facets_count))
+	{
+		return STL_LOG_ERR(STL_ERROR_UNSUPPORTED);
+	}
+
+	writer = (stl_writer_t *)malloc(sizeof(*writer));
+	if(NULL == writer)
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(writer, 0x00, sizeof(*writer));
+
+		writer->buffer = (unsigned char *)malloc(STL_FACETS_OFFSET + (STL_WRITE_CHUNK_FACETS * STL_FACET_SIZE));
+		if(NULL == writer->buffer)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_create_file(output_file, &writer->fp);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		/* The header and count go out together with the first block. A
+		 * deferred count is 0 until close patches in the real one, so a file
+		 * left behind by a crash reads as empty rather than as garbage.
+		 */
+		writer->deferred = (STL_FACETS_COUNT_DEFERRED == facets_count);
+		writer->facets_count = writer->deferred ? STL_MAX_FILE_FACETS : facets_count;
+
+		memcpy(writer->buffer, header, STL_HEADER_SIZE);
+		error = _stl_unpack_le32(writer->deferred ? 0 : (unsigned int)facets_count, writer->buffer + STL_HEADER_SIZE);
+		writer->used = STL_FACETS_OFFSET;
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		*writer_new = writer;
+		writer = NULL;
+	}
+
+	if(NULL != writer)
+	{
+		if(NULL != writer->fp)
+		{
+			fclose(writer->fp);
+			writer->fp = NULL;
+		}
+
+		free(writer->buffer);
+		free(writer);
+		writer = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_writer_append(stl_writer_t *writer, const stl_facet_t *facets, size_t count)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      room = 0;
+	size_t      chunk = 0;
+
+	if((NULL == writer) || ((NULL == facets) && (0 != count)))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(count > writer->facets_count - writer->facets_written)
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	while((STL_SUCCESS == error) && (count > 0))
+	{
+		room = (STL_FACETS_OFFSET + (STL_WRITE_CHUNK_FACETS * STL_FACET_SIZE) - writer->used) / STL_FACET_SIZE;
+
+		chunk = count;
+		if(chunk > room)
+		{
+			chunk = room;
+		}
+
+		_stl_encode_facets(facets, chunk, writer->buffer + writer->used);
+
+		writer->used += chunk * STL_FACET_SIZE;
+		writer->facets_written += chunk;
+		facets += chunk;
+		count -= chunk;
+
+		if(chunk == room)
+		{
+			error = stl_writer_flush(writer);
+		}
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_writer_close(stl_writer_t *writer)
+{
+	stl_error_t   error = STL_SUCCESS;
+	int           patch = 0;
+	unsigned char count[4];
+
+	if(NULL == writer)
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* Small files never flushed the header, so the count can still be
+	 * patched in the buffer and the file goes out in one write. Otherwise
+	 * seek back and overwrite the 4 count bytes once everything is out.
+	 */
+	if(writer->deferred)
+	{
+		if(!writer->flushed)
+		{
+			_stl_unpack_le32((unsigned int)writer->facets_written, writer->buffer + STL_HEADER_SIZE);
+		}
+		else
+		{
+			patch = 1;
+		}
+	}
+
+	error = stl_writer_flush(writer);
+
+	if((STL_SUCCESS == error) && patch)
+	{
+		_stl_unpack_le32((unsigned int)writer->facets_written, count);
+
+		if((0 != fseek(writer->fp, STL_HEADER_SIZE, SEEK_SET)) || (sizeof(count) != fwrite(count, 1, sizeof(count), writer->fp)))
+		{
+			error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+		}
+	}
+
+	if((STL_SUCCESS == error) && !writer->deferred && (writer->facets_written != writer->facets_count))
+	{
+		error = STL_LOG_ERR(STL_ERROR);
+	}
+
+	if((0 != fclose(writer->fp)) && (STL_SUCCESS == error))
+	{
+		error = STL_LOG_ERR(STL_ERROR_IO_ERROR);
+	}
+
+	free(writer->buffer);
+	free(writer);
+
+	return STL_LOG_ERR(error);
+}
+
+/* Where the push parser is in the file
+ */
+#define STL_PARSER_HEADER 0
+#define STL_PARSER_FACETS 1
+#define STL_PARSER_DONE   2
+#define STL_PARSER_FAILED 3
+
+struct stl_parser_s
+{
+	unsigned int    state;
+
+	/* What stopped it, once the state is STL_PARSER_FAILED */
+	stl_error_t     error;
+
+	stl_facets_cb_t callback;
+	void            *arg;
+
+	unsigned char   header[STL_HEADER_SIZE];
+
+	/* Bytes of the header/count or of a facet that was split between two
+	 * calls to stl_parser_feed()
+	 */
+	unsigned char   partial[STL_FACETS_OFFSET];
+	size_t          partial_len;
+
+	size_t          facets_count;
+	size_t          facets_left;
+
+	/* Decoded facets waiting to be handed to the callback */
+	stl_facet_t     *batch;
+	size_t          batch_len;
+};
+
+stl_error_t stl_parser_new(stl_facets_cb_t callback, void *arg, stl_parser_t **parser_new)
+{
+	stl_error_t  error = STL_SUCCESS;
+	stl_parser_t *parser = NULL;
+
+	if((NULL == callback) || (NULL == parser_new))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		parser = (stl_parser_t *)malloc(sizeof(*parser));
+		if(NULL == parser)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(parser, 0x00, sizeof(*parser));
+
+		parser->state = STL_PARSER_HEADER;
+		parser->callback = callback;
+		parser->arg = arg;
+
+		parser->batch = (stl_facet_t *)malloc(STL_READ_CHUNK_FACETS * sizeof(parser->batch[0]));
+		if(NULL == parser->batch)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		*parser_new = parser;
+		parser = NULL;
+	}
+
+	if(NULL != parser)
+	{
+		stl_parser_free(parser);
+		parser = NULL;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Stop the parser for good, every later call gives back the same error
+ */
+static stl_error_t stl_parser_fail(stl_parser_t *parser, stl_error_t error)
+{
+	parser->state = STL_PARSER_FAILED;
+	parser->error = error;
+	parser->batch_len = 0;
+
+	return STL_LOG_ERR(error);
+}
+
+/* Hand the batched facets to the callback
+ */
+static stl_error_t stl_parser_flush(stl_parser_t *parser)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if(parser->batch_len > 0)
+	{
+		error = parser->callback(parser->batch, parser->batch_len, parser->arg);
+		parser->batch_len = 0;
+	}
+
+	if(STL_SUCCESS != error)
+	{
+		error = stl_parser_fail(parser, error);
+	}
+	else if((STL_PARSER_FACETS == parser->state) && (0 == parser->facets_left))
+	{
+		parser->state = STL_PARSER_DONE;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_parser_feed(stl_parser_t *parser, const unsigned char *data, size_t len)
+{
+	stl_error_t error = STL_SUCCESS;
+	size_t      take = 0;
+	size_t      whole = 0;
+
+	if((NULL == parser) || ((NULL == data) && (0 != len)))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if((STL_SUCCESS == error) && (STL_PARSER_FAILED == parser->state))
+	{
+		error = STL_LOG_ERR(parser->error);
+	}
+
+	/* Collect the header and facet count */
+	if((STL_SUCCESS == error) && (STL_PARSER_HEADER == parser->state) && (len > 0))
+	{
+		take = STL_FACETS_OFFSET - parser->partial_len;
+		if(take > len)
+		{
+			take = len;
+		}
+
+		memcpy(parser->partial + parser->partial_len, data, take);
+		parser->partial_len += take;
+		data += take;
+		len -= take;
+
+		/* Only binary STL data can be pushed through the parser */
+		if((STL_FACETS_OFFSET == parser->partial_len) && _stl_looks_ascii(parser->partial, STL_FACETS_OFFSET, 0))
+		{
+			error = stl_parser_fail(parser, STL_ERROR_UNSUPPORTED);
+		}
+		else if(STL_FACETS_OFFSET == parser->partial_len)
+		{
+			memcpy(parser->header, parser->partial, STL_HEADER_SIZE);
+			parser->facets_count = _stl_pack_le32(parser->partial + STL_HEADER_SIZE);
+			parser->facets_left = parser->facets_count;
+			parser->partial_len = 0;
+			parser->state = STL_PARSER_FACETS;
+
+			if(0 == parser->facets_left)
+			{
+				parser->state = STL_PARSER_DONE;
+			}
+		}
+	}
+
+	while((STL_SUCCESS == error) && (STL_PARSER_FACETS == parser->state) && (len > 0))
+	{
+		if(parser->partial_len > 0)
+		{
+			/* Finish off a facet that was split across two chunks */
+			take = STL_FACET_SIZE - parser->partial_len;
+			if(take > len)
+			{
+				take = len;
+			}
+
+			memcpy(parser->partial + parser->partial_len, data, take);
+			parser->partial_len += take;
+			data += take;
+			len -= take;
+
+			if(STL_FACET_SIZE == parser->partial_len)
+			{
+				_stl_decode_facet(parser->partial, &parser->batch[parser->batch_len]);
+				parser->batch_len++;
+				parser->facets_left--;
+				parser->partial_len = 0;
+			}
+		}
+		else
+		{
+			/* Decode as many whole facets as fit in the batch straight out
+			 * of the caller's data
+			 */
+			whole = len / STL_FACET_SIZE;
+			if(whole > STL_READ_CHUNK_FACETS - parser->batch_len)
+			{
+				whole = STL_READ_CHUNK_FACETS - parser->batch_len;
+			}
+			if(whole > parser->facets_left)
+			{
+				whole = parser->facets_left;
+			}
+
+			if(whole > 0)
+			{
+				_stl_decode_facets(data, &parser->batch[parser->batch_len], whole);
+				parser->batch_len += whole;
+				parser->facets_left -= whole;
+				data += whole * STL_FACET_SIZE;
+				len -= whole * STL_FACET_SIZE;
+			}
+			else if(len < STL_FACET_SIZE)
+			{
+				/* Keep the start of a split facet for the next call */
+				memcpy(parser->partial, data, len);
+				parser->partial_len = len;
+				len = 0;
+			}
+		}
+
+		if((STL_READ_CHUNK_FACETS == parser->batch_len) || (0 == parser->facets_left))
+		{
+			error = stl_parser_flush(parser);
+		}
+	}
+
+	/* Anything past the last facet is ignored, the same as stl_read_file() */
+
+	/* Don't sit on facets that are already complete */
+	if(STL_SUCCESS == error)
+	{
+		error = stl_parser_flush(parser);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_parser_header(stl_parser_t *parser, unsigned char *header, size_t *facets_count)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if(NULL == parser)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if((STL_SUCCESS == error) && (STL_PARSER_FAILED == parser->state))
+	{
+		error = STL_LOG_ERR(parser->error);
+	}
+
+	/* Not all of it has been fed in yet */
+	if((STL_SUCCESS == error) && (STL_PARSER_HEADER == parser->state))
+	{
+		error = STL_LOG_ERR(STL_ERROR);
+	}
+
+	if((STL_SUCCESS == error) && (NULL != header))
+	{
+		memcpy(header, parser->header, STL_HEADER_SIZE);
+	}
+
+	if((STL_SUCCESS == error) && (NULL != facets_count))
+	{
+		*facets_count = parser->facets_count;
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_parser_finish(stl_parser_t *parser)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if(NULL == parser)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if((STL_SUCCESS == error) && (STL_PARSER_FAILED == parser->state))
+	{
+		error = STL_LOG_ERR(parser->error);
+	}
+
+	if((STL_SUCCESS == error) && (STL_PARSER_DONE != parser->state))
+	{
+		error = STL_LOG_ERR(STL_ERROR);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+void stl_parser_free(stl_parser_t *parser)
+{
+	if(NULL == parser)
+	{
+		return;
+	}
+
+	if(NULL != parser->batch)
+	{
+		free(parser->batch);
+		parser->batch = NULL;
+	}
+
+	free(parser);
+}
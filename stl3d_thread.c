@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+typedef struct
+{
+	_stl_task_fn_t fn;
+	void           *arg;
+	unsigned int   index;
+} stl_thread_arg_t;
+
+
+unsigned int _stl_cpu_count(void)
+{
+	long count = 1;
+
+#ifndef _WIN32
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	if(count < 1)
+	{
+		count = 1;
+	}
+
+	return (unsigned int)count;
+}
+
+#ifndef _WIN32
+static void *stl_thread_main(void *arg)
+{
+	stl_thread_arg_t *targ = (stl_thread_arg_t *)arg;
+
+	targ->fn(targ->index, targ->arg);
+
+	return NULL;
+}
+#endif
+
+/* Run fn(0, arg) .. fn(count - 1, arg) at the same time, one per thread,
+ * and wait for all of them. fn(0) runs on the calling thread. Where threads
+ * are not available (or can't be created) the calls are made one after the
+ * other instead, so callers must not depend on them overlapping.
+ */
+stl_error_t _stl_run_threads(unsigned int count, _stl_task_fn_t fn, void *arg)
+{
+	stl_error_t      error = STL_SUCCESS;
+	unsigned int     i = 0;
+	stl_thread_arg_t *targs = NULL;
+#ifndef _WIN32
+	pthread_t        *threads = NULL;
+	unsigned char    *started = NULL;
+#endif
+
+	if((0 == count) || (NULL == fn))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	targs = (stl_thread_arg_t *)malloc(count * sizeof(targs[0]));
+	if(NULL == targs)
+	{
+		error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+	}
+
+#ifndef _WIN32
+	if(STL_SUCCESS == error)
+	{
+		threads = (pthread_t *)malloc(count * sizeof(threads[0]));
+		started = (unsigned char *)calloc(count, sizeof(started[0]));
+		if((NULL == threads) || (NULL == started))
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+#endif
+
+	if(STL_SUCCESS == error)
+	{
+		for(i = 0; i < count; i++)
+		{
+			targs[i].fn = fn;
+			targs[i].arg = arg;
+			targs[i].index = i;
+		}
+
+#ifndef _WIN32
+		for(i = 1; i < count; i++)
+		{
+			if(0 == pthread_create(&threads[i], NULL, stl_thread_main, &targs[i]))
+			{
+				started[i] = 1;
+			}
+		}
+#endif
+
+		fn(0, arg);
+
+		for(i = 1; i < count; i++)
+		{
+#ifndef _WIN32
+			if(started[i])
+			{
+				pthread_join(threads[i], NULL);
+				continue;
+			}
+#endif
+			/* Couldn't get a thread for this one, run it here */
+			fn(i, arg);
+		}
+	}
+
+#ifndef _WIN32
+	free(threads);
+	free(started);
+#endif
+	free(targs);
+
+	return STL_LOG_ERR(error);
+}
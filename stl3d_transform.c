@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "stl3d_lib.h"
+#include "stl3d_internal.h"
+
+
+/* Matrices are 4x4, row major, and act on column vectors, so a point p
+ * becomes m * [p.x p.y p.z 1]. The builders below all add their step to
+ * the end of whatever m already does (m = step * m), which lets a whole
+ * job be built up in one matrix and then applied in a single pass.
+ */
+
+/* How far from exact a matrix can be and still count as a pure rotation
+ * or mirror, which only differs from exact by rounding in cos() and sin()
+ */
+#define STL_MATRIX_ORTHO_EPSILON 1e-9
+
+static double deg2rad(double deg)
+{
+	return (deg * STL_PI / 180);
+}
+
+/* m = step * m
+ */
+static void stl_matrix_append(double m[16], const double step[16])
+{
+	double result[16];
+
+	stl_matrix_multiply(result, step, m);
+	memcpy(m, result, sizeof(result));
+}
+
+stl_error_t stl_matrix_identity(double m[16])
+{
+	if(NULL == m)
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	memset(m, 0x00, 16 * sizeof(m[0]));
+	m[0] = 1.0;
+	m[5] = 1.0;
+	m[10] = 1.0;
+	m[15] = 1.0;
+
+	return STL_SUCCESS;
+}
+
+stl_error_t stl_matrix_multiply(double result[16], const double a[16], const double b[16])
+{
+	double tmp[16];
+	int    row = 0;
+	int    col = 0;
+
+	if((NULL == result) || (NULL == a) || (NULL == b))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* Through tmp so result can be a or b */
+	for(row = 0; row < 4; row++)
+	{
+		for(col = 0; col < 4; col++)
+		{
+			tmp[row * 4 + col] =
+				a[row * 4 + 0] * b[0 * 4 + col] +
+				a[row * 4 + 1] * b[1 * 4 + col] +
+				a[row * 4 + 2] * b[2 * 4 + col] +
+				a[row * 4 + 3] * b[3 * 4 + col];
+		}
+	}
+
+	memcpy(result, tmp, sizeof(tmp));
+
+	return STL_SUCCESS;
+}
+
+stl_error_t stl_matrix_rotate(double m[16], double axis_x, double axis_y, double axis_z, double degrees)
+{
+	double step[16];
+	double length = 0.0;
+	double radians = deg2rad(degrees);
+	double cs = cos(radians);
+	double sn = sin(radians);
+	double t = 1.0 - cs;
+	double x = 0.0;
+	double y = 0.0;
+	double z = 0.0;
+
+	length = sqrt(axis_x * axis_x + axis_y * axis_y + axis_z * axis_z);
+
+	if((NULL == m) || !(length > 0.0))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	stl_matrix_identity(step);
+
+	/* Around one of the main axes the other coordinate is left exactly as
+	 * it was, which the general form below doesn't quite manage
+	 */
+	if((0.0 == axis_y) && (0.0 == axis_z))
+	{
+		sn = (axis_x < 0.0) ? -sn : sn;
+		step[5] = cs;  step[6] = -sn;
+		step[9] = sn;  step[10] = cs;
+	}
+	else if((0.0 == axis_x) && (0.0 == axis_z))
+	{
+		sn = (axis_y < 0.0) ? -sn : sn;
+		step[0] = cs;  step[2] = sn;
+		step[8] = -sn; step[10] = cs;
+	}
+	else if((0.0 == axis_x) && (0.0 == axis_y))
+	{
+		sn = (axis_z < 0.0) ? -sn : sn;
+		step[0] = cs;  step[1] = -sn;
+		step[4] = sn;  step[5] = cs;
+	}
+	else
+	{
+		/* Rodrigues' rotation formula */
+		x = axis_x / length;
+		y = axis_y / length;
+		z = axis_z / length;
+
+		step[0] = t * x * x + cs;
+		step[1] = t * x * y - sn * z;
+		step[2] = t * x * z + sn * y;
+
+		step[4] = t * x * y + sn * z;
+		step[5] = t * y * y + cs;
+		step[6] = t * y * z - sn * x;
+
+		step[8] = t * x * z - sn * y;
+		step[9] = t * y * z + sn * x;
+		step[10] = t * z * z + cs;
+	}
+
+	stl_matrix_append(m, step);
+
+	return STL_SUCCESS;
+}
+
+stl_error_t stl_matrix_scale(double m[16], double pct_x, double pct_y, double pct_z)
+{
+	double step[16];
+
+	if(NULL == m)
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	stl_matrix_identity(step);
+	step[0] = pct_x / 100.0;
+	step[5] = pct_y / 100.0;
+	step[10] = pct_z / 100.0;
+
+	stl_matrix_append(m, step);
+
+	return STL_SUCCESS;
+}
+
+stl_error_t stl_matrix_translate(double m[16], double x, double y, double z)
+{
+	double step[16];
+
+	if(NULL == m)
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	stl_matrix_identity(step);
+	step[3] = x;
+	step[7] = y;
+	step[11] = z;
+
+	stl_matrix_append(m, step);
+
+	return STL_SUCCESS;
+}
+
+stl_error_t stl_matrix_mirror(double m[16], stl_axis_t axis)
+{
+	double step[16];
+
+	if((NULL == m) || ((STL_AXIS_X != axis) && (STL_AXIS_Y != axis) && (STL_AXIS_Z != axis)))
+	{
+		return STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	stl_matrix_identity(step);
+
+	if(STL_AXIS_X == axis)
+	{
+		step[0] = -1.0;
+	}
+	else if(STL_AXIS_Y == axis)
+	{
+		step[5] = -1.0;
+	}
+	else
+	{
+		step[10] = -1.0;
+	}
+
+	stl_matrix_append(m, step);
+
+	return STL_SUCCESS;
+}
+
+/* Is the 3x3 part of m a rotation or mirror, so that its inverse transpose
+ * is itself and it leaves the length of normals alone
+ */
+static int stl_matrix_is_orthogonal(const double m[16])
+{
+	int    i = 0;
+	int    j = 0;
+	double dot = 0.0;
+
+	for(i = 0; i < 3; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			dot = m[0 * 4 + i] * m[0 * 4 + j] + m[1 * 4 + i] * m[1 * 4 + j] + m[2 * 4 + i] * m[2 * 4 + j];
+
+			if(fabs(dot - ((i == j) ? 1.0 : 0.0)) > STL_MATRIX_ORTHO_EPSILON)
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+stl_error_t _stl_xform_prepare(const double m[16], _stl_xform_t *xform)
+{
+	stl_error_t error = STL_SUCCESS;
+	double      det = 0.0;
+	double      *n = xform->n;
+
+	/* Only affine transforms, perspective makes no sense for a mesh */
+	if((0.0 != m[12]) || (0.0 != m[13]) || (0.0 != m[14]) || (1.0 != m[15]))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		memset(xform, 0x00, sizeof(*xform));
+		memcpy(xform->m, m, sizeof(xform->m));
+
+		det = m[0] * (m[5] * m[10] - m[6] * m[9]) -
+			m[1] * (m[4] * m[10] - m[6] * m[8]) +
+			m[2] * (m[4] * m[9] - m[5] * m[8]);
+
+		/* Normals go through the inverse transpose of the 3x3 part. For
+		 * a rotation or mirror that's the 3x3 part itself and the length
+		 * doesn't change, otherwise build it from the cofactors and
+		 * renormalize each one.
+		 */
+		if(stl_matrix_is_orthogonal(m))
+		{
+			n[0] = m[0]; n[1] = m[1]; n[2] = m[2];
+			n[3] = m[4]; n[4] = m[5]; n[5] = m[6];
+			n[6] = m[8]; n[7] = m[9]; n[8] = m[10];
+		}
+		else if(0.0 != det)
+		{
+			n[0] = (m[5] * m[10] - m[6] * m[9]) / det;
+			n[1] = (m[6] * m[8] - m[4] * m[10]) / det;
+			n[2] = (m[4] * m[9] - m[5] * m[8]) / det;
+			n[3] = (m[2] * m[9] - m[1] * m[10]) / det;
+			n[4] = (m[0] * m[10] - m[2] * m[8]) / det;
+			n[5] = (m[1] * m[8] - m[0] * m[9]) / det;
+			n[6] = (m[1] * m[6] - m[2] * m[5]) / det;
+			n[7] = (m[2] * m[4] - m[0] * m[6]) / det;
+			n[8] = (m[0] * m[5] - m[1] * m[4]) / det;
+			xform->normalize = 1;
+		}
+
+		/* Otherwise it's flattened and there's no telling which way the
+		 * facets face, n is left as zeros.
+		 *
+		 * A mirror turns the facets inside out, swap two corners so the
+		 * winding still agrees with the normal.
+		 */
+		xform->flip = (det < 0.0);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_transform_facets(const double m[16], stl_facet_t *facets, size_t facets_count)
+{
+	stl_error_t  error = STL_SUCCESS;
+	_stl_xform_t xform;
+
+	if((NULL == m) || ((NULL == facets) && (0 != facets_count)))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_xform_prepare(m, &xform);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		_stl_xform_facets(&xform, facets, facets_count);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+/* Not NaN or infinite */
+static int stl_vertex_is_finite(const stl_vertex_t *v)
+{
+	return (fabs(v->x) <= FLT_MAX) && (fabs(v->y) <= FLT_MAX) && (fabs(v->z) <= FLT_MAX);
+}
+
+void _stl_xform_bounds(const double m[12], stl_t *stl)
+{
+	int          row = 0;
+	int          col = 0;
+	int          uses = 0;
+	float        lo[3];
+	float        hi[3];
+	stl_vertex_t a = stl->bounds_min;
+	stl_vertex_t b = stl->bounds_max;
+
+	if(!stl->has_bounds)
+	{
+		return;
+	}
+
+	/* The zeros in m times an infinite corner would make a NaN box */
+	if(!stl_vertex_is_finite(&a) || !stl_vertex_is_finite(&b))
+	{
+		stl->has_bounds = 0;
+		return;
+	}
+
+	/* The box only stays exact if each new coordinate comes from just one
+	 * old one. Rotations almost never manage that (even at 90 degrees cos()
+	 * isn't quite zero), so they drop it and it's found again when needed.
+	 */
+	for(row = 0; row < 3; row++)
+	{
+		uses = 0;
+
+		for(col = 0; col < 3; col++)
+		{
+			uses += (0.0 != m[row * 4 + col]);
+		}
+
+		if(uses > 1)
+		{
+			stl->has_bounds = 0;
+			return;
+		}
+	}
+
+	/* The same sums as the kernels do on each corner, so the ends of the box
+	 * land exactly where the outermost vertices did
+	 */
+	lo[0] = (float)(m[0] * a.x + m[1] * a.y + m[2] * a.z + m[3]);
+	lo[1] = (float)(m[4] * a.x + m[5] * a.y + m[6] * a.z + m[7]);
+	lo[2] = (float)(m[8] * a.x + m[9] * a.y + m[10] * a.z + m[11]);
+
+	hi[0] = (float)(m[0] * b.x + m[1] * b.y + m[2] * b.z + m[3]);
+	hi[1] = (float)(m[4] * b.x + m[5] * b.y + m[6] * b.z + m[7]);
+	hi[2] = (float)(m[8] * b.x + m[9] * b.y + m[10] * b.z + m[11]);
+
+	stl->bounds_min.x = (lo[0] < hi[0]) ? lo[0] : hi[0];
+	stl->bounds_min.y = (lo[1] < hi[1]) ? lo[1] : hi[1];
+	stl->bounds_min.z = (lo[2] < hi[2]) ? lo[2] : hi[2];
+
+	stl->bounds_max.x = (lo[0] < hi[0]) ? hi[0] : lo[0];
+	stl->bounds_max.y = (lo[1] < hi[1]) ? hi[1] : lo[1];
+	stl->bounds_max.z = (lo[2] < hi[2]) ? hi[2] : lo[2];
+}
+
+stl_error_t stl_transform(const double m[16], stl_t *stl)
+{
+	return stl_transform_ctx(NULL, m, stl);
+}
+
+typedef struct
+{
+	stl_facet_t  *facets;
+	_stl_xform_t xform;
+} stl_transform_job_t;
+
+static void stl_transform_chunk(size_t chunk_index, size_t first, size_t count, void *arg)
+{
+	stl_transform_job_t *job = (stl_transform_job_t *)arg;
+
+	_stl_xform_facets(&job->xform, job->facets + first, count);
+}
+
+stl_error_t stl_transform_ctx(stl_ctx_t *ctx, const double m[16], stl_t *stl)
+{
+	stl_error_t         error = STL_SUCCESS;
+	int                 had_bounds = 0;
+	stl_transform_job_t job;
+
+	if((NULL == m) || (NULL == stl))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		error = _stl_xform_prepare(m, &job.xform);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		had_bounds = stl->has_bounds;
+		error = _stl_make_writable(stl);
+	}
+
+	if(STL_SUCCESS == error)
+	{
+		job.facets = stl->facets;
+
+		_stl_ctx_run(ctx, stl->facets_count, STL_CTX_CHUNK_FACETS, stl_transform_chunk, &job);
+
+		stl->has_bounds = had_bounds;
+		_stl_xform_bounds(job.xform.m, stl);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_transform_deferred(const double m[16], stl_t *stl)
+{
+	stl_error_t  error = STL_SUCCESS;
+	double       combined[16];
+	_stl_xform_t xform;
+
+	if((NULL == m) || (NULL == stl))
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* Goes after whatever is already waiting */
+	if(STL_SUCCESS == error)
+	{
+		if(NULL != stl->pending)
+		{
+			stl_matrix_identity(combined);
+			memcpy(combined, stl->pending->m, sizeof(stl->pending->m));
+			stl_matrix_multiply(combined, m, combined);
+		}
+		else
+		{
+			memcpy(combined, m, sizeof(combined));
+		}
+
+		error = _stl_xform_prepare(combined, &xform);
+	}
+
+	/* Bounds of the facets as they are in memory, before anything was
+	 * deferred. Ones found while a transform was already waiting are of
+	 * the facets as seen through it, and can't be used.
+	 */
+	if(STL_SUCCESS == error)
+	{
+		if(NULL != stl->pending)
+		{
+			xform.has_bounds = stl->pending->has_bounds;
+			xform.bounds_min = stl->pending->bounds_min;
+			xform.bounds_max = stl->pending->bounds_max;
+		}
+		else
+		{
+			xform.has_bounds = stl->has_bounds;
+			xform.bounds_min = stl->bounds_min;
+			xform.bounds_max = stl->bounds_max;
+		}
+	}
+
+	if((STL_SUCCESS == error) && (NULL == stl->pending))
+	{
+		stl->pending = (_stl_xform_t *)malloc(sizeof(*stl->pending));
+		if(NULL == stl->pending)
+		{
+			error = STL_LOG_ERR(STL_ERROR_MEMORY_ERROR);
+		}
+	}
+
+	/* The bounds are of the facets as they'll be seen. Moving the current
+	 * box by just this step would round differently from the combined
+	 * transform the facets get, so start again from the box before it all.
+	 */
+	if(STL_SUCCESS == error)
+	{
+		memcpy(stl->pending, &xform, sizeof(xform));
+
+		stl->has_bounds = xform.has_bounds;
+		stl->bounds_min = xform.bounds_min;
+		stl->bounds_max = xform.bounds_max;
+
+		_stl_xform_bounds(xform.m, stl);
+	}
+
+	return STL_LOG_ERR(error);
+}
+
+stl_error_t stl_flush_transform(stl_t *stl)
+{
+	stl_error_t error = STL_SUCCESS;
+
+	if(NULL == stl)
+	{
+		error = STL_LOG_ERR(STL_ERROR_INVALID_ARG);
+	}
+
+	/* Leave mapped objects mapped if there's nothing to apply */
+	if((STL_SUCCESS == error) && (NULL != stl->pending))
+	{
+		error = _stl_make_writable(stl);
+	}
+
+	return STL_LOG_ERR(error);
+}